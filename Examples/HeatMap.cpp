@@ -271,11 +271,14 @@ void run_kernel() {
   auto k = compile(step);
   k.setNumQPUs(settings.num_qpus);
 
+  k.load(&mapA, &mapB, settings.HEIGHT, settings.WIDTH);  // Load the uniforms
+
   for (int i = 0; i < settings.num_steps; i++) {
+    // Swap input and output maps, leaving the dimensions as loaded
     if (i & 1) {
-      k.load(&mapB, &mapA, settings.HEIGHT, settings.WIDTH);  // Load the uniforms
+      k.set_arg<0>(&mapB).set_arg<1>(&mapA);
     } else {
-      k.load(&mapA, &mapB, settings.HEIGHT, settings.WIDTH);  // Load the uniforms
+      k.set_arg<0>(&mapA).set_arg<1>(&mapB);
 		}
 
 		// Invoke the kernel
@@ -19,7 +19,7 @@ const float THETA = (float) 3.14159;
 // Command line handling
 // ============================================================================
 
-std::vector<const char *> const kernels = { "2", "1", "cpu" };  // First is default
+std::vector<const char *> const kernels = { "2", "1", "3", "cpu", "split" };  // First is default
 
 
 CmdParameters params = {
@@ -111,6 +111,51 @@ void run_scalar_kernel() {
 }
 
 
+/**
+ * Run the work on QPUs and host at the same time.
+ *
+ * The split is adjusted over a couple of runs, so that both parts take about the same time.
+ */
+void run_split_kernel() {
+	Timer timer;
+
+	auto k = compile(rot3D_range);
+	k.setNumQPUs(settings.num_qpus);
+
+	SharedArray<float> x(SIZE), y(SIZE);
+	init_arrays(x, y);
+
+	if (!settings.compile_only) {
+		WorkSplit split(16*settings.num_qpus);
+		float const cosTheta = cosf(THETA);
+		float const sinTheta = sinf(THETA);
+		float *x_ptr = x.view().data();
+		float *y_ptr = y.view().data();
+
+		// Repeat a couple of times, so that the split can adapt. The output is that of the last run.
+		for (int run = 0; run < 5; ++run) {
+			init_arrays(x, y);
+
+			split.run(SIZE,
+				[&] (size_t first, size_t last) {
+					k.load((int) first, (int) (last - first), cosTheta, sinTheta, &x, &y);
+					k.call();
+				},
+				[&] (size_t first, size_t last) {
+					rot3D((int) (last - first), cosTheta, sinTheta, x_ptr + first, y_ptr + first);
+				});
+		}
+
+		if (!settings.silent) {
+			printf("QPU share: %.2f\n", split.qpu_share());
+		}
+	}
+
+	disp_arrays(x, y);
+	timer.end(!settings.silent);
+}
+
+
 /**
  * Run a kernel as specified by the passed kernel index
  */
@@ -118,7 +163,9 @@ void run_kernel(int kernel_index) {
 	switch (kernel_index) {
 		case 0: run_qpu_kernel(rot3D_2);  break;	
 		case 1: run_qpu_kernel(rot3D_1);  break;	
-		case 2: run_scalar_kernel(); break;
+		case 2: run_qpu_kernel(rot3D_3);  break;	
+		case 3: run_scalar_kernel(); break;
+		case 4: run_split_kernel();  break;
 	}
 
 	auto name = kernels[kernel_index];
@@ -62,4 +62,36 @@ void rot3D_2(Int n, Float cosTheta, Float sinTheta, Ptr<Float> x, Ptr<Float> y)
   receive(xOld); receive(yOld);
 }
 
+// ============================================================================
+// Vector version 3
+// ============================================================================
+
+/**
+ * Same as version 1, with the work distributed over the QPU's.
+ *
+ * The loads are pipelined automatically, as in version 2.
+ */
+void rot3D_3(Int n, Float cosTheta, Float sinTheta, Ptr<Float> x, Ptr<Float> y) {
+  ParFor (i, 0, n)
+    Float xOld = x[i];
+    Float yOld = y[i];
+    x[i] = xOld * cosTheta - yOld * sinTheta;
+    y[i] = yOld * cosTheta + xOld * sinTheta;
+  End
+}
+
+
+// ============================================================================
+// Vector version for a subrange
+// ============================================================================
+
+/**
+ * Version 2, for the vertices in range [offset, offset + n).
+ *
+ * Used for splitting the work between QPUs and host.
+ */
+void rot3D_range(Int offset, Int n, Float cosTheta, Float sinTheta, Ptr<Float> x, Ptr<Float> y) {
+  rot3D_2(n, cosTheta, sinTheta, x + offset, y + offset);
+}
+
 }  // namespace Rot3DLib
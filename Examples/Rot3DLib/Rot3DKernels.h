@@ -9,6 +9,7 @@ void rot3D(int n, float cosTheta, float sinTheta, float* x, float* y);
 void rot3D_1(Int n, Float cosTheta, Float sinTheta, Ptr<Float>x, Ptr<Float> y);
 void rot3D_2(Int n, Float cosTheta, Float sinTheta, Ptr<Float> x, Ptr<Float> y);
 void rot3D_3(Int n, Float cosTheta, Float sinTheta, Ptr<Float> x, Ptr<Float> y);
+void rot3D_range(Int offset, Int n, Float cosTheta, Float sinTheta, Ptr<Float> x, Ptr<Float> y);
 
 }  // namespace Rot3DLib
 
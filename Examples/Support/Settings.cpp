@@ -5,9 +5,12 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 #include "Settings.h"
+#include <cstdlib>  // atexit()
 #include <memory>
 #include <iostream>
 #include "Kernel.h"
+#include "Common/BufferObject.h"  // heap_stats()
+#include "Support/InstructionComment.h"
 
 #ifdef QPU_MODE
 #include "Support/Platform.h"
@@ -72,6 +75,11 @@ CmdParameters base_params = {
     "-f",
     ParamType::NONE,     // Prefix needed to dsambiguate
     "Write representations of the generated code to file"
+  }, {
+    "Output Compile Statistics",
+    "-stats",
+    ParamType::NONE,
+    "Write the time and memory usage per compile pass to file, in JSON format"
   }, { 
     "Compile Only",
     "-c",
@@ -87,6 +95,16 @@ CmdParameters base_params = {
     "-s", "-silent",
     ParamType::NONE,     // Prefix needed to dsambiguate
     "Do not show the logging output on standard output"
+  }, {
+    "Output Heap Statistics",
+    "-heap-stats",
+    ParamType::NONE,
+    "Show the usage statistics of the heap for shared arrays at exit"
+  }, {
+    "Trace Heap Allocations",
+    "-heap-trace",
+    ParamType::NONE,
+    "Record where shared arrays are allocated, and show the ones not deallocated at exit"
 #ifdef QPU_MODE
     }, {
     "Performance Counters",
@@ -114,6 +132,23 @@ CmdParameters numqpu_params = {
 
 std::unique_ptr<CmdParameters> params;
 
+bool show_heap_stats = false;
+bool show_heap_trace = false;
+
+
+/**
+ * Called at program exit, so that all local shared arrays have been deallocated
+ */
+void output_heap_info() {
+  if (show_heap_stats) {
+    printf("%s", V3DLib::heap_stats().dump().c_str());
+  }
+
+  if (show_heap_trace) {
+    printf("%s", V3DLib::heap_trace_dump().c_str());
+  }
+}
+
 CmdParameters &instance(bool use_numqpus = false) {
   if (!params) {
     CmdParameters *p = new CmdParameters(base_params);
@@ -184,9 +219,12 @@ void Settings::set_name(const char *in_name) {
 
 bool Settings::process(CmdParameters &in_params) {
   output_code  = in_params.parameters()["Output Generated Code"]->get_bool_value();
+  output_stats = in_params.parameters()["Output Compile Statistics"]->get_bool_value();
   compile_only = in_params.parameters()["Compile Only"]->get_bool_value();
   silent       = in_params.parameters()["Disable logging"]->get_bool_value();
   run_type     = in_params.parameters()["Select run type"]->get_int_value();
+  output_heap_stats = in_params.parameters()["Output Heap Statistics"]->get_bool_value();
+  trace_heap        = in_params.parameters()["Trace Heap Allocations"]->get_bool_value();
 #ifdef QPU_MODE
   show_perf_counters = in_params.parameters()["Performance Counters"]->get_bool_value();
 #endif  // QPU_MODE
@@ -211,10 +249,24 @@ bool Settings::process(CmdParameters &in_params) {
     disable_logging();
   }
 
+  if (output_code) {
+    InstructionComment::enable();  // Comments are only collected for the generated code output
+  }
+
   if (compile_only || run_type != 0) {
     Platform::use_main_memory(true);
   }
 
+  if (trace_heap) {
+    heap_trace(true);
+  }
+
+  if (output_heap_stats || trace_heap) {
+    show_heap_stats = output_heap_stats;
+    show_heap_trace = trace_heap;
+    std::atexit(output_heap_info);
+  }
+
   return true;
 }
 
@@ -300,6 +352,8 @@ void Settings::process(KernelBase &k) {
 
   stopPerfCounters();
 
+  bool output_for_vc4 = Platform::instance().has_vc4 || (run_type != 0);
+
   // NOTE: For multiple calls here (entirely possible, HeatMap does this),
   //       this will dump the v3d code (mnemonics, actually) on every call.
   if (output_code) {
@@ -307,7 +361,6 @@ void Settings::process(KernelBase &k) {
       assert(!name.empty());
       std::string code_filename = name + "_code.txt";
 
-      bool output_for_vc4 = Platform::instance().has_vc4 || (run_type != 0);
       k.pretty(output_for_vc4, code_filename.c_str());
     } else if (output_count == 1) {
       warning("Not outputting code more than once");
@@ -315,6 +368,26 @@ void Settings::process(KernelBase &k) {
 
     output_count++;
   }
+
+  // Done after code output, so that the encoding passes are included
+  if (output_stats) {
+    if (stats_count == 0) {
+      assert(!name.empty());
+      std::string stats_filename = name + "_stats.json";
+
+      std::string json = k.compile_stats(output_for_vc4).to_json(output_for_vc4?"vc4":"v3d");
+
+      FILE *f = fopen(stats_filename.c_str(), "w");
+      if (f == nullptr) {
+        error("Could not open file '" + stats_filename + "' for writing");
+      } else {
+        fprintf(f, "%s", json.c_str());
+        fclose(f);
+      }
+    }
+
+    stats_count++;
+  }
 }
 
 }  // namespace V3DLib;
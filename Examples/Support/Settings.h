@@ -12,8 +12,11 @@ struct Settings {
 	std::string name;
 
 	bool output_code;
+	bool output_stats;
 	bool compile_only;
 	bool silent;
+	bool output_heap_stats;
+	bool trace_heap;
 	int  run_type;
 	int  num_qpus = 1;
 #ifdef QPU_MODE
@@ -30,6 +33,7 @@ private:
 	CmdParameters * const m_derived_params;
 	bool const m_use_num_qpus;
 	int output_count = 0;
+	int stats_count  = 0;
 
 	void set_name(const char *in_name);
 	bool process(CmdParameters &in_params);
@@ -0,0 +1,75 @@
+#include "CommandQueue.h"
+#include <map>
+#include "Support/basics.h"  // fatal()
+
+namespace V3DLib {
+
+/**
+ * Record an invocation of the kernel with its currently loaded parameters.
+ *
+ * The parameters are copied, so the kernel can be loaded and recorded again
+ * with different parameters. The kernel must stay valid until the queue is
+ * submitted or cleared.
+ *
+ * The kernel is encoded here if not done already, so that `submit()` can
+ * run on a background thread.
+ */
+void CommandQueue::record(KernelBase &k) {
+  assertq(k.uniforms.size() != 0, "CommandQueue::record(): kernel parameters not loaded", true);
+
+  k.prepare(k.numQPUs);
+
+  Launch launch;
+  launch.kernel   = &k;
+  launch.num_qpus = k.numQPUs;
+  launch.params   = k.uniforms;
+  m_launches.push_back(launch);
+}
+
+
+/**
+ * Add the invocations recorded in the given queue, after the ones already recorded
+ */
+void CommandQueue::append(CommandQueue const &q) {
+  m_launches.insert(m_launches.end(), q.m_launches.begin(), q.m_launches.end());
+}
+
+
+/**
+ * Run the recorded invocations, in order of recording.
+ *
+ * Returns when all invocations are done. Afterwards, the queue is empty.
+ */
+void CommandQueue::submit() {
+  // Don't run concurrently with runs started by `KernelBase::launch()`
+  for (auto &launch : m_launches) {
+    launch.kernel->wait();
+  }
+
+#if defined(QPU_MODE) && !defined(EMULATION_MODE)
+  if (!Platform::instance().has_vc4) {
+    v3d::Batch batch;
+    std::map<KernelBase *, int> count;  // Invocations per kernel, for selecting the uniforms
+
+    for (auto &launch : m_launches) {
+      launch.kernel->m_v3d_driver.enqueue(launch.num_qpus, launch.params, batch, count[launch.kernel]++);
+    }
+
+    if (!batch.submit()) {
+      m_launches.clear();
+      fatal("CommandQueue::submit(): failed to run the kernels");
+    }
+
+    m_launches.clear();
+    return;
+  }
+#endif
+
+  for (auto &launch : m_launches) {
+    launch.kernel->call(launch.num_qpus, launch.params);
+  }
+
+  m_launches.clear();
+}
+
+}  // namespace V3DLib
@@ -0,0 +1,48 @@
+#ifndef _V3DLIB_COMMANDQUEUE_H_
+#define _V3DLIB_COMMANDQUEUE_H_
+#include <vector>
+#include "Kernel.h"
+
+namespace V3DLib {
+
+/**
+ * Records kernel invocations, for running them together.
+ *
+ * Usage:
+ *
+ *     CommandQueue queue;
+ *     k1.load(&a, 1); queue.record(k1);
+ *     k2.load(&a, &b); queue.record(k2);
+ *     queue.submit();
+ *
+ * The invocations run in order of recording, each one starting after the
+ * previous one has finished.
+ *
+ * On v3d, the invocations are submitted as consecutive compute jobs with a
+ * single wait at the end. On vc4, the QPU's started by a single mailbox call
+ * run concurrently, which would break the ordering; the invocations are run
+ * one after the other instead. In emulation mode, they are emulated in order.
+ */
+class CommandQueue {
+public:
+  void record(KernelBase &k);
+  void append(CommandQueue const &q);
+  void submit();
+  void clear() { m_launches.clear(); }
+
+  int size() const { return (int) m_launches.size(); }
+  bool empty() const { return m_launches.empty(); }
+
+private:
+  struct Launch {
+    KernelBase   *kernel   = nullptr;
+    int           num_qpus = 1;
+    Seq<int32_t>  params;
+  };
+
+  std::vector<Launch> m_launches;
+};
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_COMMANDQUEUE_H_
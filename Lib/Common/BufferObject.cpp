@@ -1,11 +1,23 @@
 #include "BufferObject.h"
+#include <algorithm>  // std::max(), std::min(), std::reverse()
+#include <atomic>
+#include <cstdlib>    // free()
+#include <map>
+#include <memory>
+#include <mutex>
 #include "Support/Platform.h"
+#include "Support/basics.h"  // fatal()
 #include "Support/debug.h"
 #include "BufferType.h"
+#include "SlabAllocator.h"
 #include "Target/BufferObject.h"
 #include "vc4/BufferObject.h"
 #include "v3d/BufferObject.h"
 
+#ifdef __GLIBC__
+#include <execinfo.h>  // backtrace()
+#endif
+
 namespace V3DLib {
 
 /**
@@ -15,19 +27,46 @@ namespace V3DLib {
  * @return physical address of the newly allocated memory in the heap
  */
 uint32_t BufferObject::alloc_array(uint32_t size_in_bytes, uint8_t *&array_start_address) {
+  uint32_t ret = 0;
+
+  if (!try_alloc_array(size_in_bytes, ret, array_start_address)) {
+    fatal("V3DLib: heap overflow (increase heap size)");
+  }
+
+  return ret;
+}
+
+
+/**
+ * Allocate memory if there is enough space available
+ *
+ * @param size_in_bytes        requested size of memory to allocate 
+ * @param phyaddr              out parameter; physical address of the newly allocated memory
+ * @param array_start_address  out parameter; memory address of the newly allocated memory in the heap
+ *
+ * @return true if allocated, false if there is not enough space
+ */
+bool BufferObject::try_alloc_array(uint32_t size_in_bytes, uint32_t &phyaddr, uint8_t *&array_start_address) {
   int new_offset = HeapManager::alloc_array(size_in_bytes);
-  assert(new_offset >= 0);
+  if (new_offset < 0) return false;
+
   array_start_address = arm_base + (uint32_t) new_offset;
-  return phy_address() + (uint32_t) new_offset;
+  phyaddr = phy_address() + (uint32_t) new_offset;
+  return true;
 }
 
 
 void BufferObject::dealloc_array(uint32_t in_phyaddr, uint32_t in_size) {
-  assert(phy_address() <= in_phyaddr && in_phyaddr < (phy_address() + size()));
+  assert(contains(in_phyaddr));
   HeapManager::dealloc_array(in_phyaddr - phy_address(), in_size);
 }
 
 
+bool BufferObject::contains(uint32_t in_phyaddr) const {
+  return phy_address() <= in_phyaddr && in_phyaddr < (phy_address() + size());
+}
+
+
 uint32_t BufferObject::getHandle() const {
   breakpoint
   assertq(!Platform::instance().compiling_for_vc4(), "getHandle(): only use this override when compiling for v3d");
@@ -67,4 +106,614 @@ BufferObject &getBufferObject() {
   }
 }
 
+
+namespace {
+
+using BufferObjects = std::vector<std::unique_ptr<BufferObject>>;
+
+/**
+ * Guards the administration of the heaps below.
+ *
+ * Allocating small arrays via a `ThreadCache` does not need this lock.
+ */
+std::mutex heap_mutex;
+
+/**
+ * Extra buffer objects per main buffer object
+ */
+std::map<BufferObject const *, BufferObjects> extra_heaps;
+
+/**
+ * Buffer objects per main buffer object which are accessible to kernels, but
+ * not used for allocation. See `heap_attach()`.
+ */
+std::map<BufferObject const *, BufferObjects> attached_heaps;
+
+/**
+ * Incremented whenever a buffer object is added to or removed from a heap.
+ */
+std::atomic<uint32_t> generation(0);
+
+
+std::vector<BufferObject *> buffer_objects(BufferObject &main) {
+  std::vector<BufferObject *> ret;
+  ret.push_back(&main);
+
+  auto it = extra_heaps.find(&main);
+  if (it != extra_heaps.end()) {
+    for (auto &bo : it->second) {
+      ret.push_back(bo.get());
+    }
+  }
+
+  return ret;
+}
+
+
+/**
+ * Get the buffer objects used for allocation, and the attached buffer objects
+ */
+std::vector<BufferObject *> all_buffer_objects(BufferObject &main) {
+  auto ret = buffer_objects(main);
+
+  auto it = attached_heaps.find(&main);
+  if (it != attached_heaps.end()) {
+    for (auto &bo : it->second) {
+      ret.push_back(bo.get());
+    }
+  }
+
+  return ret;
+}
+
+
+/**
+ * Create an extra buffer object of the same kind as the main buffer object
+ *
+ * @param mem  memory to use for the buffer object, only for emulation mode
+ */
+std::unique_ptr<BufferObject> new_buffer_object(BufferObject &main, uint32_t size, uint8_t *mem = nullptr) {
+  BufferObject *ret = nullptr;
+  assert(mem == nullptr || Platform::instance().use_main_memory());
+
+  if (Platform::instance().use_main_memory()) {
+    // Use a range of physical addresses after the existing ones
+    uint32_t phyaddr = 0;
+
+    for (auto const *bo : all_buffer_objects(main)) {
+      phyaddr = std::max(phyaddr, bo->phy_address() + bo->size());
+    }
+
+    ret = new emu::BufferObject(size, phyaddr, mem);
+  } else if (Platform::instance().has_vc4) {
+    auto *bo = new vc4::BufferObject();
+    bo->alloc_mem(size);
+    ret = bo;
+  } else {
+    ret = new v3d::BufferObject(size);
+  }
+
+  return std::unique_ptr<BufferObject>(ret);
+}
+
+
+/**
+ * Allocate memory from the heap with the given main buffer object.
+ *
+ * If the memory is not available in the existing buffer objects, an extra buffer object
+ * is allocated.
+ */
+SlabAllocator::Range alloc_range(BufferObject &main, uint32_t size_in_bytes) {
+  SlabAllocator::Range ret;
+
+  for (auto *cur : buffer_objects(main)) {
+    if (cur->try_alloc_array(size_in_bytes, ret.phyaddr, ret.usr_address)) {
+      ret.bo = cur;
+      return ret;
+    }
+  }
+
+  // Add a buffer object, large enough to contain the requested size
+  uint32_t page = 4096;
+  uint32_t size = std::max((uint32_t) BufferObject::DEFAULT_HEAP_SIZE, (size_in_bytes/page + 1)*page);
+
+  auto &extra = extra_heaps[&main];
+  extra.push_back(new_buffer_object(main, size));
+  generation++;
+  ret.bo = extra.back().get();
+
+  ret.phyaddr = ret.bo->alloc_array(size_in_bytes, ret.usr_address);
+  return ret;
+}
+
+
+/**
+ * Deallocate memory obtained with `alloc_range()`.
+ *
+ * Extra buffer objects are released when they are no longer used.
+ */
+void dealloc_range(BufferObject &bo, uint32_t phyaddr, uint32_t size_in_bytes) {
+  bo.dealloc_array(phyaddr, size_in_bytes);
+  if (!bo.empty()) return;
+
+  for (auto &it : extra_heaps) {
+    auto &extra = it.second;
+
+    for (auto cur = extra.begin(); cur != extra.end(); ++cur) {
+      if (cur->get() == &bo) {
+        extra.erase(cur);
+        generation++;
+        return;
+      }
+    }
+  }
+}
+
+
+/**
+ * Allocators for small arrays, per main buffer object
+ */
+std::map<BufferObject const *, SlabAllocator> slab_allocators;
+
+
+SlabAllocator &slab_allocator(BufferObject &main) {
+  auto it = slab_allocators.find(&main);
+  if (it != slab_allocators.end()) return it->second;
+
+  SlabAllocator allocator(
+    [&main] (uint32_t size_in_bytes) {
+      return alloc_range(main, size_in_bytes);
+    },
+    [] (SlabAllocator::Range const &range, uint32_t size_in_bytes) {
+      dealloc_range(*range.bo, range.phyaddr, size_in_bytes);
+    }
+  );
+
+  return slab_allocators.insert({&main, allocator}).first->second;
+}
+
+
+/**
+ * Per-thread cache of free slots for small arrays.
+ *
+ * Small arrays are allocated and deallocated via the cache of the current thread,
+ * without locking. The cache exchanges slots with the slab allocator in batches.
+ *
+ * Only slots in the main buffer object are cached. The main buffer objects are
+ * never released, so the cached slots stay valid.
+ */
+class ThreadCache {
+public:
+  ~ThreadCache() { flush(); }
+
+  SlabAllocator::Range alloc(BufferObject &main, uint32_t size_in_bytes);
+  bool dealloc(BufferObject &main, BufferObject &bo, uint32_t phyaddr, uint32_t size_in_bytes);
+
+private:
+  static int const CAPACITY = 32;  // Max number of cached slots per size class
+  static int const BATCH    = 16;  // Number of slots to exchange with the slab allocator
+
+  BufferObject *m_main = nullptr;
+  std::vector<SlabAllocator::Range> m_slots[SlabAllocator::NUM_CLASSES];
+
+  void set_main(BufferObject &main);
+  void release(int index, int count);
+  void flush();
+};
+
+
+SlabAllocator::Range ThreadCache::alloc(BufferObject &main, uint32_t size_in_bytes) {
+  set_main(main);
+  auto &slots = m_slots[SlabAllocator::class_index(size_in_bytes)];
+
+  if (slots.empty()) {
+    std::lock_guard<std::mutex> guard(heap_mutex);
+    auto &allocator = slab_allocator(main);
+
+    for (int i = 0; i < BATCH; ++i) {
+      auto range = allocator.alloc(size_in_bytes);
+
+      if (range.bo != &main) {
+        // Slab in an extra buffer object, don't cache
+        if (slots.empty()) return range;
+        allocator.dealloc(*range.bo, range.phyaddr, size_in_bytes);
+        break;
+      }
+
+      slots.push_back(range);
+    }
+
+    // Hand out the slots in order of address
+    std::reverse(slots.begin(), slots.end());
+  }
+
+  auto ret = slots.back();
+  slots.pop_back();
+  return ret;
+}
+
+
+/**
+ * @return true if the slot was added to the cache, false otherwise
+ */
+bool ThreadCache::dealloc(BufferObject &main, BufferObject &bo, uint32_t phyaddr, uint32_t size_in_bytes) {
+  if (&bo != &main) return false;
+  set_main(main);
+
+  int index = SlabAllocator::class_index(size_in_bytes);
+  auto &slots = m_slots[index];
+
+  if ((int) slots.size() >= CAPACITY) {
+    release(index, BATCH);
+  }
+
+  SlabAllocator::Range range;
+  range.bo          = &bo;
+  range.phyaddr     = phyaddr;
+  range.usr_address = bo.usr_address() + (phyaddr - bo.phy_address());
+  slots.push_back(range);
+  return true;
+}
+
+
+void ThreadCache::set_main(BufferObject &main) {
+  if (m_main == &main) return;
+
+  flush();
+  m_main = &main;
+}
+
+
+/**
+ * Return the oldest cached slots of a size class to the slab allocator
+ */
+void ThreadCache::release(int index, int count) {
+  auto &slots = m_slots[index];
+  if (slots.empty()) return;
+  assert(m_main != nullptr);
+
+  count = std::min(count, (int) slots.size());
+  uint32_t slot_size = SlabAllocator::MIN_SLOT_SIZE << index;
+
+  std::lock_guard<std::mutex> guard(heap_mutex);
+  auto &allocator = slab_allocator(*m_main);
+
+  for (int i = 0; i < count; ++i) {
+    bool found = allocator.dealloc(*slots[i].bo, slots[i].phyaddr, slot_size);
+    assert(found);
+    (void) found;
+  }
+
+  slots.erase(slots.begin(), slots.begin() + count);
+}
+
+
+void ThreadCache::flush() {
+  for (int index = 0; index < SlabAllocator::NUM_CLASSES; ++index) {
+    release(index, (int) m_slots[index].size());
+  }
+}
+
+
+thread_local ThreadCache thread_cache;
+
+
+/**
+ * Usage statistics of the global heap, counted per allocated array.
+ *
+ * These are updated without locking, so that the thread caches stay lock-free.
+ */
+struct Counters {
+  std::atomic<uint32_t> used;
+  std::atomic<uint32_t> peak;
+  std::atomic<uint32_t> num_allocs;
+  std::atomic<uint32_t> num_live;
+  std::atomic<uint32_t> histogram[HeapStats::NUM_BUCKETS];
+};
+
+Counters counters;  // Zero-initialized as a global
+
+
+/**
+ * Allocation sites of the arrays in the global heap, for finding arrays which are
+ * never deallocated.
+ */
+struct AllocationSite {
+  uint32_t            size = 0;
+  std::vector<void *> frames;
+};
+
+std::atomic<bool> trace_enabled(false);
+std::mutex trace_mutex;
+std::map<uint32_t, AllocationSite> trace_sites;  // By physical address
+
+
+void count_alloc(uint32_t phyaddr, uint32_t size_in_bytes) {
+  uint32_t used = (counters.used += size_in_bytes);
+  uint32_t peak = counters.peak;
+  while (peak < used && !counters.peak.compare_exchange_weak(peak, used));
+
+  counters.num_allocs++;
+  counters.num_live++;
+  counters.histogram[HeapStats::bucket(size_in_bytes)]++;
+
+  if (!trace_enabled) return;
+
+  AllocationSite site;
+  site.size = size_in_bytes;
+
+#ifdef __GLIBC__
+  int const MAX_FRAMES = 16;
+  site.frames.resize(MAX_FRAMES);
+  int num_frames = backtrace(site.frames.data(), MAX_FRAMES);
+  site.frames.resize(num_frames);
+#endif
+
+  std::lock_guard<std::mutex> guard(trace_mutex);
+  trace_sites[phyaddr] = site;
+}
+
+
+void count_dealloc(uint32_t phyaddr, uint32_t size_in_bytes) {
+  counters.used -= size_in_bytes;
+  counters.num_live--;
+
+  if (!trace_enabled) return;
+
+  std::lock_guard<std::mutex> guard(trace_mutex);
+  trace_sites.erase(phyaddr);
+}
+
+}  // anon namespace
+
+
+/**
+ * Allocate memory from the heap for the current platform.
+ *
+ * Small arrays are allocated from slabs, see `SlabAllocator`; larger arrays from the
+ * buffer objects directly.
+ *
+ * This is thread-safe. Small arrays are usually handled by a per-thread cache,
+ * which does not lock.
+ *
+ * @param size_in_bytes        requested size of memory to allocate 
+ * @param bo                   out parameter; the buffer object from which the memory was allocated
+ * @param array_start_address  out parameter; memory address of the newly allocated memory in the heap
+ *
+ * @return physical address of the newly allocated memory in the heap
+ */
+uint32_t heap_alloc(uint32_t size_in_bytes, BufferObject *&bo, uint8_t *&array_start_address) {
+  BufferObject &main = getBufferObject();
+  SlabAllocator::Range range;
+
+  if (SlabAllocator::handles(size_in_bytes)) {
+    range = thread_cache.alloc(main, size_in_bytes);
+  } else {
+    std::lock_guard<std::mutex> guard(heap_mutex);
+    range = alloc_range(main, size_in_bytes);
+  }
+
+  count_alloc(range.phyaddr, size_in_bytes);
+
+  bo = range.bo;
+  array_start_address = range.usr_address;
+  return range.phyaddr;
+}
+
+
+/**
+ * Deallocate memory obtained with `heap_alloc()`.
+ *
+ * The memory may have been allocated by another thread.
+ */
+void heap_dealloc(BufferObject &bo, uint32_t phyaddr, uint32_t size_in_bytes) {
+  count_dealloc(phyaddr, size_in_bytes);
+
+  if (SlabAllocator::handles(size_in_bytes)) {
+    if (thread_cache.dealloc(getBufferObject(), bo, phyaddr, size_in_bytes)) return;
+  }
+
+  std::lock_guard<std::mutex> guard(heap_mutex);
+
+  if (!SlabAllocator::handles(size_in_bytes)) {
+    dealloc_range(bo, phyaddr, size_in_bytes);
+    return;
+  }
+
+  for (auto &it : slab_allocators) {
+    if (it.second.dealloc(bo, phyaddr, size_in_bytes)) return;
+  }
+
+  assertq(false, "heap_dealloc(): small array not allocated from a slab", true);
+}
+
+
+/**
+ * Get all buffer objects of the heap with the given main buffer object.
+ *
+ * @return list of buffer objects, the main buffer object first. This includes
+ *         the buffer objects added with `heap_attach()`.
+ */
+std::vector<BufferObject *> heap_buffer_objects(BufferObject &main) {
+  std::lock_guard<std::mutex> guard(heap_mutex);
+  return all_buffer_objects(main);
+}
+
+
+/**
+ * Get the current generation of the heaps.
+ *
+ * The generation changes whenever buffer objects are added to or removed from
+ * a heap. This allows callers to keep the list of `heap_buffer_objects()` and
+ * only retrieve it again when the generation has changed.
+ */
+uint32_t heap_generation() {
+  return generation;
+}
+
+
+/**
+ * Add a buffer object to the global heap, which is not used for allocating arrays.
+ *
+ * The memory of the buffer object is accessible to kernels. It can be used
+ * by `SharedArray` instances with `SharedArray::heap_view()`.
+ *
+ * @param size_in_bytes  size of the buffer object
+ * @param mem            memory to use for the buffer object, only for emulation mode.
+ *                       The caller remains the owner of this memory.
+ *
+ * @return the new buffer object; release it with `heap_detach()`
+ */
+BufferObject &heap_attach(uint32_t size_in_bytes, uint8_t *mem) {
+  assert(size_in_bytes > 0);
+  BufferObject &main = getBufferObject();
+
+  std::lock_guard<std::mutex> guard(heap_mutex);
+  auto &attached = attached_heaps[&main];
+  attached.push_back(new_buffer_object(main, size_in_bytes, mem));
+  generation++;
+  return *attached.back();
+}
+
+
+/**
+ * Release a buffer object obtained with `heap_attach()`
+ */
+void heap_detach(BufferObject &bo) {
+  std::lock_guard<std::mutex> guard(heap_mutex);
+
+  for (auto &it : attached_heaps) {
+    auto &attached = it.second;
+
+    for (auto cur = attached.begin(); cur != attached.end(); ++cur) {
+      if (cur->get() == &bo) {
+        attached.erase(cur);
+        generation++;
+        return;
+      }
+    }
+  }
+
+  assertq(false, "heap_detach(): buffer object not attached to a heap", true);
+}
+
+
+/**
+ * Get the usage statistics of the global heap.
+ *
+ * The used size and the histogram count the allocated arrays. The free space is
+ * taken from the buffer objects of the heap, so memory reserved for slabs counts
+ * as used.
+ */
+HeapStats heap_stats() {
+  BufferObject &main = getBufferObject();
+  HeapStats ret;
+
+  {
+    std::lock_guard<std::mutex> guard(heap_mutex);
+
+    for (auto *bo : buffer_objects(main)) {
+      HeapStats bo_stats = bo->stats();
+
+      ret.size            += bo_stats.size;
+      ret.free            += bo_stats.free;
+      ret.largest_free     = std::max(ret.largest_free, bo_stats.largest_free);
+      ret.num_free_ranges += bo_stats.num_free_ranges;
+    }
+  }
+
+  ret.used       = counters.used;
+  ret.peak       = counters.peak;
+  ret.num_allocs = counters.num_allocs;
+  ret.num_live   = counters.num_live;
+
+  for (int i = 0; i < HeapStats::NUM_BUCKETS; ++i) {
+    ret.histogram[i] = counters.histogram[i];
+  }
+
+  return ret;
+}
+
+
+/**
+ * Enable or disable recording the allocation sites of arrays in the global heap.
+ *
+ * Only arrays allocated while enabled are reported by `heap_trace_dump()`.
+ */
+void heap_trace(bool enable) {
+  std::lock_guard<std::mutex> guard(trace_mutex);
+  trace_enabled = enable;
+  if (!enable) trace_sites.clear();
+}
+
+
+/**
+ * Show the arrays in the global heap which have not been deallocated, with the
+ * call stack of their allocation.
+ *
+ * Function names are only shown if the program is linked with `-rdynamic`;
+ * otherwise, use `addr2line` on the offsets.
+ */
+std::string heap_trace_dump() {
+  std::lock_guard<std::mutex> guard(trace_mutex);
+  std::string ret;
+
+  if (trace_sites.empty()) {
+    ret << "No live arrays in the heap trace\n";
+    return ret;
+  }
+
+  ret << "Live arrays in the heap trace: " << (int) trace_sites.size() << "\n";
+
+  for (auto const &it : trace_sites) {
+    auto const &site = it.second;
+    ret << "  " << site.size << " bytes at physical address " << it.first << ", allocated at:\n";
+
+#ifdef __GLIBC__
+    char **symbols = backtrace_symbols(site.frames.data(), (int) site.frames.size());
+    if (symbols == nullptr) continue;
+
+    for (int i = 1; i < (int) site.frames.size(); ++i) {  // Skip the frame of count_alloc()
+      ret << "    " << symbols[i] << "\n";
+    }
+
+    free(symbols);
+#else
+    ret << "    (not available)\n";
+#endif
+  }
+
+  return ret;
+}
+
+
+/**
+ * Get a word in the heap.
+ *
+ * @param i  physical address, in words
+ */
+uint32_t &HeapView::phy(uint32_t i) {
+  assert(m_main != nullptr);
+  uint32_t phyaddr = 4*i;
+
+  if (!m_last->contains(phyaddr)) {
+    m_last = nullptr;
+
+    for (auto *bo : heap_buffer_objects(*m_main)) {
+      if (bo->contains(phyaddr)) {
+        m_last = bo;
+        break;
+      }
+    }
+
+    if (m_last == nullptr) {
+      m_last = m_main;
+      assertq(false, "HeapView::phy(): address outside of heap", true);
+    }
+  }
+
+  uint32_t *base = (uint32_t *) m_last->usr_address();
+  return base[(phyaddr - m_last->phy_address())/4];
+}
+
 }  // namespace V3DLib
@@ -3,6 +3,8 @@
 // This is the very first include file of the library to be compiled,
 // therefore a great place for global includes.
 #include <stdint.h>
+#include <string>
+#include <vector>
 #include "defines.h"
 #include "Common/BufferType.h"
 #include "Support/HeapManager.h"
@@ -19,12 +21,14 @@ public:
   virtual uint32_t getHandle() const;
 
   uint32_t alloc_array(uint32_t size_in_bytes, uint8_t *&array_start_address);
+  bool try_alloc_array(uint32_t size_in_bytes, uint32_t &phyaddr, uint8_t *&array_start_address);
   void dealloc_array(uint32_t in_phyaddr, uint32_t in_size);
 
   static const int DEFAULT_HEAP_SIZE = 5*1024*1024;
 
   uint32_t phy_address() const { return phyaddr; }
   uint8_t *usr_address() { return arm_base; }
+  bool contains(uint32_t in_phyaddr) const;
 
 protected:
   uint8_t *arm_base = nullptr;
@@ -43,6 +47,39 @@ private:
 
 BufferObject &getBufferObject();
 
+
+//
+// The heap for SharedArray instances consists of the main buffer object, as returned
+// by `getBufferObject()`, and extra buffer objects which are added when the main
+// buffer object is full.
+//
+uint32_t heap_alloc(uint32_t size_in_bytes, BufferObject *&bo, uint8_t *&array_start_address);
+void heap_dealloc(BufferObject &bo, uint32_t phyaddr, uint32_t size_in_bytes);
+std::vector<BufferObject *> heap_buffer_objects(BufferObject &main);
+uint32_t heap_generation();
+BufferObject &heap_attach(uint32_t size_in_bytes, uint8_t *mem = nullptr);
+void heap_detach(BufferObject &bo);
+
+HeapStats heap_stats();
+void heap_trace(bool enable);
+std::string heap_trace_dump();
+
+
+/**
+ * Access to the memory of all buffer objects of a heap by physical address.
+ *
+ * Used by the emulator and the interpreter.
+ */
+class HeapView {
+public:
+  void heap_view(BufferObject &main) { m_main = &main; m_last = &main; }
+  uint32_t &phy(uint32_t i);
+
+private:
+  BufferObject *m_main = nullptr;
+  BufferObject *m_last = nullptr;  // Buffer object of the previous access
+};
+
 }  // namespace V3DLib
 
 #endif  // _V3DLIB_COMMON_BUFFEROBJECT_H_
@@ -0,0 +1,188 @@
+#include "FileMapping.h"
+#include <algorithm>    // std::min()
+#include <cerrno>
+#include <cstring>      // strerror()
+#include <fcntl.h>      // open()
+#include <sys/mman.h>   // mmap()
+#include <sys/stat.h>   // fstat()
+#include <unistd.h>     // pread(), pwrite(), sysconf()
+#include "Support/Platform.h"
+#include "Support/basics.h"  // fatal()
+
+namespace V3DLib {
+namespace {
+
+/**
+ * Number of bytes per read or write call, when copying between the file and a buffer object
+ */
+size_t const CHUNK_SIZE = 4*1024*1024;
+
+}  // anon namespace
+
+
+/**
+ * @param filename  file to map
+ * @param mode      access mode, see class description
+ * @param offset    offset in bytes of the range to map in the file
+ * @param size      size in bytes of the range to map. If 0, the range extends
+ *                  to the end of the file, which fails if that is more than 4 GiB.
+ *                  Required for mode `CREATE`.
+ */
+FileMapping::FileMapping(std::string const &filename, Mode mode, off_t offset, uint32_t size) :
+  m_filename(filename),
+  m_mode(mode),
+  m_offset(offset),
+  m_size(size)
+{
+  assertq(offset >= 0, "FileMapping: offset can not be negative", true);
+  assertq(mode != CREATE || size > 0, "FileMapping: size required when creating a file", true);
+
+  int flags = O_RDONLY;
+  if (mode == READ_WRITE) flags = O_RDWR;
+  if (mode == CREATE)     flags = O_RDWR | O_CREAT | O_TRUNC;
+
+  m_fd = open(filename.c_str(), flags, 0644);
+  if (m_fd < 0) fail("could not open file");
+
+  if (mode == CREATE) {
+    if (ftruncate(m_fd, offset + (off_t) size) != 0) fail("could not set file size");
+  } else {
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) fail("could not get file size");
+
+    if (offset >= st.st_size) fail("offset beyond end of file", false);
+
+    if (m_size == 0) {
+      // Buffer object sizes are 32-bit
+      if ((uint64_t) (st.st_size - offset) > UINT32_MAX) fail("range larger than 4 GiB, pass a size", false);
+      m_size = (uint32_t) (st.st_size - offset);
+    } else if (offset + (off_t) m_size > st.st_size) {
+      fail("range beyond end of file", false);
+    }
+  }
+
+  if (Platform::instance().use_main_memory()) {
+    map_file();
+  } else {
+    read_file();
+  }
+}
+
+
+FileMapping::~FileMapping() {
+  if (m_mode != READ_ONLY) {
+    sync();
+  }
+
+  release();
+}
+
+
+/**
+ * Write changes to the memory to the file.
+ *
+ * Does nothing for mode `READ_ONLY`.
+ */
+void FileMapping::sync() {
+  if (m_mode == READ_ONLY) return;
+  assert(m_bo != nullptr);
+
+  if (m_map != nullptr) {
+    if (msync(m_map, m_map_size, MS_SYNC) != 0) {
+      error("FileMapping: could not sync file '" + m_filename + "'");
+    }
+    return;
+  }
+
+  uint8_t const *src = m_bo->usr_address();
+
+  for (size_t done = 0; done < m_size;) {
+    size_t count = std::min(CHUNK_SIZE, m_size - done);
+    ssize_t res = pwrite(m_fd, src + done, count, m_offset + (off_t) done);
+
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      error("FileMapping: could not write file '" + m_filename + "'");
+      return;
+    }
+
+    done += (size_t) res;
+  }
+}
+
+
+/**
+ * Map the file into memory and use this memory for the buffer object
+ *
+ * `mmap()` requires an offset which is a multiple of the page size;
+ * the mapping starts at the page containing the offset.
+ */
+void FileMapping::map_file() {
+  off_t  page  = (off_t) sysconf(_SC_PAGESIZE);
+  size_t delta = (size_t) (m_offset % page);
+
+  // Changes in mode READ_ONLY should not end up in the file, hence a private mapping
+  int flags = (m_mode == READ_ONLY)? MAP_PRIVATE : MAP_SHARED;
+
+  m_map_size = delta + m_size;
+  void *map = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE, flags, m_fd, m_offset - (off_t) delta);
+  if (map == MAP_FAILED) fail("could not map file");
+
+  m_map = (uint8_t *) map;
+  m_bo  = &heap_attach(m_size, m_map + delta);
+}
+
+
+/**
+ * Read the range of the file into a new buffer object
+ */
+void FileMapping::read_file() {
+  m_bo = &heap_attach(m_size);
+  if (m_mode == CREATE) return;  // Nothing to read
+
+  uint8_t *dst = m_bo->usr_address();
+
+  for (size_t done = 0; done < m_size;) {
+    size_t count = std::min(CHUNK_SIZE, m_size - done);
+    ssize_t res = pread(m_fd, dst + done, count, m_offset + (off_t) done);
+
+    if (res < 0 && errno == EINTR) continue;
+    if (res <= 0) fail("could not read file");
+
+    done += (size_t) res;
+  }
+}
+
+
+void FileMapping::release() {
+  if (m_bo != nullptr) {
+    heap_detach(*m_bo);
+    m_bo = nullptr;
+  }
+
+  if (m_map != nullptr) {
+    munmap(m_map, m_map_size);
+    m_map = nullptr;
+  }
+
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+
+/**
+ * Release the resources acquired so far and signal the error
+ *
+ * @param show_errno  if true, add the description of the current `errno` value
+ */
+void FileMapping::fail(std::string const &msg, bool show_errno) {
+  std::string err = "FileMapping: " + msg + " '" + m_filename + "'";
+  if (show_errno) err += std::string(": ") + strerror(errno);
+
+  release();
+  fatal(err);
+}
+
+}  // namespace V3DLib
@@ -0,0 +1,64 @@
+#ifndef _V3DLIB_COMMON_FILEMAPPING_H_
+#define _V3DLIB_COMMON_FILEMAPPING_H_
+#include <stdint.h>
+#include <sys/types.h>  // off_t
+#include <string>
+#include "BufferObject.h"
+
+namespace V3DLib {
+
+/**
+ * A range of a file, made available as memory accessible to kernels.
+ *
+ * Use it as the memory of a `SharedArray` with `SharedArray::heap_view()`:
+ *
+ *     FileMapping file("field.raw");
+ *     SharedArray<float> field;
+ *     field.heap_view(file.buffer_object());
+ *
+ * In emulation mode, the file is mapped into memory with `mmap()`, so that there
+ * is no intermediate copy. On the Pi, the GPU can only access buffer objects;
+ * the file is read into a buffer object in large chunks instead.
+ *
+ * In mode `READ_ONLY`, changes to the memory are not written to the file.
+ * Otherwise, they are written to the file by `sync()` and on destruction.
+ *
+ * The offset in the file can be anywhere, but the mapped range is limited to the
+ * maximum size of a buffer object, 4 GiB. For use in a `SharedArray`, the offset
+ * must be a multiple of the alignment of the element type.
+ */
+class FileMapping {
+public:
+  enum Mode {
+    READ_ONLY,
+    READ_WRITE,
+    CREATE      // Create or truncate the file, the size must be passed
+  };
+
+  FileMapping(std::string const &filename, Mode mode = READ_ONLY, off_t offset = 0, uint32_t size = 0);
+  FileMapping(FileMapping const &rhs) = delete;
+  ~FileMapping();
+
+  uint32_t size() const { return m_size; }
+  BufferObject &buffer_object() { return *m_bo; }
+  void sync();
+
+private:
+  std::string   m_filename;
+  Mode          m_mode;
+  int           m_fd     = -1;
+  off_t         m_offset = 0;     // Offset of the mapped range in the file
+  uint32_t      m_size   = 0;     // Size of the mapped range in bytes
+  uint8_t      *m_map    = nullptr;  // Start of mmap()'ed memory, emulation mode only
+  size_t        m_map_size = 0;
+  BufferObject *m_bo     = nullptr;
+
+  void map_file();
+  void read_file();
+  void release();
+  void fail(std::string const &msg, bool show_errno = true);
+};
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_COMMON_FILEMAPPING_H_
@@ -77,7 +77,7 @@ public:
       return get(index);
     }
 
-    T operator[](int index) const {
+    T const &operator[](int index) const {
       assertq(!empty(), "seq[]: can not access elements, sequence is empty");
       assertq(0 <= index && index < numElems, "Seq[]: index out of range", true);
       return elems[index];
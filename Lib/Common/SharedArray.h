@@ -1,17 +1,51 @@
 #ifndef _V3DLIB_COMMON_SHAREDARRAY_H_
 #define _V3DLIB_COMMON_SHAREDARRAY_H_
+#include <algorithm>    // std::fill(), std::max()
+#include <cstring>      // memcpy()
+#include <type_traits>  // std::is_trivially_copyable
 #include <vector>
 #include "BufferObject.h"
 #include "../Support/debug.h"
+#include "../Support/parallel.h"
 #include "../Support/Platform.h"  // has_vc4
 
 namespace V3DLib {
 
+/**
+ * Non-owning view on a contiguous range of elements, in the style of `std::span`.
+ *
+ * Used to pass the memory of a shared array to other code without copying.
+ * The view is only valid as long as the array is not deallocated.
+ */
+template <typename T>
+class ArrayView {
+public:
+  ArrayView() {}
+  ArrayView(T *data, uint32_t size) : m_data(data), m_size(size) {}
+
+  T *data() const { return m_data; }
+  uint32_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  T *begin() const { return m_data; }
+  T *end() const { return m_data + m_size; }
+
+  T &operator[] (uint32_t i) const {
+    assert(i < m_size);
+    return m_data[i];
+  }
+
+private:
+  T       *m_data = nullptr;
+  uint32_t m_size = 0;
+};
+
+
 /**
  * Reserve and access a memory range in the underlying buffer object.
  *
- * All SharedArray instances use the same global BufferObject (BO) instance.
- * This is how the memory and v3d access already worked.
+ * Unless a heap is passed, SharedArray instances allocate from the global heap,
+ * see `heap_alloc()`. This is the global BufferObject (BO) instance, extended with
+ * extra BO's when it is full. Each instance keeps track of the BO it lives in.
  *
  * For vc4, this is a change. Previously, each SharedArray instance had its
  * own BO. Experience will tell if this new setup works
@@ -21,35 +55,128 @@ class SharedArray {
 public:
   SharedArray() {}
   SharedArray(uint32_t n) { alloc(n); }
-  SharedArray(uint32_t n, BufferObject &heap) : m_heap(&heap) { alloc(n); }
+  SharedArray(uint32_t n, BufferObject &heap) : m_heap(&heap), m_fixed_heap(true) { alloc(n); }
   SharedArray(SharedArray const &a) = delete;  // Disallow copy
 
-  SharedArray(SharedArray &&a) = default;
-  SharedArray &operator=(SharedArray &&a) = default; 
+  SharedArray(SharedArray &&a) { take(a); }
 
-  ~SharedArray() { dealloc(); }
+  SharedArray &operator=(SharedArray &&a) {
+    if (this != &a) {
+      dealloc();
+      take(a);
+    }
+    return *this;
+  }
+
+  ~SharedArray() {
+    // Here instead of at class level, so that pointers to arrays of incomplete types are allowed
+    static_assert(std::is_trivially_copyable<T>::value, "SharedArray elements are copied as raw memory");
+    dealloc();
+  }
 
   void heap_view(BufferObject &heap) {
     assert(!allocated());
     assert(m_heap == nullptr);
 
+    // Memory from a file mapping starts at an arbitrary offset in the file
+    assertq(((uintptr_t) heap.usr_address()) % alignof(T) == 0,
+      "heap_view(): memory is not aligned for the element type", true);
+
     m_heap = &heap;
     m_is_heap_view = true;
-    m_size = m_heap->size();
+    m_size = m_heap->size()/sizeof(T);
     assert(m_size > 0);
     m_usraddr = m_heap->usr_address();
     m_phyaddr = m_heap->phy_address();
   }
 
 
+  /**
+   * Use externally owned memory for this array.
+   *
+   * In emulation mode, the memory is used directly, without copying.
+   *
+   * On hardware, this is not possible: the hardware can only access buffer objects, and
+   * the kernel drivers have no support for importing user memory. There, the memory is
+   * copied into a buffer object once, here. The two copies are only synchronized explicitly:
+   *
+   * - `sync_to_device()` - after the caller changed the adopted memory directly
+   * - `sync_from_device()` - to get the results of a kernel into the adopted memory.
+   *                          This is also done on deallocation.
+   *
+   * Portable code should call these as if a copy is always made.
+   *
+   * The caller remains the owner of the memory, which must stay valid until
+   * this array is deallocated.
+   */
+  void adopt(T *ptr, uint32_t n) {
+    assert(!allocated());
+    assert(m_heap == nullptr);
+    assert(ptr != nullptr);
+    assert(n > 0);
+
+    bool in_place = Platform::instance().use_main_memory();
+
+    m_heap    = &heap_attach((uint32_t) (sizeof(T)*n), in_place? (uint8_t *) ptr : nullptr);
+    m_adopted = ptr;
+    m_size    = n;
+    m_usraddr = m_heap->usr_address();
+    m_phyaddr = m_heap->phy_address();
+
+    if (!in_place) {
+      copyFrom(ptr, n);
+    }
+  }
+
+  void adopt(std::vector<T> &src) {
+    assert(!src.empty());
+    adopt(src.data(), (uint32_t) src.size());
+  }
+
+
+  /**
+   * Copy the adopted memory into the buffer object, if it is not used directly.
+   */
+  void sync_to_device() {
+    if (m_adopted != nullptr && m_usraddr != (uint8_t *) m_adopted) {
+      copyFrom(m_adopted, m_size);
+    }
+  }
+
+
+  /**
+   * Copy the contents of the buffer object to the adopted memory, if it is not used directly.
+   */
+  void sync_from_device() {
+    if (m_adopted != nullptr && m_usraddr != (uint8_t *) m_adopted) {
+      copyTo(m_adopted, m_size);
+    }
+  }
+
+
   uint32_t getAddress() { return m_phyaddr; }
   uint32_t size() const { return m_size; }
 
+  /**
+   * Set all elements to the given value.
+   *
+   * Large arrays are filled by multiple threads.
+   */
   void fill(T val) {
-    for (int i = 0; i < (int) size(); i++)
-      (*this)[i] = val;
+    T *base = data();
+
+    parallel_for(m_size, PARALLEL_MIN_BYTES/sizeof(T), [base, val] (size_t first, size_t last) {
+      std::fill(base + first, base + last, val);
+    });
   }
 
+
+  /**
+   * Get a view on the elements, as seen by the CPU.
+   */
+  ArrayView<T> view() { return ArrayView<T>(data(), m_size); }
+  ArrayView<T const> view() const { return ArrayView<T const>(data(), m_size); }
+
   /**
    * Get starting address of the section in question
    *
@@ -75,11 +202,12 @@ public:
     assert(!allocated());
     assert(n > 0);
 
-    if (m_heap == nullptr) {
-      m_heap = &getBufferObject();
+    if (m_fixed_heap) {
+      m_phyaddr = m_heap->alloc_array((uint32_t) (sizeof(T)*n), m_usraddr);
+    } else {
+      m_phyaddr = heap_alloc((uint32_t) (sizeof(T)*n), m_heap, m_usraddr);
     }
 
-    m_phyaddr = m_heap->alloc_array((uint32_t) (sizeof(T)*n), m_usraddr);
     m_size = n;
     assert(allocated());
   }
@@ -95,6 +223,7 @@ public:
       assert(m_phyaddr == 0);
       assert(m_usraddr == nullptr);
       assert(!m_is_heap_view);
+      assert(m_adopted == nullptr);
       return false;
     }
   }
@@ -107,8 +236,18 @@ public:
     if (m_size > 0) {
       assert(allocated());
       assert(m_heap != nullptr);
-      if (!m_is_heap_view) { 
+      if (m_is_heap_view) {
+        // Nothing to deallocate
+      } else if (m_adopted != nullptr) {
+        sync_from_device();
+        heap_detach(*m_heap);
+        m_heap    = nullptr;
+        m_adopted = nullptr;
+      } else if (m_fixed_heap) {
         m_heap->dealloc_array(m_phyaddr, (uint32_t) (sizeof(T)*m_size));
+      } else {
+        heap_dealloc(*m_heap, m_phyaddr, (uint32_t) (sizeof(T)*m_size));
+        m_heap = nullptr;  // The BO may have been released
       }
 
       m_phyaddr = 0;
@@ -154,27 +293,126 @@ public:
   }
 
 
-  void copyFrom(T const *src, uint32_t size) {
+  /**
+   * Copy elements into this array.
+   *
+   * @param src     elements to copy
+   * @param size    number of elements to copy
+   * @param offset  index in this array to copy to
+   */
+  void copyFrom(T const *src, uint32_t size, uint32_t offset = 0) {
     assert(src != nullptr);
-    assert(size <= m_size);
+    assertq(offset + size <= m_size, "SharedArray::copyFrom(): range outside of array", true);
 
-    // TODO: consider using memcpy() instead
-    for (uint32_t offset = 0; offset < size; ++offset) {
-      (*this)[offset] = src[offset];
-    }
+    bulk_copy(data() + offset, src, sizeof(T)*size);
   }
 
   void copyFrom(std::vector<T> const &src) {
     assert(!src.empty());
-    assert(src.size() <= m_size);
+    copyFrom(src.data(), (uint32_t) src.size());
+  }
+
+
+  /**
+   * Copy elements out of this array.
+   *
+   * @param dst     destination of the copied elements
+   * @param size    number of elements to copy
+   * @param offset  index in this array to copy from
+   */
+  void copyTo(T *dst, uint32_t size, uint32_t offset = 0) const {
+    assert(dst != nullptr);
+    assertq(offset + size <= m_size, "SharedArray::copyTo(): range outside of array", true);
+
+    bulk_copy(dst, data() + offset, sizeof(T)*size);
+  }
+
+  void copyTo(std::vector<T> &dst) const {
+    dst.resize(m_size);
+    if (m_size > 0) copyTo(dst.data(), m_size);
+  }
+
+
+  /**
+   * Copy every `stride`-th element of `src` into consecutive elements of this array.
+   */
+  void copyFromStrided(T const *src, uint32_t count, uint32_t stride, uint32_t offset = 0) {
+    assert(src != nullptr);
+    assert(stride > 0);
+    assertq(offset + count <= m_size, "SharedArray::copyFromStrided(): range outside of array", true);
+
+    T *base = data() + offset;
+    for (uint32_t i = 0; i < count; ++i) {
+      base[i] = src[i*stride];
+    }
+  }
 
-    // TODO: consider using memcpy() instead
-    for (uint32_t offset = 0; offset < src.size(); ++offset) {
-      (*this)[offset] = src[offset];
+
+  /**
+   * Copy consecutive elements of this array into every `stride`-th element of `dst`.
+   */
+  void copyToStrided(T *dst, uint32_t count, uint32_t stride, uint32_t offset = 0) const {
+    assert(dst != nullptr);
+    assert(stride > 0);
+    assertq(offset + count <= m_size, "SharedArray::copyToStrided(): range outside of array", true);
+
+    T const *base = data() + offset;
+    for (uint32_t i = 0; i < count; ++i) {
+      dst[i*stride] = base[i];
     }
   }
 
 
+  /**
+   * Copy a 2D block of `width` x `height` elements into this array.
+   *
+   * @param src_pitch  distance in elements between the rows in `src`
+   * @param pitch      distance in elements between the rows in this array
+   * @param offset     index in this array of the first element of the block
+   */
+  void copyFrom2D(T const *src, uint32_t width, uint32_t height,
+                  uint32_t src_pitch, uint32_t pitch, uint32_t offset = 0) {
+    assert(src != nullptr);
+    assert(width <= src_pitch && width <= pitch);
+    assertq(height == 0 || offset + (height - 1)*pitch + width <= m_size,
+            "SharedArray::copyFrom2D(): block outside of array", true);
+
+    T *base = data() + offset;
+    size_t min_rows = PARALLEL_MIN_BYTES/std::max(sizeof(T)*width, (size_t) 1);
+
+    parallel_for(height, min_rows, [=] (size_t first, size_t last) {
+      for (size_t row = first; row < last; ++row) {
+        memcpy(base + row*pitch, src + row*src_pitch, sizeof(T)*width);
+      }
+    });
+  }
+
+
+  /**
+   * Copy a 2D block of `width` x `height` elements out of this array.
+   *
+   * @param dst_pitch  distance in elements between the rows in `dst`
+   * @param pitch      distance in elements between the rows in this array
+   * @param offset     index in this array of the first element of the block
+   */
+  void copyTo2D(T *dst, uint32_t width, uint32_t height,
+                uint32_t dst_pitch, uint32_t pitch, uint32_t offset = 0) const {
+    assert(dst != nullptr);
+    assert(width <= dst_pitch && width <= pitch);
+    assertq(height == 0 || offset + (height - 1)*pitch + width <= m_size,
+            "SharedArray::copyTo2D(): block outside of array", true);
+
+    T const *base = data() + offset;
+    size_t min_rows = PARALLEL_MIN_BYTES/std::max(sizeof(T)*width, (size_t) 1);
+
+    parallel_for(height, min_rows, [=] (size_t first, size_t last) {
+      for (size_t row = first; row < last; ++row) {
+        memcpy(dst + row*dst_pitch, base + row*pitch, sizeof(T)*width);
+      }
+    });
+  }
+
+
   /**
    * Debug method for showing a range in a shared array
    */
@@ -198,11 +436,41 @@ private:
   void operator=(SharedArray a);
   void operator=(SharedArray const &a);
 
+  T *data() { return (T *) m_usraddr; }
+  T const *data() const { return (T const *) m_usraddr; }
+
+
+  /**
+   * Take over the memory of the given array, which is left empty.
+   *
+   * Otherwise, both arrays would deallocate the same memory.
+   */
+  void take(SharedArray &a) {
+    m_heap         = a.m_heap;
+    m_usraddr      = a.m_usraddr;
+    m_phyaddr      = a.m_phyaddr;
+    m_size         = a.m_size;
+    m_is_heap_view = a.m_is_heap_view;
+    m_fixed_heap   = a.m_fixed_heap;
+    m_adopted      = a.m_adopted;
+
+    if (!a.m_fixed_heap) {
+      a.m_heap = nullptr;
+    }
+    a.m_usraddr      = nullptr;
+    a.m_phyaddr      = 0;
+    a.m_size         = 0;
+    a.m_is_heap_view = false;
+    a.m_adopted      = nullptr;
+  }
+
   BufferObject *m_heap = nullptr;  // Reference to used heap
   uint8_t *m_usraddr   = nullptr;  // Start of the heap in main memory, as seen by the CPU
   uint32_t m_phyaddr   = 0;        // Starting index of memory in GPU space
   uint32_t m_size      = 0;        // Number of contained elements (not memory size!)
   bool     m_is_heap_view = false;
+  bool     m_fixed_heap   = false;   // If true, always allocate from the heap passed in the ctor
+  T       *m_adopted      = nullptr; // Externally owned memory, see `adopt()`
 };
 
 }  // namespace V3DLib
@@ -0,0 +1,131 @@
+#include "SlabAllocator.h"
+#include <algorithm>  // std::find()
+#include "Support/basics.h"
+
+namespace V3DLib {
+
+/**
+ * @param alloc_slab    function to allocate the memory for a slab
+ * @param dealloc_slab  function to release the memory of a slab
+ */
+SlabAllocator::SlabAllocator(AllocFunc alloc_slab, DeallocFunc dealloc_slab) :
+  m_alloc_slab(alloc_slab),
+  m_dealloc_slab(dealloc_slab)
+{
+  for (uint32_t size = MIN_SLOT_SIZE; size <= MAX_SLOT_SIZE; size *= 2) {
+    SizeClass cls;
+    cls.slot_size = size;
+    m_classes.push_back(cls);
+  }
+
+  assert((int) m_classes.size() == NUM_CLASSES);
+}
+
+
+/**
+ * @return index of the size class for the given size, in range [0, NUM_CLASSES)
+ */
+int SlabAllocator::class_index(uint32_t size_in_bytes) {
+  assert(size_in_bytes > 0);
+  assert(handles(size_in_bytes));
+
+  int index = 0;
+  for (uint32_t size = MIN_SLOT_SIZE; size < size_in_bytes; size *= 2) {
+    ++index;
+  }
+
+  return index;
+}
+
+
+SlabAllocator::Range SlabAllocator::alloc(uint32_t size_in_bytes) {
+  auto &cls = size_class(size_in_bytes);
+
+  if (cls.partial.empty()) {
+    Slab slab;
+    slab.range     = m_alloc_slab(SLAB_SIZE);
+    slab.num_slots = (int) (SLAB_SIZE/cls.slot_size);
+
+    // Reverse order, so that the slots are handed out in order of address
+    for (int i = slab.num_slots - 1; i >= 0; --i) {
+      slab.free_slots.push_back((uint16_t) i);
+    }
+
+    auto res = cls.slabs.insert({slab.range.phyaddr, slab});
+    assert(res.second);
+    cls.partial.push_back(&res.first->second);
+  }
+
+  Slab &slab = *cls.partial.back();
+  uint32_t offset = cls.slot_size*slab.free_slots.back();
+  slab.free_slots.pop_back();
+
+  if (slab.free_slots.empty()) {
+    cls.partial.pop_back();
+  }
+
+  Range ret = slab.range;
+  ret.phyaddr     += offset;
+  ret.usr_address += offset;
+  return ret;
+}
+
+
+/**
+ * Release a slot.
+ *
+ * A slab is released when all its slots are free, except for the last slab of
+ * a size class, so that alternating allocations and deallocations don't
+ * allocate a new slab each time.
+ *
+ * @return true if the slot was allocated by this allocator, false otherwise
+ */
+bool SlabAllocator::dealloc(BufferObject const &bo, uint32_t phyaddr, uint32_t size_in_bytes) {
+  auto &cls = size_class(size_in_bytes);
+
+  auto it = cls.slabs.upper_bound(phyaddr);
+  if (it == cls.slabs.begin()) return false;
+  --it;
+
+  Slab &slab = it->second;
+  if (slab.range.bo != &bo || phyaddr >= slab.range.phyaddr + SLAB_SIZE) return false;
+
+  uint32_t offset = phyaddr - slab.range.phyaddr;
+  assert(offset % cls.slot_size == 0);
+  uint16_t slot = (uint16_t) (offset/cls.slot_size);
+
+#ifdef DEBUG
+  bool is_free = std::find(slab.free_slots.begin(), slab.free_slots.end(), slot) != slab.free_slots.end();
+  assertq(!is_free, "SlabAllocator::dealloc(): slot already deallocated", true);
+#endif
+
+  if (slab.free_slots.empty()) {
+    cls.partial.push_back(&slab);
+  }
+
+  slab.free_slots.push_back(slot);
+
+  if ((int) slab.free_slots.size() == slab.num_slots && cls.slabs.size() > 1) {
+    auto p = std::find(cls.partial.begin(), cls.partial.end(), &slab);
+    assert(p != cls.partial.end());
+    cls.partial.erase(p);
+
+    m_dealloc_slab(slab.range, SLAB_SIZE);
+    cls.slabs.erase(it);
+  }
+
+  return true;
+}
+
+
+int SlabAllocator::num_slabs() const {
+  int ret = 0;
+
+  for (auto const &cls : m_classes) {
+    ret += (int) cls.slabs.size();
+  }
+
+  return ret;
+}
+
+}  // namespace V3DLib
@@ -0,0 +1,71 @@
+#ifndef _V3DLIB_COMMON_SLABALLOCATOR_H_
+#define _V3DLIB_COMMON_SLABALLOCATOR_H_
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace V3DLib {
+
+class BufferObject;
+
+/**
+ * Allocator for small arrays in the heap.
+ *
+ * Small arrays are allocated from slabs, blocks of heap memory which are divided
+ * into slots of equal size. There is a size class for each power of two from
+ * `MIN_SLOT_SIZE` up to `MAX_SLOT_SIZE`.
+ *
+ * Allocation takes a free slot of the size class, in constant time.
+ * Deallocation finds the slab by address, in O(log n) for n slabs of the size class.
+ *
+ * This keeps small allocations together, so that they don't fragment the heap.
+ */
+class SlabAllocator {
+public:
+  static uint32_t const MIN_SLOT_SIZE = 16;    // In bytes
+  static uint32_t const MAX_SLOT_SIZE = 256;   // idem
+  static uint32_t const SLAB_SIZE     = 4096;  // idem
+  static int const      NUM_CLASSES   = 5;     // Number of size classes
+
+  struct Range {
+    BufferObject *bo          = nullptr;
+    uint32_t      phyaddr     = 0;
+    uint8_t      *usr_address = nullptr;
+  };
+
+  using AllocFunc   = std::function<Range (uint32_t size_in_bytes)>;
+  using DeallocFunc = std::function<void (Range const &range, uint32_t size_in_bytes)>;
+
+  SlabAllocator(AllocFunc alloc_slab, DeallocFunc dealloc_slab);
+
+  static bool handles(uint32_t size_in_bytes) { return size_in_bytes <= MAX_SLOT_SIZE; }
+  static int class_index(uint32_t size_in_bytes);
+
+  Range alloc(uint32_t size_in_bytes);
+  bool dealloc(BufferObject const &bo, uint32_t phyaddr, uint32_t size_in_bytes);
+  int num_slabs() const;
+
+private:
+  struct Slab {
+    Range                 range;
+    int                   num_slots = 0;
+    std::vector<uint16_t> free_slots;
+  };
+
+  struct SizeClass {
+    uint32_t               slot_size = 0;
+    std::map<uint32_t, Slab> slabs;    // Slabs by physical address
+    std::vector<Slab *>    partial;    // Slabs with free slots
+  };
+
+  AllocFunc              m_alloc_slab;
+  DeallocFunc            m_dealloc_slab;
+  std::vector<SizeClass> m_classes;
+
+  SizeClass &size_class(uint32_t size_in_bytes) { return m_classes[class_index(size_in_bytes)]; }
+};
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_COMMON_SLABALLOCATOR_H_
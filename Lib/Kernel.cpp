@@ -11,10 +11,81 @@ std::vector<Ptr<Int>>   uniform_int_pointers;
 std::vector<Ptr<Float>> uniform_float_pointers;
 
 
+/**
+ * Add the offset for the current QPU to the pointer parameters created with `mkArg()`.
+ *
+ * This is only done for vc4; for v3d, the offsets are added on translation.
+ * Afterwards, the pointer lists are empty, for the next kernel.
+ */
+void offset_uniform_pointers() {
+  if (Platform::instance().compiling_for_vc4()) {
+    Int offset = me() << 4;
+
+    for (auto &expr : uniform_int_pointers) {
+      expr = expr + offset;
+    }
+    for (auto &expr : uniform_float_pointers) {
+      expr = expr + offset;
+    }
+  }
+
+  uniform_int_pointers.clear();
+  uniform_float_pointers.clear();
+}
+
+
+// ============================================================================
+// Class KernelEvent
+// ============================================================================
+
+/**
+ * @return true if the kernel run has finished, false otherwise
+ */
+bool KernelEvent::ready() const {
+  if (!valid()) return true;
+  return m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+
+/**
+ * Wait until the kernel run has finished.
+ *
+ * If the run failed with an exception, it is rethrown here.
+ */
+void KernelEvent::wait() const {
+  if (!valid()) return;
+  m_future.get();
+}
+
+
 // ============================================================================
 // Class KernelBase
 // ============================================================================
 
+/**
+ * A run started with `launch()` uses the moved instance, hence it is waited for
+ * before anything is moved.
+ */
+KernelBase::KernelBase(KernelBase &&k) :
+  numQPUs((k.wait(), k.numQPUs)),
+  uniforms(std::move(k.uniforms)),
+  m_vc4_driver(std::move(k.m_vc4_driver)),
+  numVars(k.numVars)
+#ifdef QPU_MODE
+  , m_v3d_driver(std::move(k.m_v3d_driver))
+#endif
+{}
+
+
+KernelBase::~KernelBase() {
+  // A running kernel should not outlive its instance.
+  // Errors of the run can not be reported here.
+  try {
+    wait();
+  } catch (...) {}
+}
+
+
 int KernelBase::maxQPUs() {
   // TODO: better would be to take the values from Platform
   if (Platform::instance().has_vc4) {
@@ -38,6 +109,26 @@ void KernelBase::pretty(bool output_for_vc4, const char *filename) {
 }
 
 
+/**
+ * Get the statistics of the compile and encode passes
+ *
+ * Note that the encoding passes are only present after the kernel
+ * has been run or pretty-printed.
+ */
+CompileStats const &KernelBase::compile_stats(bool output_for_vc4) const {
+  if (output_for_vc4) {
+    return m_vc4_driver.stats();
+  } else {
+#ifdef QPU_MODE
+    return m_v3d_driver.stats();
+#else
+    fatal("KernelBase::compile_stats(): v3d code not generated for this platform.");
+    return m_vc4_driver.stats();  // Return anything
+#endif
+  }
+}
+
+
 /**
  * Invoke the emulator
  *
@@ -45,6 +136,7 @@ void KernelBase::pretty(bool output_for_vc4, const char *filename) {
  */
 void KernelBase::emu() {
   assert(uniforms.size() != 0);
+  wait();
   emulate(numQPUs, &m_vc4_driver.targetCode(), numVars, uniforms, getBufferObject());
 }
 
@@ -56,6 +148,7 @@ void KernelBase::emu() {
  */
 void KernelBase::interpret() {
   assert(uniforms.size() != 0);
+  wait();
   interpreter(numQPUs, m_vc4_driver.sourceCode(), numVars, uniforms, getBufferObject());
 }
 
@@ -66,6 +159,7 @@ void KernelBase::interpret() {
  */
 void KernelBase::qpu() {
   assert(uniforms.size() != 0);
+  wait();
 
   if (Platform::instance().has_vc4) {
     m_vc4_driver.invoke(numQPUs, uniforms);
@@ -80,13 +174,90 @@ void KernelBase::qpu() {
  * Invoke the kernel
  */
 void KernelBase::call() {
+  assert(uniforms.size() != 0);
+  wait();
+  call(numQPUs, uniforms);
+}
+
+
+/**
+ * Encode the kernel for running on the hardware, if not done already.
+ *
+ * Encoding uses global state, so this must be done on the caller's thread
+ * before the kernel is invoked on a background thread.
+ */
+void KernelBase::prepare(int num_qpus) {
+#ifndef EMULATION_MODE
+#ifdef QPU_MODE
+  if (Platform::instance().has_vc4) {
+    m_vc4_driver.prepare(num_qpus);
+  } else {
+    m_v3d_driver.prepare(num_qpus);
+  }
+#endif
+#endif
+}
+
+
+/**
+ * Invoke the kernel with the given parameters, as `call()` does
+ */
+void KernelBase::call(int num_qpus, Seq<int32_t> &params) {
 #ifdef EMULATION_MODE
-  emu();
+  emulate(num_qpus, &m_vc4_driver.targetCode(), numVars, params, getBufferObject());
 #else
 #ifdef QPU_MODE
-  qpu();
+  if (Platform::instance().has_vc4) {
+    m_vc4_driver.invoke(num_qpus, params);
+  } else {
+    m_v3d_driver.invoke(num_qpus, params);
+  }
 #endif
 #endif
-};
+}
+
+
+/**
+ * Start the kernel and return immediately, so that the host can continue
+ * with other work while the kernel runs.
+ *
+ * The kernel is encoded on the calling thread and then invoked as with `call()`,
+ * on a background thread. On the hardware, this thread waits for the QPUs;
+ * in emulation mode, it runs the emulator. On vc4, kernel runs are serialized
+ * over the process, so launching several kernels does not run them concurrently.
+ *
+ * The current parameters are copied, so new parameters can be loaded
+ * while the kernel runs. Only one run of a kernel instance can be active;
+ * launching again or calling the kernel first waits for the previous run.
+ *
+ * The shared arrays passed to the kernel should not be accessed or
+ * deallocated until the run has finished.
+ *
+ * @return handle for waiting on or polling the run
+ */
+KernelEvent KernelBase::launch() {
+  assert(uniforms.size() != 0);
+  wait();
+
+  Seq<int32_t> params   = uniforms;
+  int          num_qpus = numQPUs;
+  prepare(num_qpus);
+
+  m_launched = KernelEvent(std::async(std::launch::async, [this, params, num_qpus] () mutable {
+    call(num_qpus, params);
+  }).share());
+
+  return m_launched;
+}
+
+
+/**
+ * Wait until the last run started with `launch()` has finished.
+ */
+void KernelBase::wait() {
+  KernelEvent launched = m_launched;
+  m_launched = KernelEvent();
+  launched.wait();
+}
 
 }  // namespace V3DLib
@@ -2,6 +2,7 @@
 #define _V3DLIB_KERNEL_H_
 #include <tuple>
 #include <algorithm>  // std::move
+#include <future>
 #include "Source/Int.h"
 #include "Source/Ptr.h"
 #include "Source/Interpreter.h"
@@ -56,6 +57,8 @@ namespace V3DLib {
 //   * interpret(...)  invoke kernel using source code interpreter
 //   * call(...)       in emulation mode, same as emulate(...)
 //                     with QPU_MODE, same as qpu(...)
+//   * launch(...)     same as call(...), but returns immediately.
+//                     The kernel runs on a background thread.
 //
 // Emulation mode calls are provided for doing equivalence
 // testing between the physical QPU and the QPU emulator.  However,
@@ -102,12 +105,12 @@ template <> inline Ptr<Float> mkArg< Ptr<Float> >() {
   return x;
 }
 
+void offset_uniform_pointers();
+
 // ============================================================================
 // Parameter passing
 // ============================================================================
 
-template <typename... ts> inline void nothing(ts... args) {}
-
 // Pass argument of ARM type 'u' as parameter of QPU type 't'.
 
 template <typename t, typename u>
@@ -146,16 +149,51 @@ inline bool passParam< Ptr<Float>, SharedArray<float>* > (Seq<int32_t>* uniforms
 }
 
 
+// Uniform value of argument of ARM type 'u' for parameter of QPU type 't'.
+// Goes through `passParam()`, so that its specializations for other types apply.
+
+template <typename t, typename u>
+inline int32_t paramValue(u x) {
+  Seq<int32_t> value;
+  passParam<t, u>(&value, x);
+  assertq(value.size() == 1, "paramValue(): expecting a single uniform per parameter", true);
+  return value[0];
+}
+
+
 // ============================================================================
 // Kernels
 // ============================================================================
 
+/**
+ * Handle for a kernel run started with `KernelBase::launch()`.
+ *
+ * Copies refer to the same run.
+ */
+class KernelEvent {
+public:
+  KernelEvent() {}
+  KernelEvent(std::shared_future<void> const &future) : m_future(future) {}
+
+  bool valid() const { return m_future.valid(); }
+  bool ready() const;
+  void wait() const;
+
+private:
+  std::shared_future<void> m_future;
+};
+
+
 class KernelBase {
+  friend class CommandQueue;
+
 public:
   KernelBase() {}
-  KernelBase(KernelBase &&k) = default;
+  KernelBase(KernelBase &&k);
+  ~KernelBase();
 
   void pretty(bool output_for_vc4, const char *filename = nullptr);
+  CompileStats const &compile_stats(bool output_for_vc4) const;
 
   void setNumQPUs(int n) { numQPUs = n; }  // Set number of QPUs to use
   static int maxQPUs();
@@ -167,6 +205,9 @@ public:
   void qpu();
 #endif  // QPU_MODE
 
+  KernelEvent launch();
+  void wait();
+
 
 protected:
   int numQPUs = 1;                 // Number of QPUs to run on
@@ -177,6 +218,47 @@ protected:
 #ifdef QPU_MODE
   v3d::KernelDriver m_v3d_driver;
 #endif
+
+  /**
+   * Construct the AST and compile it, for vc4 and if required for v3d.
+   *
+   * `build()` is called once per target, after the kernel driver for that
+   * target has been initialized.
+   */
+  template <typename F>
+  void compile_kernel(F build, bool vc4_only) {
+    {
+      m_vc4_driver.compile_init();
+
+      m_vc4_driver.stats().start("AST build");
+      build();
+      m_vc4_driver.stats().stop();
+
+      m_vc4_driver.compile();
+
+      // Remember the number of variables used - for emulator/interpreter
+      numVars = getFreshVarCount();
+    }
+
+#ifdef QPU_MODE
+    if (!vc4_only && !Platform::instance().has_vc4) {
+      m_v3d_driver.compile_init();
+
+      // Construct the AST for v3d
+      m_v3d_driver.stats().start("AST build");
+      build();
+      m_v3d_driver.stats().stop();
+
+      m_v3d_driver.compile();
+    }
+#endif  // QPU_MODE
+  }
+
+private:
+  KernelEvent m_launched;          // Last run started with `launch()`
+
+  void prepare(int num_qpus);
+  void call(int num_qpus, Seq<int32_t> &params);
 };
 
 
@@ -215,45 +297,13 @@ public:
    * Construct kernel out of C++ function
    */
   Kernel(KernelFunction f, bool vc4_only = false) {
-    {
-      uniform_int_pointers.clear();
-      uniform_float_pointers.clear();
-
-      m_vc4_driver.compile_init();
-
-      auto args = std::make_tuple(mkArg<ts>()...);
-
-      //
-      // Add offsets to the uniform pointers
-      //
-      Int offset = me() << 4;
+    compile_kernel([f] () {
+      // Braced initialization, so that the uniforms are read in order of the parameters
+      std::tuple<ts...> args{mkArg<ts>()...};
+      offset_uniform_pointers();
 
-      for (auto &expr : uniform_int_pointers) {
-        expr = expr + offset;
-      }
-      for (auto &expr : uniform_float_pointers) {
-        expr = expr + offset;
-      }
-
-      // Construct the AST for vc4
       apply(f, args);
-
-      m_vc4_driver.compile();
-
-      // Remember the number of variables used - for emulator/interpreter
-      numVars = getFreshVarCount();
-    }
-
-#ifdef QPU_MODE
-    if (!vc4_only && !Platform::instance().has_vc4) {
-      m_v3d_driver.compile_init();
-
-      // Construct the AST for v3d
-      f(mkArg<ts>()...);
-
-      m_v3d_driver.compile();
-    }
-#endif  // QPU_MODE
+    }, vc4_only);
   }
 
 
@@ -261,11 +311,41 @@ public:
    * Load uniform values.
    *
    * Pass params, checking arguments types us against parameter types ts.
+   * Uniform `i` contains the value of parameter `i`.
    */
   template <typename... us>
   Kernel &load(us... args) {
     uniforms.clear();
-    nothing(passParam<ts, us>(&uniforms, args)...);
+
+    // Braced initialization, so that the parameters are passed in order.
+    // `set_arg()` depends on this.
+    bool passed[] = {true, passParam<ts, us>(&uniforms, args)...};
+    (void) passed;
+
+    return *this;
+  }
+
+
+  /**
+   * Change the value of a single parameter, keeping the other loaded values.
+   *
+   * The parameters must have been loaded with `load()` first. The argument
+   * type is checked against the type of parameter `N`, as for `load()`.
+   *
+   * Example, swapping input and output between steps:
+   *
+   *     k.load(&a, &b, n);
+   *     k.call();
+   *     k.set_arg<0>(&b).set_arg<1>(&a);
+   *     k.call();
+   */
+  template <int N, typename u>
+  Kernel &set_arg(u arg) {
+    static_assert(0 <= N && N < (int) sizeof...(ts), "set_arg(): parameter index out of range");
+    using t = typename std::tuple_element<N, std::tuple<ts...>>::type;
+
+    assertq(uniforms.size() == (int) sizeof...(ts), "set_arg(): parameters not loaded", true);
+    uniforms[N] = paramValue<t, u>(arg);
 
     return *this;
   }
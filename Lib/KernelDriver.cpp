@@ -4,6 +4,7 @@
 #include "Source/StmtStack.h"
 #include "Source/Pretty.h"
 #include "Source/Translate.h"
+#include "Source/IfConversion.h"
 #include "Source/Lang.h"       // initStmt
 #include "Target/Satisfy.h"
 #include "SourceTranslate.h"
@@ -51,22 +52,31 @@ void print_target_code(FILE *f, Seq<Instr> const &code) {
 
 /**
  * @param targetCode  output variable for the target code assembled from the AST and adjusted
+ * @param stats       output variable for the statistics per pass
  */
-void compile_postprocess(Seq<Instr> &targetCode) {
+void compile_postprocess(Seq<Instr> &targetCode, CompileStats &stats) {
   assertq(!targetCode.empty(), "compile_postprocess(): passed target code is empty");
 
   // Load/store pass
-  loadStorePass(targetCode);
+  stats.measure("loadStorePass", targetCode, [&targetCode] {
+    loadStorePass(targetCode);
+  });
 
   // Construct control-flow graph
   CFG cfg;
-  buildCFG(targetCode, cfg);
+  stats.measure("buildCFG", targetCode, [&targetCode, &cfg] {
+    buildCFG(targetCode, cfg);
+  });
 
   // Perform register allocation
-  getSourceTranslate().regAlloc(&cfg, &targetCode);
+  stats.measure("regAlloc", targetCode, [&targetCode, &cfg] {
+    getSourceTranslate().regAlloc(&cfg, &targetCode);
+  });
 
   // Satisfy target code constraints
-  satisfy(&targetCode);
+  stats.measure("satisfy", targetCode, [&targetCode] {
+    satisfy(&targetCode);
+  });
 }
 
 
@@ -84,6 +94,7 @@ KernelDriver::~KernelDriver() {}
  * @param numVars           number of variables already assigned prior to compilation
  */
 void KernelDriver::init_compile(bool set_qpu_uniforms, int numVars) {
+  m_stats.clear();  // Only keep the stats of the last compile
   initStmt(m_stmtStack);
   resetFreshVarGen(numVars);
   resetFreshLabelGen();
@@ -103,6 +114,28 @@ void KernelDriver::obtain_ast() {
 }
 
 
+/**
+ * Convert small `If`-statements in the given statement to `Where`-statements.
+ *
+ * The conditions of the converted statements are added as notes to the compile stats.
+ *
+ * @return converted statement; the passed statement is not changed
+ */
+Stmt::Ptr KernelDriver::convert_ifs(Stmt::Ptr body) {
+  std::vector<std::string> converted;
+
+  m_stats.start("if_conversion");
+  Stmt::Ptr ret = if_conversion(body, converted);
+  m_stats.stop();
+
+  for (auto const &cond : converted) {
+    m_stats.note("converted If " + cond);
+  }
+
+  return ret;
+}
+
+
 /**
  * Entry point for compilation of source code to target code.
  *
@@ -117,6 +150,10 @@ void KernelDriver::compile() {
 
     if (e.msg().compare(0, 5, "ERROR") == 0) {
       errors << msg;
+
+      if (m_stats.running()) {
+        m_stats.stop();  // Close the failed pass
+      }
     } else {
       throw;  // Must be a fatal()
     }
@@ -149,6 +186,9 @@ bool KernelDriver::handle_errors() {
 /**
 * @brief Output a human-readable representation of the source and target code.
 *
+* The code comments are only shown if these were enabled with `InstructionComment::enable()`
+* before the kernel was compiled.
+*
 * @param filename  if specified, print the output to this file. Otherwise, print to stdout
 */
 void KernelDriver::pretty(int numQPUs, const char *filename) {
@@ -187,7 +227,10 @@ void KernelDriver::pretty(int numQPUs, const char *filename) {
 }
 
 
-void KernelDriver::invoke(int numQPUs, Seq<int32_t> &params) {
+/**
+ * Encode the kernel for running, if not done already
+ */
+void KernelDriver::prepare(int numQPUs) {
   if (!has_errors()) {
     encode(numQPUs);
   }
@@ -195,6 +238,11 @@ void KernelDriver::invoke(int numQPUs, Seq<int32_t> &params) {
   if (handle_errors()) {
     fatal("Errors during kernel compilation/encoding, can't continue.");
   }
+}
+
+
+void KernelDriver::invoke(int numQPUs, Seq<int32_t> &params) {
+  prepare(numQPUs);
 
    // Invoke kernel on QPUs
   invoke_intern(numQPUs, &params);
@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include "Common/BufferType.h"
+#include "Support/CompileStats.h"
 #include "Source/StmtStack.h"
 #include "Target/CFG.h"
 
@@ -16,6 +17,7 @@ public:
   virtual void encode(int numQPUs) = 0;
 
   void compile();
+  void prepare(int numQPUs);
   void invoke(int numQPUs, Seq<int32_t> &params);
   void pretty(int numQPUs, const char *filename = nullptr);
 
@@ -26,6 +28,9 @@ public:
 
   Seq<Instr> &targetCode() { return m_targetCode; }
 
+  CompileStats &stats() { return m_stats; }
+  CompileStats const &stats() const { return m_stats; }
+
   BufferType const buffer_type;
 
 #ifdef DEBUG
@@ -39,6 +44,7 @@ protected:
 
   Seq<Instr> m_targetCode;            // Target code generated from AST
   Stmt::Ptr  m_body;
+  CompileStats m_stats;               // Statistics of the compile and encode passes
 
   int qpuCodeMemOffset = 0;
   std::vector<std::string> errors;
@@ -46,6 +52,7 @@ protected:
   void init_compile(bool set_qpu_uniforms = true, int numVars = 0);
   virtual void emit_opcodes(FILE *f) {} 
   void obtain_ast();
+  Stmt::Ptr convert_ifs(Stmt::Ptr body);
 
 
 private:
@@ -58,7 +65,7 @@ private:
   bool handle_errors();
 };
 
-void compile_postprocess(Seq<Instr> &targetCode);
+void compile_postprocess(Seq<Instr> &targetCode, CompileStats &stats);
 
 }  // namespace V3DLib
 
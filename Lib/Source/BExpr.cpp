@@ -178,4 +178,19 @@ std::string BExpr::dump() const {
   return ret;
 }
 
+
+/**
+ * @return true if the expression contains a memory load, false otherwise
+ */
+bool has_deref(BExpr::Ptr b) {
+  switch (b->tag()) {
+    case NOT: return has_deref(b->neg());
+    case AND:
+    case OR:  return has_deref(b->lhs()) || has_deref(b->rhs());
+    case CMP: return has_deref(b->cmp_lhs()) || has_deref(b->cmp_rhs());
+  }
+
+  return true;
+}
+
 }  // namespace V3DLib
@@ -81,6 +81,9 @@ private:
   Ptr ptr() const;
 };
 
+
+bool has_deref(BExpr::Ptr b);
+
 }  // namespace V3DLib
 
 #endif  // _V3DLIB_SOURCE_BEXPR_H_
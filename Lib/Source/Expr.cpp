@@ -205,4 +205,65 @@ Expr::Ptr mkApply(Expr::Ptr lhs, Op op) {
 }
 
 
+/**
+ * @return true if the expression contains a memory load, false otherwise
+ */
+bool has_deref(Expr::Ptr e) {
+	switch (e->tag()) {
+		case Expr::DEREF: return true;
+		case Expr::APPLY: return has_deref(e->lhs()) || has_deref(e->rhs());
+		default:          return false;
+	}
+}
+
+
+bool same_var(Var lhs, Var rhs) {
+  return lhs.tag() == rhs.tag() && lhs.id() == rhs.id();
+}
+
+
+/**
+ * Check if two expressions are structurally the same
+ */
+bool equal(Expr::Ptr a, Expr::Ptr b) {
+  if (a->tag() != b->tag()) return false;
+
+  switch (a->tag()) {
+    case Expr::INT_LIT:   return a->intLit == b->intLit;
+    case Expr::FLOAT_LIT: return a->floatLit == b->floatLit;
+    case Expr::VAR:       return same_var(a->var(), b->var());
+    case Expr::DEREF:     return equal(a->deref_ptr(), b->deref_ptr());
+    case Expr::APPLY:
+      return a->apply_op.op == b->apply_op.op
+          && a->apply_op.type == b->apply_op.type
+          && equal(a->lhs(), b->lhs())
+          && equal(a->rhs(), b->rhs());
+  }
+
+  return false;
+}
+
+
+bool uses_var(Expr::Ptr e, Var v) {
+  switch (e->tag()) {
+    case Expr::VAR:   return same_var(e->var(), v);
+    case Expr::DEREF: return uses_var(e->deref_ptr(), v);
+    case Expr::APPLY: return uses_var(e->lhs(), v) || uses_var(e->rhs(), v);
+    default:          return false;
+  }
+}
+
+
+/**
+ * Return a copy of the expression with all occurences of `v` replaced by `rep`
+ */
+Expr::Ptr subst(Expr::Ptr e, Var v, Expr::Ptr rep) {
+  switch (e->tag()) {
+    case Expr::VAR:   return same_var(e->var(), v)? rep : e;
+    case Expr::DEREF: return mkDeref(subst(e->deref_ptr(), v, rep));
+    case Expr::APPLY: return mkApply(subst(e->lhs(), v, rep), e->apply_op, subst(e->rhs(), v, rep));
+    default:          return e;
+  }
+}
+
 }  // namespace V3DLib
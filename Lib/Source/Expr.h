@@ -88,6 +88,12 @@ Expr::Ptr mkApply(Expr::Ptr lhs, Op op, Expr::Ptr rhs);
 Expr::Ptr mkApply(Expr::Ptr rhs, Op op);
 Expr::Ptr mkDeref(Expr::Ptr ptr);
 
+bool same_var(Var lhs, Var rhs);
+bool equal(Expr::Ptr a, Expr::Ptr b);
+bool uses_var(Expr::Ptr e, Var v);
+bool has_deref(Expr::Ptr e);
+Expr::Ptr subst(Expr::Ptr e, Var v, Expr::Ptr rep);
+
 }  // namespace V3DLib
 
 
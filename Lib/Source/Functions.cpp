@@ -0,0 +1,163 @@
+#include "Functions.h"
+#include "Support/Platform.h"
+#include "Lang.h"
+#include "gather.h"
+#include "vc4/DMA.h"  // semaInc(), semaDec(), dmaWaitWrite()
+
+namespace V3DLib {
+namespace {
+
+int const VEC_SIZE = 16;
+
+/**
+ * Semaphore used for combining the results of the QPUs in a reduction.
+ *
+ * Semaphore 15 is used by `KernelDriver::kernelFinish()` for vc4.
+ */
+int const REDUCE_SEMA_ID = 14;
+
+IntExpr   op_add(IntExpr a, IntExpr b)     { return a + b; }
+FloatExpr op_add(FloatExpr a, FloatExpr b) { return a + b; }
+IntExpr   op_min(IntExpr a, IntExpr b)     { return min(a, b); }
+FloatExpr op_min(FloatExpr a, FloatExpr b) { return min(a, b); }
+IntExpr   op_max(IntExpr a, IntExpr b)     { return max(a, b); }
+FloatExpr op_max(FloatExpr a, FloatExpr b) { return max(a, b); }
+
+
+/**
+ * Combine all elements of a vector in log2(16) = 4 steps.
+ *
+ * After step k, every element holds the combination of 2^k consecutive
+ * elements, wrapping around at the end of the vector.
+ *
+ * The rotate amounts are constants, so that no rotate amount register needs
+ * to be set up (r5 on vc4).
+ */
+template<typename T, typename Expr>
+Expr reduce(Expr a, Expr (*op)(Expr, Expr)) {
+  T ret = a;
+
+  for (int n = 1; n < VEC_SIZE; n *= 2) {  // loop unroll
+    ret = op(ret, rotate(ret, n));
+  }
+
+  return ret;
+}
+
+
+/**
+ * Inclusive prefix sum in log2(16) = 4 steps (Hillis-Steele).
+ */
+template<typename T, typename Expr>
+Expr scan(Expr a) {
+  T ret = a;
+  Int i = index();
+
+  for (int n = 1; n < VEC_SIZE; n *= 2) {  // loop unroll
+    T tmp = rotate(ret, n);
+
+    Where (i >= n)
+      ret = ret + tmp;
+    End
+  }
+
+  return ret;
+}
+
+
+template<typename T, typename Expr>
+Expr exclusive_scan(Expr a) {
+  T ret = rotate(scan<T, Expr>(a), 1);
+
+  Where (index() == 0)
+    ret = 0;
+  End
+
+  return ret;
+}
+
+
+/**
+ * Combine the reduced vectors of all QPUs on QPU 0.
+ *
+ * Every QPU stores its partial result in its own vector of `scratch`.
+ * The other QPUs then signal QPU 0 that their result is available:
+ *
+ * - vc4: with a semaphore, as in `KernelDriver::kernelFinish()`
+ * - v3d: with a done-flag in the second half of `scratch`, since there are no
+ *        semaphores. QPU 0 polls the flags and resets them after use, so that
+ *        the scratch buffer can be reused for a next kernel invocation.
+ *
+ * On v3d, a partial result is only flagged as available after its store has completed
+ * (TMUWT), so that it can not arrive after the flag.
+ *
+ * TODO: the poll should use a flushing TMU lookup, so that it can not be served from a stale
+ *       line in the TMU cache of QPU 0. This requires passing the TMU operation in a config
+ *       uniform, which the v3d code generation does not support yet.
+ */
+template<typename T, typename Expr>
+Expr reduce(Expr a, Ptr<T> &scratch, Expr (*op)(Expr, Expr)) {
+  T ret = reduce<T, Expr>(a, op);
+  bool for_vc4 = Platform::instance().compiling_for_vc4();
+
+  If (me() != 0)
+    *scratch = ret;  comment("Cross-QPU reduction: pass partial result to QPU 0");
+
+    if (for_vc4) {
+      dmaWaitWrite();
+      semaInc(REDUCE_SEMA_ID);
+    } else {
+      tmuWaitWrite();  // Result must be visible before the flag is
+      T done = 1;
+      scratch[numQPUs() << 4] = done;
+    }
+  Else
+    For (Int q = 1, q < numQPUs(), q++)
+      if (for_vc4) {
+        semaDec(REDUCE_SEMA_ID);
+      } else {
+        Ptr<T> flag = scratch + ((numQPUs() + q) << 4);
+        T done = 0;
+
+        While (any(done == 0))
+          gather(flag);
+          receive(done);
+        End
+
+        T clear = 0;
+        *flag = clear;
+      }
+    End
+
+    For (Int q = 1, q < numQPUs(), q++)
+      T val = scratch[q << 4];
+      ret = op(ret, val);
+    End
+  End
+
+  return ret;
+}
+
+}  // anon namespace
+
+
+IntExpr   reduce_add(IntExpr a)   { return reduce<Int>(a, op_add); }
+FloatExpr reduce_add(FloatExpr a) { return reduce<Float>(a, op_add); }
+IntExpr   reduce_min(IntExpr a)   { return reduce<Int>(a, op_min); }
+FloatExpr reduce_min(FloatExpr a) { return reduce<Float>(a, op_min); }
+IntExpr   reduce_max(IntExpr a)   { return reduce<Int>(a, op_max); }
+FloatExpr reduce_max(FloatExpr a) { return reduce<Float>(a, op_max); }
+
+IntExpr   scan_add(IntExpr a)             { return scan<Int>(a); }
+FloatExpr scan_add(FloatExpr a)           { return scan<Float>(a); }
+IntExpr   exclusive_scan_add(IntExpr a)   { return exclusive_scan<Int>(a); }
+FloatExpr exclusive_scan_add(FloatExpr a) { return exclusive_scan<Float>(a); }
+
+IntExpr   reduce_add(IntExpr a, Ptr<Int> &scratch)     { return reduce(a, scratch, op_add); }
+FloatExpr reduce_add(FloatExpr a, Ptr<Float> &scratch) { return reduce(a, scratch, op_add); }
+IntExpr   reduce_min(IntExpr a, Ptr<Int> &scratch)     { return reduce(a, scratch, op_min); }
+FloatExpr reduce_min(FloatExpr a, Ptr<Float> &scratch) { return reduce(a, scratch, op_min); }
+IntExpr   reduce_max(IntExpr a, Ptr<Int> &scratch)     { return reduce(a, scratch, op_max); }
+FloatExpr reduce_max(FloatExpr a, Ptr<Float> &scratch) { return reduce(a, scratch, op_max); }
+
+}  // namespace V3DLib
@@ -0,0 +1,55 @@
+#ifndef _V3DLIB_SOURCE_FUNCTIONS_H_
+#define _V3DLIB_SOURCE_FUNCTIONS_H_
+#include "Source/Int.h"
+#include "Source/Float.h"
+#include "Source/Ptr.h"
+
+namespace V3DLib {
+
+//=============================================================================
+// Reductions over the elements of a vector
+//
+// These are kernel helper functions; they emit code.
+// All vector elements of the result contain the same value.
+//=============================================================================
+
+IntExpr   reduce_add(IntExpr a);
+FloatExpr reduce_add(FloatExpr a);
+IntExpr   reduce_min(IntExpr a);
+FloatExpr reduce_min(FloatExpr a);
+IntExpr   reduce_max(IntExpr a);
+FloatExpr reduce_max(FloatExpr a);
+
+//=============================================================================
+// Prefix sums over the elements of a vector
+//
+// Element i of the result of the inclusive scan is the sum of elements 0..i,
+// for the exclusive scan it is the sum of elements 0..i-1.
+//=============================================================================
+
+IntExpr   scan_add(IntExpr a);
+FloatExpr scan_add(FloatExpr a);
+IntExpr   exclusive_scan_add(IntExpr a);
+FloatExpr exclusive_scan_add(FloatExpr a);
+
+//=============================================================================
+// Reductions over the vectors of all QPUs
+//
+// The final result is only available on QPU 0; the other QPUs get the
+// reduction of their own vector.
+//
+// `scratch` must be a kernel parameter, unmodified by the kernel, with room
+// for 2*numQPUs() vectors, which must be zero on kernel start.
+// Use a separate scratch buffer for every call within a kernel.
+//=============================================================================
+
+IntExpr   reduce_add(IntExpr a, Ptr<Int> &scratch);
+FloatExpr reduce_add(FloatExpr a, Ptr<Float> &scratch);
+IntExpr   reduce_min(IntExpr a, Ptr<Int> &scratch);
+FloatExpr reduce_min(FloatExpr a, Ptr<Float> &scratch);
+IntExpr   reduce_max(IntExpr a, Ptr<Int> &scratch);
+FloatExpr reduce_max(FloatExpr a, Ptr<Float> &scratch);
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_SOURCE_FUNCTIONS_H_
@@ -0,0 +1,235 @@
+#include "IfConversion.h"
+#include <algorithm>  // std::max()
+#include "Support/basics.h"
+#include "Uniformity.h"
+
+namespace V3DLib {
+namespace {
+
+/**
+ * Maximum estimated number of instructions in the bodies of a converted `If`.
+ *
+ * A branch costs a compare, the branch itself and three delay slots, which are
+ * often not filled. A `Where` replaces this with the compare and a flag reset,
+ * but executes both bodies. Above this size, the skipped instructions are
+ * expected to outweigh the branch overhead.
+ */
+int const MAX_COST = 4;
+
+/**
+ * Estimated number of instructions for an SFU function (write, two wait slots, read).
+ */
+int const SFU_COST = 4;
+
+
+/**
+ * Check that an expression has no side effects.
+ *
+ * Reading memory, the VPM or the uniforms changes state.
+ */
+bool is_pure(Expr::Ptr e) {
+  if (e.get() == nullptr) return true;
+
+  switch (e->tag()) {
+    case Expr::INT_LIT:
+    case Expr::FLOAT_LIT:
+      return true;
+    case Expr::VAR: {
+      auto tag = e->var().tag();
+      return tag == STANDARD || tag == QPU_NUM || tag == ELEM_NUM;
+    }
+    case Expr::APPLY:
+      return is_pure(e->lhs()) && is_pure(e->rhs());
+    case Expr::DEREF:
+      return false;
+  }
+
+  assert(false);
+  return false;
+}
+
+
+bool is_pure(BExpr::Ptr b) {
+  switch (b->tag()) {
+    case NOT: return is_pure(b->neg());
+    case AND:
+    case OR:  return is_pure(b->lhs()) && is_pure(b->rhs());
+    case CMP: return is_pure(b->cmp_lhs()) && is_pure(b->cmp_rhs());
+  }
+
+  assert(false);
+  return false;
+}
+
+
+int cost(Expr::Ptr e) {
+  if (e.get() == nullptr || e->tag() != Expr::APPLY) return 0;
+
+  int ret = e->apply_op.isFunction()? SFU_COST : 1;
+  return ret + cost(e->lhs()) + cost(e->rhs());
+}
+
+
+int cost(BExpr::Ptr b) {
+  switch (b->tag()) {
+    case NOT: return cost(b->neg()) + 1;
+    case AND:
+    case OR:  return cost(b->lhs()) + cost(b->rhs()) + 1;
+    case CMP: return cost(b->cmp_lhs()) + cost(b->cmp_rhs()) + 1;
+  }
+
+  assert(false);
+  return 0;
+}
+
+
+/**
+ * Estimate the number of instructions of a statement within a `Where`.
+ *
+ * Only assignments to variables and nested `Where`-statements are allowed.
+ *
+ * @return estimated number of instructions, -1 if the statement can not be
+ *         placed in a `Where`
+ */
+int where_cost(Stmt::Ptr s) {
+  if (s.get() == nullptr) return 0;
+
+  switch (s->tag) {
+    case SKIP:
+      return 0;
+    case SEQ: {
+      int c0 = where_cost(s->seq_s0());
+      int c1 = where_cost(s->seq_s1());
+      if (c0 < 0 || c1 < 0) return -1;
+      return c0 + c1;
+    }
+    case ASSIGN: {
+      auto lhs = s->assign_lhs();
+      if (lhs->tag() != Expr::VAR || lhs->var().tag() != STANDARD) return -1;
+      if (!is_pure(s->assign_rhs())) return -1;
+      return std::max(1, cost(s->assign_rhs()));
+    }
+    case WHERE: {
+      if (!is_pure(s->where_cond())) return -1;
+      int c0 = where_cost(s->thenStmt());
+      int c1 = where_cost(s->elseStmt());
+      if (c0 < 0 || c1 < 0) return -1;
+
+      int ret = cost(s->where_cond()) + 2 + c0 + c1;  // cond, combining flags, flag reset
+      if (!s->else_is_null()) ret += 2;
+      return ret;
+    }
+    default:
+      return -1;
+  }
+}
+
+
+class Converter {
+public:
+  Converter(Stmt::Ptr body, std::vector<std::string> &converted) : m_converted(converted) {
+    if (body.get() != nullptr) m_info.add(*body, false);
+  }
+
+  Stmt::Ptr convert(Stmt::Ptr s);
+
+private:
+  Uniformity m_info;
+  std::vector<std::string> &m_converted;
+
+  bool can_convert(Stmt const &s) const;
+};
+
+
+bool Converter::can_convert(Stmt const &s) const {
+  assert(s.tag == IF);
+  BExpr::Ptr cond = s.if_cond()->bexpr();
+  if (!is_pure(cond) || !m_info.uniform(cond)) return false;
+
+  int then_cost = where_cost(s.thenStmt());
+  int else_cost = where_cost(s.elseStmt());
+  if (then_cost < 0 || else_cost < 0) return false;
+
+  return (then_cost + else_cost <= MAX_COST);
+}
+
+
+Stmt::Ptr Converter::convert(Stmt::Ptr s) {
+  if (s.get() == nullptr) return s;
+
+  Stmt::Ptr ret;
+
+  switch (s->tag) {
+    case SEQ: {
+      auto s0 = convert(s->seq_s0());
+      auto s1 = convert(s->seq_s1());
+      if (s0 == s->seq_s0() && s1 == s->seq_s1()) return s;
+
+      ret = Stmt::create_sequence(s0, s1);
+      break;
+    }
+    case IF: {
+      // Inner statements first, so that nested if's can become nested where's
+      auto then_stmt = convert(s->thenStmt());
+      auto else_stmt = convert(s->elseStmt());
+
+      ret = Stmt::mkIf(s->if_cond(), then_stmt, else_stmt);
+
+      if (can_convert(*ret)) {
+        m_converted.push_back(s->if_cond()->dump());
+        ret = mkWhere(s->if_cond()->bexpr(), then_stmt, else_stmt);
+        ret->transfer_comments(*s);
+        ret->comment("If converted to Where");
+        return ret;
+      } else if (then_stmt == s->thenStmt() && else_stmt == s->elseStmt()) {
+        return s;
+      }
+      break;
+    }
+    case WHERE: {
+      auto then_stmt = convert(s->thenStmt());
+      auto else_stmt = convert(s->elseStmt());
+      if (then_stmt == s->thenStmt() && else_stmt == s->elseStmt()) return s;
+
+      ret = mkWhere(s->where_cond(), then_stmt, else_stmt);
+      break;
+    }
+    case WHILE: {
+      auto body = convert(s->body());
+      if (body == s->body()) return s;
+
+      ret = Stmt::mkWhile(s->loop_cond(), body);
+      break;
+    }
+    default:
+      return s;
+  }
+
+  ret->transfer_comments(*s);
+  return ret;
+}
+
+}  // anon namespace
+
+
+/**
+ * Convert small `If`-statements into `Where`-statements.
+ *
+ * An `If` compiles to a compare, a branch and three delay slots. For short bodies
+ * which only assign variables, executing the bodies with predicated instructions
+ * is cheaper. This is only possible if the condition has the same value in all
+ * vector elements, otherwise `any()` and `all()` differ from a `Where`.
+ *
+ * The passed statement is not changed; the changed parts are copied. This allows
+ * the interpreter to use the original statements.
+ *
+ * @param converted  output parameter, receives the conditions of the converted `If`-statements
+ *
+ * @return statement with converted `If`-statements
+ */
+Stmt::Ptr if_conversion(Stmt::Ptr s, std::vector<std::string> &converted) {
+  Converter converter(s, converted);
+  return converter.convert(s);
+}
+
+}  // namespace V3DLib
@@ -0,0 +1,13 @@
+#ifndef _V3DLIB_SOURCE_IFCONVERSION_H_
+#define _V3DLIB_SOURCE_IFCONVERSION_H_
+#include <string>
+#include <vector>
+#include "Stmt.h"
+
+namespace V3DLib {
+
+Stmt::Ptr if_conversion(Stmt::Ptr s, std::vector<std::string> &converted);
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_SOURCE_IFCONVERSION_H_
@@ -22,7 +22,7 @@ struct CoreState {
   Seq<char>* output = nullptr;   // Output from print statements
   Seq<Stmt::Ptr> stack;          // Control stack
   Seq<Vec> loadBuffer;           // Load buffer
-  SharedArray<uint32_t> emuHeap;
+  HeapView emuHeap;
 
 
   ~CoreState() {
@@ -644,6 +644,7 @@ void exec(InterpreterState* state, CoreState* s) {
 
     case DMA_READ_WAIT:
     case DMA_WRITE_WAIT:
+    case TMU_WRITE_WAIT:
     case SETUP_VPM_READ:
     case SETUP_VPM_WRITE:
     case SETUP_DMA_READ:
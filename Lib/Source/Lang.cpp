@@ -1,13 +1,19 @@
 #include "Lang.h"
 #include <stdio.h>
+#include <vector>
 #include "Support/basics.h"  // fatal()
+#include "Support/Platform.h"
 #include "Source/Int.h"
+#include "Source/Float.h"
 #include "StmtStack.h"
+#include "Pipeline.h"
 
 namespace V3DLib {
 
 namespace {
   StmtStack controlStack;
+
+  Stmt::Ptr mask_par_for_tail(Stmt const &loop, Stmt::Ptr body);
 } // anon namespace
 
 
@@ -83,12 +89,24 @@ void End_() {
       ok = 1;
     }
 
+    Stmt::Ptr prologue;
+
     if (s->tag == FOR && s->body_is_null()) {
-      s->for_to_while(stmtStack().pop());
+      Stmt::Ptr body = mask_par_for_tail(*s, stmtStack().pop());
+
+      if (Platform::instance().pipeline_loads()) {
+        prologue = pipeline_loads(*s, body, stmtStack(), controlStack);
+      }
+
+      s->for_to_while(body);
       ok = 1;
     }
 
     if (ok) {
+      if (prologue.get() != nullptr) {
+        stmtStack().append(prologue);
+      }
+
       stmtStack().append(controlStack.pop());
     }
   }
@@ -142,6 +160,272 @@ void ForBody_() {
   stmtStack().push(mkSkip());
 }
 
+//=============================================================================
+// 'ParFor' token
+//=============================================================================
+
+namespace {
+
+/**
+ * An open `ParFor`-loop
+ */
+struct ParForLoop {
+  Stmt const *loop;
+  Var i;
+  Var limit;  // End of the range, relative to the per-QPU offset
+};
+
+std::vector<ParForLoop> parForLoops;  // Innermost last
+
+
+bool is_store(Stmt::Ptr s) {
+  return s->tag == ASSIGN && s->assign_lhs()->tag() == Expr::DEREF;
+}
+
+
+bool is_load(Stmt::Ptr s) {
+  return s->tag == ASSIGN && s->assign_lhs()->tag() == Expr::VAR && s->assign_rhs()->tag() == Expr::DEREF;
+}
+
+
+/**
+ * Masks the stores in a `ParFor` body for the lanes beyond the end of the range.
+ *
+ * Stores are always done for the full vector. For the lanes beyond the end, the
+ * current memory contents are stored instead of the computed value:
+ *
+ *     tmp = value
+ *     Where (i + index() >= limit)
+ *       tmp = old
+ *     End
+ *     *addr = tmp
+ *
+ * Here, `old` is a copy of a preceding load from the same address in the body if there
+ * is one, so that no extra memory access is needed for the common case `x[i] = f(x[i])`.
+ * Otherwise, it is loaded separately.
+ */
+class TailMask {
+public:
+  TailMask(ParForLoop const &loop) : m_loop(loop) {}
+
+  Stmt::Ptr top_level(Stmt::Ptr body);
+
+private:
+  ParForLoop const &m_loop;
+
+  int matching_load(std::vector<Stmt::Ptr> const &stmts, int store) const;
+  Stmt::Ptr nested(Stmt::Ptr s) const;
+  Stmt::Ptr masked_store(Stmt::Ptr store, Expr::Ptr old) const;
+};
+
+
+Stmt::Ptr TailMask::top_level(Stmt::Ptr body) {
+  std::vector<Stmt::Ptr> stmts;
+  flatten(body, stmts);
+
+  std::vector<Expr::Ptr> copies(stmts.size());  // Copies of loaded values, per load
+
+  for (int k = 0; k < (int) stmts.size(); ++k) {
+    if (!is_store(stmts[k])) continue;
+
+    int load = matching_load(stmts, k);
+    if (load >= 0 && copies[load].get() == nullptr) {
+      copies[load] = mkVar(freshVar());
+    }
+  }
+
+  std::vector<Stmt::Ptr> ret;
+
+  for (int k = 0; k < (int) stmts.size(); ++k) {
+    auto &s = stmts[k];
+
+    if (is_store(s)) {
+      int load = matching_load(stmts, k);
+      ret.push_back(masked_store(s, (load >= 0)? copies[load] : nullptr));
+      continue;
+    }
+
+    ret.push_back(nested(s));
+
+    if (copies[k].get() != nullptr) {
+      ret.push_back(Stmt::create_assign(copies[k], s->assign_lhs()));
+    }
+  }
+
+  return sequence(ret);
+}
+
+
+/**
+ * Find a load from the same address as the given store, which precedes it at the top level
+ * of the body.
+ *
+ * Only straight-line code without assignments to the variables in the address is allowed
+ * in between, so that the address has the same value for the load and the store.
+ *
+ * @return index of the load in `stmts`, -1 if none
+ */
+int TailMask::matching_load(std::vector<Stmt::Ptr> const &stmts, int store) const {
+  Expr::Ptr addr = stmts[store]->assign_lhs()->deref_ptr();
+
+  for (int k = store - 1; k >= 0; --k) {
+    auto const &s = stmts[k];
+    if (s->tag != ASSIGN) return -1;
+    if (is_load(s) && equal(s->assign_rhs()->deref_ptr(), addr)) return k;
+
+    Expr::Ptr lhs = s->assign_lhs();
+    if (lhs->tag() == Expr::VAR && uses_var(addr, lhs->var())) return -1;
+  }
+
+  return -1;
+}
+
+
+/**
+ * Mask the stores within control statements. These always load the current memory contents.
+ */
+Stmt::Ptr TailMask::nested(Stmt::Ptr s) const {
+  if (s.get() == nullptr) return s;
+
+  switch (s->tag) {
+    case ASSIGN:
+      return is_store(s)? masked_store(s, nullptr) : s;
+    case SEQ:
+      return Stmt::create_sequence(nested(s->seq_s0()), nested(s->seq_s1()));
+    case IF:
+      return Stmt::mkIf(s->if_cond(), nested(s->thenStmt()), nested(s->elseStmt()));
+    case WHERE:
+      return mkWhere(s->where_cond(), nested(s->thenStmt()), nested(s->elseStmt()));
+    case WHILE:
+      return Stmt::mkWhile(s->loop_cond(), nested(s->body()));
+    default:
+      return s;
+  }
+}
+
+
+Stmt::Ptr TailMask::masked_store(Stmt::Ptr store, Expr::Ptr old) const {
+  Expr::Ptr tmp = mkVar(freshVar());
+  std::vector<Stmt::Ptr> ret;
+
+  ret.push_back(Stmt::create_assign(tmp, store->assign_rhs()));
+
+  if (old.get() == nullptr) {
+    old = mkVar(freshVar());
+    ret.push_back(Stmt::create_assign(old, mkDeref(store->assign_lhs()->deref_ptr())));
+  }
+
+  BoolExpr tail = (IntExpr(mkVar(m_loop.i)) + index() >= IntExpr(mkVar(m_loop.limit)));
+  ret.push_back(mkWhere(tail.bexpr(), Stmt::create_assign(tmp, old), nullptr));
+  ret.back()->comment("Keep memory beyond the end of the ParFor range");
+
+  ret.push_back(Stmt::create_assign(store->assign_lhs(), tmp));
+  ret.back()->transfer_comments(*store);
+
+  return sequence(ret);
+}
+
+
+/**
+ * Apply the tail masking if the given loop is the innermost open `ParFor`
+ */
+Stmt::Ptr mask_par_for_tail(Stmt const &loop, Stmt::Ptr body) {
+  if (parForLoops.empty() || parForLoops.back().loop != &loop) return body;
+
+  Stmt::Ptr ret = TailMask(parForLoops.back()).top_level(body);
+  parForLoops.pop_back();
+  return ret;
+}
+
+
+/**
+ * Integer division rounded up, for small positive values.
+ *
+ * There is no integer division on the QPU's. The result is estimated with
+ * a float calculation and then corrected, because the reciprocal is not exact.
+ */
+IntExpr div_ceil(IntExpr a, IntExpr b) {
+  Int ret = toInt(toFloat(a + b - 1) * recip(toFloat(b)));
+
+  While (any(ret*b < a))
+    ret = ret + 1;
+  End
+
+  While (any(ret > 0 && (ret - 1)*b >= a))
+    ret = ret - 1;
+  End
+
+  return ret;
+}
+
+}  // anon namespace
+
+
+/**
+ * Loop over the elements in the range [begin, end) on all QPU's.
+ *
+ * The range is split in vectors of 16 elements, which are distributed over the QPU's.
+ * The loop variable `i` is the index to use with the kernel's pointer arguments for the
+ * current vector, e.g. `x[i]`. It corrects for the per-QPU offset which is added
+ * implicitly to the pointer arguments, so no index bookkeeping is needed in the kernel.
+ * The loop variable has the same value for all lanes.
+ *
+ * If the range size is not a multiple of 16, the last vector extends beyond `end`.
+ * The stores in the loop body are masked for the lanes beyond `end`, so that the memory
+ * there is left unchanged:
+ *
+ *     ParFor (i, 0, n)
+ *       Float a = x[i];
+ *       x[i] = a*2.0f;  // x[n] and up are not changed
+ *     End
+ *
+ * Note that the loads are always done for the full vector, so the memory beyond `end`
+ * up to the next multiple of 16 must be readable. The computations are also done for
+ * all lanes; use `par_index()` to mask these if needed.
+ *
+ * @param i     loop variable
+ * @param begin first element index, inclusive
+ * @param end   last element index, exclusive
+ * @param mode  distribution of the vectors over the QPU's
+ */
+void ParFor_(Int &i, IntExpr begin, IntExpr end, ParForMode mode) {
+  Int offset = me() << 4;  // Per-QPU offset of pointer arguments
+  Int limit  = end - offset;
+
+  if (mode == CONTIGUOUS) {
+    Int num_vecs = (end - begin + 15) >> 4;
+    Int chunk    = div_ceil(num_vecs, numQPUs());
+    Int first    = me()*chunk;
+    Int last     = min(first + chunk, num_vecs);
+    Int stop     = begin + (last << 4) - offset;
+
+    i = begin + (first << 4) - offset;
+
+    For_(i < stop);
+      i = i + 16;
+    ForBody_();
+  } else {
+    i = begin;
+
+    For_(i < limit);
+      i = i + (numQPUs() << 4);
+    ForBody_();
+  }
+
+  parForLoops.push_back({controlStack.top().get(), i.expr()->var(), limit.expr()->var()});
+}
+
+
+/**
+ * Get the element indexes for the lanes in the current iteration of a `ParFor`.
+ *
+ * @param i  loop variable of the `ParFor`
+ */
+IntExpr par_index(IntExpr i) {
+  return i + (me() << 4) + index();
+}
+
+
 //=============================================================================
 // 'Print' token
 //=============================================================================
@@ -181,6 +465,7 @@ void finishStmt() {
 
 void initStmt(StmtStack &stmtStack) {
   controlStack.clear();
+  parForLoops.clear();
   stmtStack.clear();
   stmtStack.push(mkSkip());
   setStack(stmtStack);
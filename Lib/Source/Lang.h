@@ -21,6 +21,18 @@ class StmtStack;  // Forward declaration
     For_(cond);              \
       inc;                   \
     ForBody_();
+#define ParFor(i, ...)       \
+  { Int i;                   \
+    ParFor_(i, __VA_ARGS__);
+
+//=============================================================================
+// Distribution of work over the QPUs for 'ParFor'
+//=============================================================================
+
+enum ParForMode {
+  BLOCK_CYCLIC,  // QPU's handle vectors in turn, i.e. QPU q handles vectors q, q + numQPUs, ...
+  CONTIGUOUS     // Each QPU handles a single contiguous range of vectors
+};
 
 //=============================================================================
 // Statement tokens
@@ -38,6 +50,8 @@ inline void Where_(BoolExpr b) { Where__(b.bexpr()); }
 void For_(Cond c);
 void For_(BoolExpr b);
 void ForBody_();
+void ParFor_(Int &i, IntExpr begin, IntExpr end, ParForMode mode = BLOCK_CYCLIC);
+IntExpr par_index(IntExpr i);
 void Print(const char *);
 void Print(IntExpr x);
 void header(char const *str);
@@ -0,0 +1,435 @@
+#include "Pipeline.h"
+#include <algorithm>              // std::find()
+#include <set>
+#include <vector>
+#include "Int.h"                  // index()
+#include "Support/Platform.h"
+#include "Support/basics.h"
+#include "Uniformity.h"
+
+namespace V3DLib {
+namespace {
+
+/**
+ * Maximum number of outstanding TMU loads per QPU, see `Doc/Examples.md`.
+ *
+ * When prefetching, the loads of two consecutive iterations are in flight
+ * at the same time, so at most half of this is available per iteration.
+ */
+int const TMU_FIFO_DEPTH = 4;
+
+
+BExpr::Ptr subst(BExpr::Ptr b, Var v, Expr::Ptr rep) {
+  switch (b->tag()) {
+    case NOT: return subst(b->neg(), v, rep)->Not();
+    case AND: return subst(b->lhs(), v, rep)->And(subst(b->rhs(), v, rep));
+    case OR:  return subst(b->lhs(), v, rep)->Or(subst(b->rhs(), v, rep));
+    case CMP: return std::make_shared<BExpr>(subst(b->cmp_lhs(), v, rep), b->cmp, subst(b->cmp_rhs(), v, rep));
+  }
+
+  assert(false);
+  return b;
+}
+
+
+/**
+ * Issue a TMU load for the given address, as `gather()` does
+ */
+Stmt::Ptr mkGather(Expr::Ptr addr) {
+  if (Platform::instance().compiling_for_vc4()) {
+    // Each lane loads its own element, like the DMA load for a dereference does
+    addr = mkApply(addr, Op(ADD, INT32), mkApply(index().expr(), Op(SHL, INT32), mkIntLit(2)));
+  }
+
+  return Stmt::create_assign(mkVar(Var(TMU0_ADDR)), addr);
+}
+
+
+/**
+ * Determines if the loads in a `For`-loop can be pipelined.
+ */
+class LoopAnalysis {
+public:
+  LoopAnalysis(Stmt const &loop, Stmt::Ptr body);
+
+  bool ok() const { return m_ok; }
+  Var ind() const { return m_ind; }
+  Expr::Ptr next_ind() const { return m_next_ind; }
+  std::vector<Stmt::Ptr> const &loads() const { return m_loads; }
+  std::vector<Stmt::Ptr> const &stmts() const { return m_stmts; }
+
+private:
+  bool m_ok = false;
+  Var m_ind = Var(DUMMY);               // Loop variable
+  Expr::Ptr m_next_ind;                 // Value of loop variable for next iteration
+  std::vector<Stmt::Ptr> m_stmts;       // Top-level statements of the body
+  std::vector<Stmt::Ptr> m_loads;       // Top-level statements of form `v = *addr`
+  std::vector<Expr::Ptr> m_stores;      // Addresses stored to in the body
+  std::set<VarId>        m_assigned;    // Variables assigned to in the body
+
+  bool is_load(Stmt::Ptr s) const;
+  bool hoistable(Expr::Ptr e) const;
+  bool hoistable(BExpr::Ptr b) const;
+  bool scan(Stmt::Ptr s);
+  bool scan_assign(Stmt::Ptr s);
+  bool init_ind(Stmt::Ptr inc);
+  bool stores_ok() const;
+  bool analyze(Stmt const &loop);
+};
+
+
+LoopAnalysis::LoopAnalysis(Stmt const &loop, Stmt::Ptr body) {
+  flatten(body, m_stmts);
+
+  for (auto const &s : m_stmts) {
+    if (s->tag != ASSIGN) continue;
+
+    Expr::Ptr lhs = s->assign_lhs();
+    if (lhs->tag() == Expr::VAR && lhs->var().tag() == STANDARD && s->assign_rhs()->tag() == Expr::DEREF) {
+      m_loads.push_back(s);
+    }
+  }
+
+  if (m_loads.empty()) return;  // Nothing to do
+
+  m_ok = scan(body) && analyze(loop);
+}
+
+
+bool LoopAnalysis::is_load(Stmt::Ptr s) const {
+  return std::find(m_loads.begin(), m_loads.end(), s) != m_loads.end();
+}
+
+
+/**
+ * Check if given expression can be evaluated for any iteration at any point in the loop.
+ *
+ * This is the case if it depends only on the loop variable and on variables which are
+ * not changed in the loop.
+ */
+bool LoopAnalysis::hoistable(Expr::Ptr e) const {
+  switch (e->tag()) {
+    case Expr::INT_LIT:
+    case Expr::FLOAT_LIT:
+      return true;
+    case Expr::VAR: {
+      Var v = e->var();
+
+      switch (v.tag()) {
+        case STANDARD:
+          return same_var(v, m_ind) || m_assigned.count(v.id()) == 0;
+        case QPU_NUM:
+        case ELEM_NUM:
+          return true;
+        default:
+          return false;  // Reading has side effects
+      }
+    }
+    case Expr::APPLY:
+      return hoistable(e->lhs()) && hoistable(e->rhs());
+    case Expr::DEREF:
+      return false;
+  }
+
+  return false;
+}
+
+
+bool LoopAnalysis::hoistable(BExpr::Ptr b) const {
+  switch (b->tag()) {
+    case NOT: return hoistable(b->neg());
+    case AND:
+    case OR:  return hoistable(b->lhs()) && hoistable(b->rhs());
+    case CMP: return hoistable(b->cmp_lhs()) && hoistable(b->cmp_rhs());
+  }
+
+  return false;
+}
+
+
+/**
+ * Scan the loop body for assigned variables and memory accesses.
+ *
+ * @return false if the body contains statements which may interfere with
+ *         the pipelined loads, true otherwise
+ */
+bool LoopAnalysis::scan(Stmt::Ptr s) {
+  if (s.get() == nullptr) return true;
+
+  switch (s->tag) {
+    case SKIP:
+      return true;
+    case SEQ:
+      return scan(s->seq_s0()) && scan(s->seq_s1());
+    case ASSIGN:
+      return scan_assign(s);
+    case IF:
+      return !has_deref(s->if_cond()->bexpr()) && scan(s->thenStmt()) && scan(s->elseStmt());
+    case WHERE:
+      return !has_deref(s->where_cond()) && scan(s->thenStmt()) && scan(s->elseStmt());
+    case WHILE:
+      return !has_deref(s->loop_cond()->bexpr()) && scan(s->body());
+    case PRINT:
+      return s->print.tag() == PRINT_STR || !has_deref(s->print_expr());
+    default:
+      // Explicit TMU, DMA and VPM operations.
+      // These would interfere with the pipelined loads, or are too hard to reason about.
+      return false;
+  }
+}
+
+
+bool LoopAnalysis::scan_assign(Stmt::Ptr s) {
+  Expr::Ptr lhs = s->assign_lhs();
+  Expr::Ptr rhs = s->assign_rhs();
+
+  if (lhs->tag() == Expr::DEREF) {  // Store
+    m_stores.push_back(lhs->deref_ptr());
+    return !has_deref(lhs->deref_ptr()) && !has_deref(rhs);
+  }
+
+  assert(lhs->tag() == Expr::VAR);
+  Var v = lhs->var();
+  if (v.tag() != STANDARD) return false;  // Notably, a `gather()` or a VPM write
+
+  m_assigned.insert(v.id());
+
+  if (is_load(s)) {
+    return !has_deref(rhs->deref_ptr());
+  }
+
+  return !has_deref(rhs);
+}
+
+
+/**
+ * Determine the loop variable and its value for the next iteration.
+ *
+ * The increment statement must be a single assignment to the loop variable.
+ */
+bool LoopAnalysis::init_ind(Stmt::Ptr inc) {
+  std::vector<Stmt::Ptr> stmts;
+  flatten(inc, stmts);
+  if (stmts.size() != 1 || stmts[0]->tag != ASSIGN) return false;
+
+  Expr::Ptr lhs = stmts[0]->assign_lhs();
+  Expr::Ptr rhs = stmts[0]->assign_rhs();
+  if (lhs->tag() != Expr::VAR || lhs->var().tag() != STANDARD) return false;
+
+  m_ind      = lhs->var();
+  m_next_ind = rhs;
+
+  return !m_assigned.count(m_ind.id()) && hoistable(m_next_ind);
+}
+
+
+/**
+ * Check that stores in the body do not change memory which is prefetched.
+ *
+ * The prefetch for the next iteration is done before the stores of the current
+ * iteration. This is only safe if the stores are to the same address as a load in
+ * the same iteration, and the memory ranges of consecutive iterations do not overlap.
+ *
+ * The latter is ensured by accepting only addresses of the form `base + (i << 2)`,
+ * i.e. `base[i]`, with `i` increased by at least a full vector in each iteration.
+ * `i` must have the same value for all lanes, this is checked by the caller.
+ */
+bool LoopAnalysis::stores_ok() const {
+  if (m_stores.empty()) return true;
+
+  // Increment must be `i = i + c` with |c| >= 16
+  Expr::Ptr step = m_next_ind;
+  if (step->tag() != Expr::APPLY || step->apply_op.op != ADD || step->apply_op.type != INT32) return false;
+
+  Expr::Ptr c;
+  if (step->lhs()->tag() == Expr::VAR && same_var(step->lhs()->var(), m_ind)) {
+    c = step->rhs();
+  } else if (step->rhs()->tag() == Expr::VAR && same_var(step->rhs()->var(), m_ind)) {
+    c = step->lhs();
+  } else {
+    return false;
+  }
+
+  if (c->tag() == Expr::INT_LIT) {
+    if (c->intLit > -16 && c->intLit < 16) return false;
+  } else if (c->tag() == Expr::APPLY && c->apply_op.op == SHL) {
+    // Accept `numQPUs() << k` with k >= 4, as generated by `ParFor`
+    Expr::Ptr lhs = c->lhs();
+    Expr::Ptr rhs = c->rhs();
+    if (lhs->tag() != Expr::VAR || !same_var(lhs->var(), Var(STANDARD, RSV_NUM_QPUS))) return false;
+    if (rhs->tag() != Expr::INT_LIT || rhs->intLit < 4 || rhs->intLit > 16) return false;
+  } else {
+    return false;
+  }
+
+  for (auto const &addr : m_stores) {
+    bool found = false;
+
+    for (auto const &load : m_loads) {
+      if (equal(addr, load->assign_rhs()->deref_ptr())) {
+        found = true;
+        break;
+      }
+    }
+
+    if (!found) return false;
+
+    // Check form `base + (i << 2)`
+    if (addr->tag() != Expr::APPLY || addr->apply_op.op != ADD) return false;
+    if (uses_var(addr->lhs(), m_ind)) return false;
+
+    Expr::Ptr index = addr->rhs();
+    if (index->tag() != Expr::APPLY || index->apply_op.op != SHL) return false;
+    if (index->lhs()->tag() != Expr::VAR || !same_var(index->lhs()->var(), m_ind)) return false;
+    if (index->rhs()->tag() != Expr::INT_LIT || index->rhs()->intLit != 2) return false;
+  }
+
+  return true;
+}
+
+
+bool LoopAnalysis::analyze(Stmt const &loop) {
+  if (2*((int) m_loads.size()) > TMU_FIFO_DEPTH) return false;
+  if (!init_ind(loop.inc())) return false;
+  if (!hoistable(loop.loop_cond()->bexpr())) return false;
+
+  for (auto const &load : m_loads) {
+    if (!hoistable(load->assign_rhs()->deref_ptr())) return false;
+  }
+
+  return stores_ok();
+}
+
+
+/**
+ * Check if the loop variable has the same value for all lanes.
+ *
+ * This takes into account all statements of the kernel up to the loop.
+ * The statement sequences on the statement stack are within the corresponding
+ * open control statements; the innermost of these is the loop itself.
+ */
+bool uniform_loop_var(Var ind, Stmt const &loop, Stmt::Ptr body, StmtStack const &context, StmtStack const &control) {
+  std::vector<Stmt const *> stmts;
+  std::vector<Stmt const *> ctrls;
+  context.each([&stmts] (Stmt const &s) { stmts.push_back(&s); });  // Innermost first
+  control.each([&ctrls] (Stmt const &s) { ctrls.push_back(&s); });
+
+  if (ctrls.empty() || ctrls[0] != &loop || stmts.size() != ctrls.size()) {
+    assert(false);
+    return false;
+  }
+
+  // stmts[k] is within ctrls[k + 1], ctrls[k] is within stmts[k]
+  Uniformity info;
+  bool masked = false;
+
+  for (int k = (int) stmts.size() - 1; k >= 0; --k) {
+    info.add(*stmts[k], masked);
+
+    if (k > 0) {
+      info.add(*ctrls[k], masked);
+      if (ctrls[k]->tag == WHERE) masked = true;
+    }
+  }
+
+  info.add(*body, masked);
+  info.add(*loop.inc(), masked);
+
+  return info.uniform(ind);
+}
+
+}  // anon namespace
+
+
+/**
+ * Software pipelining of the loads in a `For`-loop.
+ *
+ * Loads of the form `v = *addr` (e.g. `Float a = x[i];`) at the top level of the loop
+ * body are replaced by TMU loads. The loads for the next iteration are issued at the
+ * start of each iteration, so that the memory access overlaps with the computation
+ * of the current iteration:
+ *
+ *     If (cond)                  // Prologue
+ *       gather(addr)
+ *     End
+ *     For (..., cond, inc)
+ *       If (cond[i := inc(i)])   // Prefetch for next iteration
+ *         gather(addr[i := inc(i)])
+ *       End
+ *       ...
+ *       receive(v)               // Replaces `v = *addr`
+ *       ...
+ *     End
+ *
+ * Since the prefetches are guarded by the loop condition, no loads remain outstanding
+ * when the loop exits and no memory beyond the loop range is read.
+ *
+ * The loop is left as is if this can not be done safely. Notably, the addresses and
+ * the loop condition may only depend on the loop variable and on values not changed
+ * in the loop, the loop variable must have the same value for all lanes, the body
+ * may not contain other memory loads, and all loads of two iterations must fit in
+ * the TMU FIFO.
+ *
+ * On `vc4`, this is only done with memory path `VC4_MEM_TMU`, where loads already
+ * go through the TMU. With the DMA path, the kernel stores with DMA, which does not
+ * update the TMU cache. A TMU load could then return stale values, for memory written
+ * earlier in the same kernel or by a previous run.
+ *
+ * This can be disabled with `Platform::pipeline_loads(false)`.
+ *
+ * @param loop     `For`-statement, before conversion to `While`
+ * @param body     body of the loop. Replaced with the pipelined version if the
+ *                 loop can be pipelined
+ * @param context  statements of the kernel up to the loop
+ * @param control  open control statements, with the loop on top
+ *
+ * @return statement to insert before the loop if the loop is pipelined,
+ *         nullptr otherwise
+ */
+Stmt::Ptr pipeline_loads(Stmt const &loop, Stmt::Ptr &body, StmtStack const &context, StmtStack const &control) {
+  assert(loop.tag == FOR);
+
+  auto const &platform = Platform::instance();
+  if (platform.compiling_for_vc4() && platform.vc4_memory_path() != VC4_MEM_TMU) return nullptr;
+
+  LoopAnalysis info(loop, body);
+  if (!info.ok()) return nullptr;
+  if (!uniform_loop_var(info.ind(), loop, body, context, control)) return nullptr;
+
+  CExpr::Ptr cond = loop.loop_cond();
+  CExpr::Ptr next_cond = std::make_shared<CExpr>(cond->tag(), subst(cond->bexpr(), info.ind(), info.next_ind()));
+
+  std::vector<Stmt::Ptr> gathers;
+  std::vector<Stmt::Ptr> next_gathers;
+
+  for (auto const &load : info.loads()) {
+    Expr::Ptr addr = load->assign_rhs()->deref_ptr();
+
+    gathers.push_back(mkGather(addr));
+    next_gathers.push_back(mkGather(subst(addr, info.ind(), info.next_ind())));
+  }
+
+  // Replace the loads with receives
+  std::vector<Stmt::Ptr> stmts;
+  stmts.push_back(Stmt::mkIf(next_cond, sequence(next_gathers), nullptr));
+  stmts.back()->comment("Prefetch loads for next iteration");
+
+  for (auto const &s : info.stmts()) {
+    if (std::find(info.loads().begin(), info.loads().end(), s) == info.loads().end()) {
+      stmts.push_back(s);
+      continue;
+    }
+
+    auto recv = Stmt::create(LOAD_RECEIVE, s->assign_lhs(), nullptr);
+    recv->transfer_comments(*s);
+    stmts.push_back(recv);
+  }
+
+  body = sequence(stmts);
+
+  Stmt::Ptr prologue = Stmt::mkIf(cond, sequence(gathers), nullptr);
+  prologue->comment("Prefetch loads for first iteration");
+  return prologue;
+}
+
+}  // namespace V3DLib
@@ -0,0 +1,11 @@
+#ifndef _V3DLIB_SOURCE_PIPELINE_H_
+#define _V3DLIB_SOURCE_PIPELINE_H_
+#include "StmtStack.h"
+
+namespace V3DLib {
+
+Stmt::Ptr pipeline_loads(Stmt const &loop, Stmt::Ptr &body, StmtStack const &context, StmtStack const &control);
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_SOURCE_PIPELINE_H_
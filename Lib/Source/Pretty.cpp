@@ -136,6 +136,10 @@ std::string pretty(int indent, Stmt::Ptr s) {
       ret << indentBy(indent) << "dmaWriteWait();";
       break;
 
+    case TMU_WRITE_WAIT:
+      ret << indentBy(indent) << "tmuWaitWrite();";
+      break;
+
     case DMA_START_READ:
       ret << indentBy(indent)
           << "dmaStartRead(" << s->address()->pretty() << ");";
@@ -63,7 +63,7 @@ std::string PrintStmt::disp() const {
 void Stmt::init(StmtTag in_tag) {
   clear_comments();  // TODO prob not necessary, check
 
-  assert(SKIP <= in_tag && in_tag <= DMA_START_WRITE);
+  assert(SKIP <= in_tag && in_tag <= TMU_WRITE_WAIT);
   assertq(tag == SKIP, "Stmt::init(): can't reassign tag once assigned");
   tag = in_tag;
 }
@@ -176,6 +176,13 @@ Stmt::Ptr Stmt::body() const {
 }
 
 
+Stmt::Ptr Stmt::inc() const {
+  assertq(tag == FOR, "Inc-statement only valid for FOR", true);
+  assert(m_stmt_b.get() != nullptr);
+  return m_stmt_b;
+}
+
+
 Stmt::Ptr Stmt::elseStmt() const {
   assertq(tag == IF || tag == WHERE, "Else-statement only valid for IF and WHERE", true);
   // where and else stmt may not both be null
@@ -324,6 +331,7 @@ std::string Stmt::disp_intern(bool with_linebreaks, int seq_depth) const {
     case DMA_WRITE_WAIT:   ret << "DMA_WRITE_WAIT";   break;
     case DMA_START_READ:   ret << "DMA_START_READ";   break;
     case DMA_START_WRITE:  ret << "DMA_START_WRITE";  break;
+    case TMU_WRITE_WAIT:   ret << "TMU_WRITE_WAIT";   break;
 
     default:
       assert(false);
@@ -470,7 +478,7 @@ CExpr::Ptr Stmt::if_cond() const {
 
 
 CExpr::Ptr Stmt::loop_cond() const {
-  assert(tag == WHILE);
+  assert(tag == WHILE || tag == FOR);
   assert(m_cond.get() != nullptr);
   return m_cond;
 }
@@ -516,4 +524,30 @@ Stmt::Ptr mkPrint(PrintTag t, Expr::Ptr e) {
   return s;
 }
 
+
+/**
+ * Collect the statements of a sequence, skipping `SKIP` statements
+ */
+void flatten(Stmt::Ptr s, std::vector<Stmt::Ptr> &out) {
+  if (s.get() == nullptr) return;
+
+  if (s->tag == SEQ) {
+    flatten(s->seq_s0(), out);
+    flatten(s->seq_s1(), out);
+  } else if (s->tag != SKIP) {
+    out.push_back(s);
+  }
+}
+
+
+Stmt::Ptr sequence(std::vector<Stmt::Ptr> const &stmts) {
+  Stmt::Ptr ret = mkSkip();
+
+  for (auto const &s : stmts) {
+    ret = Stmt::create_sequence(ret, s);
+  }
+
+  return ret;
+}
+
 }  // namespace V3DLib
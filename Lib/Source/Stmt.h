@@ -1,5 +1,6 @@
 #ifndef _V3DLIB_SOURCE_STMT_H_
 #define _V3DLIB_SOURCE_STMT_H_
+#include <vector>
 #include "Support/InstructionComment.h"
 #include "Int.h"
 #include "Expr.h"
@@ -56,7 +57,8 @@ enum StmtTag {
   DMA_READ_WAIT,
   DMA_WRITE_WAIT,
   DMA_START_READ,
-  DMA_START_WRITE
+  DMA_START_WRITE,
+  TMU_WRITE_WAIT
 };
 
 
@@ -101,6 +103,7 @@ struct Stmt : public InstructionComment {
   Ptr thenStmt() const;
   Ptr elseStmt() const;
   Ptr body() const;
+  Ptr inc() const;
   void thenStmt(Ptr then_ptr);
   void elseStmt(Ptr else_ptr);
   void body(Ptr ptr);
@@ -179,6 +182,10 @@ Stmt::Ptr mkSkip();
 Stmt::Ptr mkWhere(BExpr::Ptr cond, Stmt::Ptr thenStmt, Stmt::Ptr elseStmt);
 Stmt::Ptr mkPrint(PrintTag t, Expr::Ptr e);
 
+// Conversion between sequences and lists of statements
+void flatten(Stmt::Ptr s, std::vector<Stmt::Ptr> &out);
+Stmt::Ptr sequence(std::vector<Stmt::Ptr> const &stmts);
+
 }  // namespace V3DLib
 
 #endif  // _V3DLIB_SOURCE_STMT_H_
@@ -10,6 +10,8 @@ namespace V3DLib {
  */
 class StmtStack : public Stack<Stmt> {
 public:
+  using Stack<Stmt>::each;
+
   void append(Stmt::Ptr stmt);
 
   StmtStack &operator<<(Stmt::Ptr stmt) {
@@ -29,7 +29,7 @@ RegOrImm operand(Expr::Ptr e) {
   assert(enc >= 0);
   x.tag          = IMM;
   x.smallImm.tag = SMALL_IMM;
-  x.smallImm.val = enc;
+  x.smallImm.val = (int16_t) enc;
   return x;
 }
 
@@ -388,6 +388,41 @@ BranchCond condExp(Seq<Instr> &seq, CExpr &c) {
 // Where statements
 // ============================================================================
 
+/**
+ * Minimum number of instructions in the body of a `Where` for which a skip
+ * branch is added.
+ *
+ * The branch costs itself and three delay slots when not taken; for smaller
+ * bodies, this is more than executing the body with all elements disabled.
+ */
+int const WHERE_SKIP_THRESHOLD = 8;
+
+
+/**
+ * Add a branch over the body of a `Where` if no vector element satisfies the condition.
+ *
+ * This is only done for bodies long enough to make this worthwhile.
+ *
+ * @param body  instructions of the body of a `Where`
+ * @param cond  condition of the body, for which the flags have just been set
+ */
+Seq<Instr> skip_if_none(Seq<Instr> const &body, AssignCond cond) {
+  using namespace V3DLib::Target::instr;
+
+  if (body.size() < WHERE_SKIP_THRESHOLD) return body;
+
+  Label skipLabel = freshLabel();
+  Seq<Instr> ret;
+
+  ret << branch(cond.to_branch_cond(false).negate(), skipLabel);
+  ret.back().comment("Skip where-body if no element selected");
+  ret << body
+      << label(skipLabel);
+
+  return ret;
+}
+
+
 Seq<Instr> whereStmt(Stmt::Ptr s, Var condVar, AssignCond cond, bool saveRestore) {
   using namespace V3DLib::Target::instr;
   Seq<Instr> ret;
@@ -448,7 +483,7 @@ Seq<Instr> whereStmt(Stmt::Ptr s, Var condVar, AssignCond cond, bool saveRestore
       if (s->thenStmt().get() != nullptr) {
         auto seq = whereStmt(s->thenStmt(), newCondVar, andCond, s->elseStmt().get() != nullptr);
         if (!seq.empty()) seq.front().comment("then-branch of where (always)");
-        ret << seq;
+        ret << skip_if_none(seq, andCond);
       }
 
       // Compile 'else' statement
@@ -458,7 +493,7 @@ Seq<Instr> whereStmt(Stmt::Ptr s, Var condVar, AssignCond cond, bool saveRestore
 
         auto seq = whereStmt(s->elseStmt(), v2, andCond, false);
         if (!seq.empty()) seq.front().comment("else-branch of where (always)");
-        ret << seq;
+        ret << skip_if_none(seq, andCond);
       }
 
       // Reset flags to initial value
@@ -488,7 +523,7 @@ Seq<Instr> whereStmt(Stmt::Ptr s, Var condVar, AssignCond cond, bool saveRestore
         {
           auto seq = whereStmt(s->thenStmt(), dummy, andCond, false);
           if (!seq.empty()) seq.front().comment("then-branch of where (nested)");
-          ret << seq;
+          ret << skip_if_none(seq, andCond);
         }
       }
 
@@ -502,7 +537,7 @@ Seq<Instr> whereStmt(Stmt::Ptr s, Var condVar, AssignCond cond, bool saveRestore
         {
           auto seq = whereStmt(s->elseStmt(), dummy, andCond, false);
           if (!seq.empty()) seq.front().comment("else-branch of where (nested)");
-          ret << seq;
+          ret << skip_if_none(seq, andCond);
         }
       }
 
@@ -548,7 +583,7 @@ Seq<Instr> printStmt(Stmt::Ptr stmt) {
       break;
     case PRINT_STR:
       instr.tag = PRS;
-      instr.PRS = stmt->print.str();
+      instr.PRS(stmt->print.str());
     break;
     default:
       assert(false);
@@ -696,7 +731,7 @@ void insertInitBlock(Seq<Instr> &code) {
 
   if (Platform::instance().compiling_for_vc4()) {
     // Add final dummy uniform handling
-    // See Note 1, function `invoke()` in `vc4/Invoke.cpp`.
+    // See Note 1, `Launch::invoke()` in `vc4/Invoke.cpp`.
     ret << mov(freshVar(), Var(UNIFORM));
     ret.back().comment("Last uniform load is dummy value");
   }
@@ -838,7 +873,7 @@ void loadStorePass(Seq<Instr> &instrs) {
   Seq<Instr> newInstrs(instrs.size()*2);
 
   for (int i = 0; i < instrs.size(); i++) {
-    Instr instr = instrs[i];
+    Instr const &instr = instrs[i];
 
     switch (instr.tag) {
       case RECV: {
@@ -0,0 +1,134 @@
+#include "Uniformity.h"
+#include "Support/debug.h"
+
+namespace V3DLib {
+
+/**
+ * Register the assignments in the given statement.
+ *
+ * @param masked  true if the statement is within a `Where`-block
+ */
+void Uniformity::add(Stmt const &s, bool masked) {
+  m_solved = false;
+
+  switch (s.tag) {
+    case ASSIGN: {
+      Expr::Ptr lhs = s.assign_lhs();
+      if (lhs->tag() != Expr::VAR || lhs->var().tag() != STANDARD) break;  // Store or special register
+
+      m_assigns.push_back({lhs->var().id(), masked ? nullptr : s.assign_rhs()});
+      break;
+    }
+    case LOAD_RECEIVE: {
+      Expr::Ptr dest = const_cast<Stmt &>(s).address();
+      if (dest->tag() == Expr::VAR) {
+        m_assigns.push_back({dest->var().id(), nullptr});
+      }
+      break;
+    }
+    case SEQ:
+      add(s.seq_s0(), masked);
+      add(s.seq_s1(), masked);
+      break;
+    case IF:
+    case WHERE:
+      if (s.tag == WHERE) masked = true;
+      if (!s.then_is_null()) add(s.thenStmt(), masked);
+      if (!s.else_is_null()) add(s.elseStmt(), masked);
+      break;
+    case WHILE:
+      if (!s.body_is_null()) add(s.body(), masked);
+      break;
+    case FOR:  // Only open loops, closed loops have been converted to `While`
+      if (!s.body_is_null()) add(s.body(), masked);
+      add(s.inc(), masked);
+      break;
+    default:
+      break;
+  }
+}
+
+
+bool Uniformity::uniform(Var v) const {
+  solve();
+  return v.tag() == STANDARD && m_varying.count(v.id()) == 0;
+}
+
+
+bool Uniformity::uniform(Expr::Ptr e) const {
+  solve();
+  return uniform_rhs(e);
+}
+
+
+bool Uniformity::uniform(BExpr::Ptr b) const {
+  switch (b->tag()) {
+    case NOT: return uniform(b->neg());
+    case AND:
+    case OR:  return uniform(b->lhs()) && uniform(b->rhs());
+    case CMP: return uniform(b->cmp_lhs()) && uniform(b->cmp_rhs());
+  }
+
+  assert(false);
+  return false;
+}
+
+
+/**
+ * Check if an expression is uniform, given the current set of non-uniform variables
+ */
+bool Uniformity::uniform_rhs(Expr::Ptr e) const {
+  if (e.get() == nullptr) return true;
+
+  switch (e->tag()) {
+    case Expr::INT_LIT:
+    case Expr::FLOAT_LIT:
+      return true;
+    case Expr::VAR:
+      switch (e->var().tag()) {
+        case STANDARD: return m_varying.count(e->var().id()) == 0;
+        case UNIFORM:  return !e->var().isUniformPtr();  // Pointers are adjusted per lane
+        case QPU_NUM:  return true;
+        default:       return false;
+      }
+    case Expr::APPLY:
+      if (e->apply_op.op == EIDX) return false;
+      return uniform_rhs(e->lhs()) && uniform_rhs(e->rhs());
+    case Expr::DEREF:
+      return false;
+  }
+
+  assert(false);
+  return false;
+}
+
+
+/**
+ * Determine the non-uniform variables.
+ *
+ * Variables are assumed uniform until an assignment shows otherwise,
+ * this is repeated until nothing changes.
+ */
+void Uniformity::solve() const {
+  if (m_solved) return;
+
+  m_varying.clear();
+  bool changed = true;
+
+  while (changed) {
+    changed = false;
+
+    for (auto const &a : m_assigns) {
+      if (m_varying.count(a.var)) continue;
+
+      if (a.rhs.get() == nullptr || !uniform_rhs(a.rhs)) {
+        m_varying.insert(a.var);
+        changed = true;
+      }
+    }
+  }
+
+  m_solved = true;
+}
+
+}  // namespace V3DLib
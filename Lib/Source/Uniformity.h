@@ -0,0 +1,51 @@
+#ifndef _V3DLIB_SOURCE_UNIFORMITY_H_
+#define _V3DLIB_SOURCE_UNIFORMITY_H_
+#include <set>
+#include <vector>
+#include "Stmt.h"
+
+namespace V3DLib {
+
+/**
+ * Determines which variables and expressions have the same value for all lanes.
+ *
+ * A variable is uniform if it is assigned only outside of `Where`-blocks, and only
+ * with uniform values. These are values derived from literals, uniforms (e.g. kernel
+ * parameters), `me()` and other uniform variables.
+ *
+ * Values derived from `index()` or from memory are not uniform. Neither are pointer
+ * parameters, because these are adjusted per lane.
+ *
+ * Used for:
+ * - `If (any(c))`, which is only equivalent to `Where (c)` if `c` is uniform
+ * - loop variables, for which consecutive iterations only access disjoint vectors
+ *   if they are uniform
+ */
+class Uniformity {
+public:
+  Uniformity() = default;
+  Uniformity(Stmt const &s) { add(s, false); }
+
+  void add(Stmt const &s, bool masked);
+  bool uniform(Var v) const;
+  bool uniform(Expr::Ptr e) const;
+  bool uniform(BExpr::Ptr b) const;
+
+private:
+  struct Assign {
+    VarId     var;
+    Expr::Ptr rhs;     // nullptr if the assigned value is not uniform anyway
+  };
+
+  std::vector<Assign>     m_assigns;
+  mutable std::set<VarId> m_varying;
+  mutable bool            m_solved = false;
+
+  void add(Stmt::Ptr s, bool masked) { if (s.get() != nullptr) add(*s, masked); }
+  bool uniform_rhs(Expr::Ptr e) const;
+  void solve() const;
+};
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_SOURCE_UNIFORMITY_H_
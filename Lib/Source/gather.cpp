@@ -24,4 +24,14 @@ void store(FloatExpr data, PtrExpr<Float> addr) { storeExpr(data.expr(), addr.ex
 void store(IntExpr data, Ptr<Int> &addr)        { storeExpr(data.expr(), addr.expr()); }
 void store(FloatExpr data, Ptr<Float> &addr)    { storeExpr(data.expr(), addr.expr()); }
 
+
+/**
+ * Wait until all outstanding TMU writes of the current QPU have completed.
+ *
+ * Only has effect on v3d; on vc4, stores are done via VPM and DMA, see `dmaWaitWrite()`.
+ */
+void tmuWaitWrite() {
+  stmtStack() << Stmt::create(TMU_WRITE_WAIT);
+}
+
 }  // namespace V3DLib
@@ -46,6 +46,7 @@ void store(IntExpr data, PtrExpr<Int> addr);
 void store(FloatExpr data, PtrExpr<Float> addr);
 void store(IntExpr data, Ptr<Int> &addr);
 void store(FloatExpr data, Ptr<Float> &addr);
+void tmuWaitWrite();
 
 }  // namespace V3DLib
 
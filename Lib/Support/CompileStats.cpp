@@ -0,0 +1,165 @@
+#include "CompileStats.h"
+#include <malloc.h>           // mallinfo()
+#include "Support/basics.h"   // operator<<
+
+namespace V3DLib {
+namespace {
+
+/**
+ * Get the amount of heap memory currently in use by the application.
+ *
+ * This is used to determine the memory usage of a compile pass.
+ * The number of allocations is not available without replacing the global
+ * `operator new`, which a library should not do; the net change in
+ * memory in use is a reasonable substitute.
+ */
+long heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return (long) (info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+  struct mallinfo info = mallinfo();
+  return (long) info.uordblks + (long) info.hblkhd;
+#else
+  return 0;  // Not available
+#endif
+}
+
+
+std::string json_int(int val) {
+  if (val < 0) return "null";
+  return std::to_string(val);
+}
+
+
+std::string json_double(double val) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.3f", val);
+  return buf;
+}
+
+
+std::string json_escape(std::string const &str) {
+  std::string ret;
+
+  for (char c : str) {
+    if (c == '"' || c == '\\') ret += '\\';
+    ret += c;
+  }
+
+  return ret;
+}
+
+}  // anon namespace
+
+
+void CompileStats::start(char const *name, int instrs_before) {
+  assertq(!m_running, "CompileStats::start(): previous pass not stopped", true);
+  assert(name != nullptr);
+
+  Pass pass;
+  pass.name          = name;
+  pass.instrs_before = instrs_before;
+  m_passes.push_back(pass);
+
+  m_running    = true;
+  m_start_heap = heap_in_use();
+  m_start_time = Clock::now();
+}
+
+
+void CompileStats::stop(int instrs_after) {
+  auto end_time = Clock::now();
+  assertq(m_running, "CompileStats::stop(): no pass started", true);
+
+  auto &pass = m_passes.back();
+  pass.time_ms      = std::chrono::duration<double, std::milli>(end_time - m_start_time).count();
+  pass.instrs_after = instrs_after;
+  pass.heap_delta   = heap_in_use() - m_start_heap;
+
+  m_running = false;
+}
+
+
+/**
+ * Add a note to the last started pass
+ */
+void CompileStats::note(std::string const &msg) {
+  assertq(!m_passes.empty(), "CompileStats::note(): no pass started", true);
+  m_passes.back().notes.push_back(msg);
+}
+
+
+/**
+ * Remove all passes.
+ *
+ * A pass which is still running is dropped as well; this can happen if a
+ * compile was aborted with an exception.
+ */
+void CompileStats::clear() {
+  m_passes.clear();
+  m_running = false;
+}
+
+
+double CompileStats::total_time_ms() const {
+  double ret = 0;
+
+  for (auto const &pass : m_passes) {
+    ret += pass.time_ms;
+  }
+
+  return ret;
+}
+
+
+/**
+ * Output the statistics in JSON format.
+ *
+ * Intended for tracking compile performance over releases.
+ *
+ * @param platform  if specified, added as field 'platform' to the output
+ */
+std::string CompileStats::to_json(char const *platform) const {
+  std::string ret;
+
+  ret << "{\n";
+
+  if (platform != nullptr) {
+    ret << "  \"platform\": \"" << platform << "\",\n";
+  }
+
+  ret << "  \"total_time_ms\": " << json_double(total_time_ms()) << ",\n"
+      << "  \"passes\": [";
+
+  for (int i = 0; i < (int) m_passes.size(); ++i) {
+    auto const &pass = m_passes[i];
+
+    ret << ((i == 0)? "\n" : ",\n")
+        << "    {"
+        << "\"name\": \"" << pass.name << "\", "
+        << "\"time_ms\": " << json_double(pass.time_ms) << ", "
+        << "\"instrs_before\": " << json_int(pass.instrs_before) << ", "
+        << "\"instrs_after\": " << json_int(pass.instrs_after) << ", "
+        << "\"heap_delta\": " << std::to_string(pass.heap_delta);
+
+    if (!pass.notes.empty()) {
+      ret << ", \"notes\": [";
+
+      for (int j = 0; j < (int) pass.notes.size(); ++j) {
+        ret << ((j == 0)? "" : ", ") << "\"" << json_escape(pass.notes[j]) << "\"";
+      }
+
+      ret << "]";
+    }
+
+    ret << "}";
+  }
+
+  ret << "\n  ]\n"
+      << "}\n";
+
+  return ret;
+}
+
+}  // namespace V3DLib
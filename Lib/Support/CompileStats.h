@@ -0,0 +1,69 @@
+#ifndef _V3DLIB_SUPPORT_COMPILESTATS_H_
+#define _V3DLIB_SUPPORT_COMPILESTATS_H_
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace V3DLib {
+
+/**
+ * Collects statistics per pass during the compilation and encoding of a kernel.
+ *
+ * Usage:
+ *
+ *   stats.start("loadStorePass", code.size());
+ *   loadStorePass(code);
+ *   stats.stop(code.size());
+ *
+ * or, equivalently:
+ *
+ *   stats.measure("loadStorePass", code, [&code] { loadStorePass(code); });
+ *
+ * The instruction counts are optional; for passes where they don't apply
+ * (e.g. building the AST), they are left out.
+ *
+ * Passes can add notes on what they did with `note()`, e.g. which statements were changed.
+ */
+class CompileStats {
+public:
+  struct Pass {
+    std::string name;
+    double time_ms    = 0;   // Wall time of the pass
+    int instrs_before = -1;  // Number of instructions before the pass, -1 if not applicable
+    int instrs_after  = -1;  // Number of instructions after the pass, -1 if not applicable
+    long heap_delta   = 0;   // Change in heap memory in use by the application, in bytes
+    std::vector<std::string> notes;
+  };
+
+  void start(char const *name, int instrs_before = -1);
+  void stop(int instrs_after = -1);
+  void note(std::string const &msg);
+  bool running() const { return m_running; }
+  void clear();
+
+  /**
+   * Measure the passed function as a pass which operates on the given code
+   */
+  template<typename Code, typename Func>
+  void measure(char const *name, Code const &code, Func f) {
+    start(name, (int) code.size());
+    f();
+    stop((int) code.size());
+  }
+
+  std::vector<Pass> const &passes() const { return m_passes; }
+  double total_time_ms() const;
+  std::string to_json(char const *platform = nullptr) const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<Pass> m_passes;
+  bool              m_running = false;
+  Clock::time_point m_start_time;
+  long              m_start_heap = 0;
+};
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_SUPPORT_COMPILESTATS_H_
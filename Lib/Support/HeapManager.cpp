@@ -1,35 +1,70 @@
 #include "HeapManager.h"
-#include "Support/basics.h"  // fatal()
+#include <algorithm>         // std::max()
+#include <iterator>          // std::prev()
+#include "Support/basics.h"
 
-namespace  {
+namespace V3DLib {
 
-int const INITIAL_FREE_RANGE_SIZE = 32;
+///////////////////////////////////////////////////////////////////////////////
+// Class HeapStats
+///////////////////////////////////////////////////////////////////////////////
 
-}  // anon namespace
+/**
+ * @return index into `histogram` for the given size
+ */
+int HeapStats::bucket(uint32_t size_in_bytes) {
+  assert(size_in_bytes > 0);
 
+  int ret = 0;
+  while (size_in_bytes > 1) {
+    size_in_bytes >>= 1;
+    ++ret;
+  }
 
-namespace V3DLib {
+  return ret;
+}
 
-unsigned HeapManager::FreeRange::size() const {
-  int ret = (int) right - (int) left + 1;
-  assert(ret >= 0);  // empty range will have left + 1 == right
 
-  return (unsigned) ret;
+/**
+ * Fraction of the free memory which is not available for the largest possible allocation.
+ *
+ * @return value in range [0, 1], 0 if all free memory is in one block
+ */
+float HeapStats::fragmentation() const {
+  if (free == 0) return 0.0f;
+  return 1.0f - ((float) largest_free)/((float) free);
 }
 
 
-std::string HeapManager::FreeRange::dump() const {
+std::string HeapStats::dump() const {
   std::string ret;
-  ret << "[" << left << ", " << right << "]";
-  return ret;
-}
 
+  ret << "Heap statistics:\n"
+      << "  size           : " << size << "\n"
+      << "  used           : " << used << " (peak " << peak << ")\n"
+      << "  allocations    : " << num_allocs << " (live " << num_live << ")\n"
+      << "  free           : " << free << "\n"
+      << "  largest free   : " << largest_free << "\n"
+      << "  free ranges    : " << num_free_ranges << "\n"
+      << "  fragmentation  : " << fragmentation() << "\n"
+      << "  size histogram :\n";
+
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    if (histogram[i] == 0) continue;
+
+    uint64_t upper = ((uint64_t) 1) << (i + 1);
+    ret << "    [" << (uint32_t) (1u << i) << ", " << std::to_string(upper) << "): "
+        << histogram[i] << "\n";
+  }
 
-HeapManager::HeapManager() {
-  m_free_ranges.reserve(INITIAL_FREE_RANGE_SIZE);
+  return ret;
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Class HeapManager
+///////////////////////////////////////////////////////////////////////////////
+
 void HeapManager::set_size(uint32_t val) {
   assert(val > 0);
   assert(m_size == 0);  // Only allow initial size setting for now
@@ -37,58 +72,78 @@ void HeapManager::set_size(uint32_t val) {
 }
 
 
-bool HeapManager::check_available(uint32_t n) {
+bool HeapManager::check_available(uint32_t n) const {
   assert(n > 0);
-
-  if (m_offset + n >= m_size) {
-    fatal("V3DLib: heap overflow (increase heap size)");  // NOTE: doesn't return
-    return false;
-  }
-
-  return true;
+  return (m_offset + n < m_size);
 }
 
 
 void HeapManager::clear() {
   m_size = 0;
   m_offset = 0;
-  m_free_ranges.clear();
+  m_free_by_addr.clear();
+  m_free_by_size.clear();
+
+  m_used       = 0;
+  m_peak       = 0;
+  m_num_allocs = 0;
+  m_num_live   = 0;
+  std::fill(m_histogram.begin(), m_histogram.end(), 0);
 }
 
 
 bool HeapManager::is_cleared() const {
   if  (m_size == 0) {
     assert(m_offset == 0);
-    assert(m_free_ranges.empty());
+    assert(m_free_by_addr.empty());
+    assert(m_free_by_size.empty());
   }
 
   return (m_size == 0);
 }
 
 
+std::string HeapManager::dump_range(uint32_t left, uint32_t size) const {
+  std::string ret;
+  ret << "[" << left << ", " << (left + size - 1) << "]";
+  return ret;
+}
+
+
+void HeapManager::add_free_range(uint32_t left, uint32_t size) {
+  assert(size > 0);
+  m_free_by_addr[left] = size;
+  m_free_by_size.insert({size, left});
+}
+
+
+void HeapManager::remove_free_range(uint32_t left, uint32_t size) {
+  auto count_addr = m_free_by_addr.erase(left);
+  auto count_size = m_free_by_size.erase({size, left});
+  assert(count_addr == 1 && count_size == 1);
+  (void) count_addr;
+  (void) count_size;
+}
+
+
 /**
+ * Allocate from the smallest free range which is large enough (best fit).
+ *
+ * If there is no such range, allocate from the top of the used space.
+ *
  * @param size_in_bytes number of bytes to allocate
  *
- * @return Start offset into heap if allocated, -1 if could not allocate.
+ * @return Start offset into heap if allocated, -1 if there is not enough space.
  */
 int HeapManager::alloc_array(uint32_t size_in_bytes) {
   assert(m_size > 0);
   assert(size_in_bytes > 0);
   assert(size_in_bytes % 4 == 0);
+  std::lock_guard<std::mutex> guard(m_mutex);
 
-  // Find the first available space that is large enough
-  int found_index = -1;
-  for (int i = 0; i < (int) m_free_ranges.size(); ++i) {
-    auto &cur = m_free_ranges[i];
+  auto it = m_free_by_size.lower_bound({size_in_bytes, 0});
 
-    if (size_in_bytes <= cur.size()) {
-      found_index = i;
-      break;
-    }
-  }
-
-
-  if (found_index == -1) {
+  if (it == m_free_by_size.end()) {
     // Didn't find a freed location, reserve from the end
     if (!check_available(size_in_bytes)) {
       return -1;
@@ -96,20 +151,30 @@ int HeapManager::alloc_array(uint32_t size_in_bytes) {
 
     uint32_t prev_offset = m_offset;
     m_offset += size_in_bytes;
+    count_alloc(size_in_bytes);
     return (int) prev_offset;
   }
 
-  int ret = -1;
+  uint32_t range_size = it->first;
+  uint32_t left       = it->second;
+
+  remove_free_range(left, range_size);
 
-  auto &cur = m_free_ranges[found_index];
-  ret = cur.left;
-  cur.left += size_in_bytes;
-  if (cur.empty()) {
-    // remove from list
-    m_free_ranges.erase(m_free_ranges.begin() + found_index);
+  if (range_size > size_in_bytes) {
+    add_free_range(left + size_in_bytes, range_size - size_in_bytes);
   }
 
-  return ret;
+  count_alloc(size_in_bytes);
+  return (int) left;
+}
+
+
+void HeapManager::count_alloc(uint32_t size_in_bytes) {
+  m_used += size_in_bytes;
+  m_peak  = std::max(m_peak, m_used);
+  m_num_allocs++;
+  m_num_live++;
+  m_histogram[HeapStats::bucket(size_in_bytes)]++;
 }
 
 
@@ -119,105 +184,110 @@ int HeapManager::alloc_array(uint32_t size_in_bytes) {
  * This should be called from deallocating SharedArray instances, which allocated
  * from this BO.
  *
- * The goal is to detect if the entire BO is free of use. When that's the case, the
- * allocated size can be reset and the BO can be reused from scratch.
- *
- * Better would be to reuse empty spaces if possible; I'm pushing this ahead of me for now.
- * TODO Examine this
+ * The range is merged with adjacent free ranges. If it is at the top of the used
+ * space, the used space shrinks instead. Hence, when everything is deallocated,
+ * there are no free ranges and the BO can be reused from scratch.
  *
  * @param index  index of memory range to deallocate
  * @param size   number of bytes to deallocate
  */
 void HeapManager::dealloc_array(uint32_t index, uint32_t size) {
+  assert(m_size > 0);
   assert(size > 0);
   assert((index + size - 1) < m_size);
+  std::lock_guard<std::mutex> guard(m_mutex);
 
-  dealloc_array(FreeRange(index, index + size -1));
-}
-
-
-void HeapManager::dealloc_array(FreeRange const in_range) {
-  assert(m_size > 0);
+  uint32_t left = index;
+  auto next = m_free_by_addr.lower_bound(left);
 
 #ifdef DEBUG
-  // Check if incoming range is already deallocated
-  for (int i = 0; i < (int) m_free_ranges.size(); ++i) {
-    auto &cur = m_free_ranges[i];
+  {
+    // Check if incoming range is already deallocated
+    std::string msg;
 
-    if (!cur.overlaps(in_range)) continue;
+    if (left + size > m_offset) {
+      msg << "range to deallocate " << dump_range(left, size) << " "
+          << "extends beyond used space";
+    } else if (next != m_free_by_addr.end() && next->first < left + size) {
+      msg << "range to deallocate " << dump_range(left, size) << " "
+          << "overlaps with free range " << dump_range(next->first, next->second);
+    } else if (next != m_free_by_addr.begin()) {
+      auto prev = std::prev(next);
+
+      if (prev->first + prev->second > left) {
+        msg << "range to deallocate " << dump_range(left, size) << " "
+            << "overlaps with free range " << dump_range(prev->first, prev->second);
+      }
+    }
 
-    std::string msg;
-    msg << "HeapManager::dealloc_array(): "
-        << "range to deallocate " << in_range.dump() << " "
-        << "overlaps with free range " << cur.dump();
-    assertq(msg, true);
+    if (!msg.empty()) {
+      std::string prefix = "HeapManager::dealloc_array(): ";
+      assertq(prefix + msg, true);
+    }
   }
 #endif
 
-  // Find adjacent matches in current free range list
-  int left_match_index  = -1;
-  int right_match_index = -1;
+  assert(m_num_live > 0 && m_used >= size);
+  m_used -= size;
+  m_num_live--;
 
-  for (int i = 0; i < (int) m_free_ranges.size(); ++i) {
-    auto &cur = m_free_ranges[i];
+  // Merge with adjacent free ranges
+  if (next != m_free_by_addr.end() && next->first == left + size) {
+    uint32_t next_size = next->second;
+    remove_free_range(next->first, next_size);
+    size += next_size;
+  }
 
-    if (in_range.right + 1 == cur.left) {
-      assert(right_match_index == -1);  // Expecting at most one match
-      right_match_index = i;
-    }
+  next = m_free_by_addr.lower_bound(left);
+  if (next != m_free_by_addr.begin()) {
+    auto prev = std::prev(next);
 
-    if (in_range.left == cur.right + 1) {
-      assert(left_match_index == -1); // At most one match
-      left_match_index = i;
+    if (prev->first + prev->second == left) {
+      uint32_t prev_left = prev->first;
+      uint32_t prev_size = prev->second;
+      remove_free_range(prev_left, prev_size);
+      left  = prev_left;
+      size += prev_size;
     }
   }
 
+  if (left + size == m_offset) {
+    m_offset = left;  // Range is at the top, give it back to the unused space
+  } else {
+    add_free_range(left, size);
+  }
 
-  if (left_match_index != -1) {
-    if (right_match_index != -1) {
-      // Both sides match
-      assert(left_match_index != right_match_index);
+  if (m_offset == 0) {
+    // We're done, the buffer is empty again
+    assert(m_free_by_addr.empty());
+    //debug("BufferObject empty again!");
+  }
+}
 
-      // Merge the three ranges to one
-      m_free_ranges[left_match_index].right = m_free_ranges[right_match_index].right;
 
-      // Move the last range to the one we want to delete
-      auto tmp = m_free_ranges.back();
-      m_free_ranges.pop_back();
-      if (right_match_index != (int) m_free_ranges.size()) {
-        m_free_ranges[right_match_index] = tmp;
-      } else {
-      }
+HeapStats HeapManager::stats() const {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  HeapStats ret;
 
-    } else {
-      // Only left side matches
-      m_free_ranges[left_match_index].right = in_range.right;
-    }
-  } else if (right_match_index != -1) {
-    // Only right side matches
-      m_free_ranges[right_match_index].left = in_range.left;
-  } else {
-    // No match, add given range to list
-    m_free_ranges.push_back(in_range);
+  ret.size            = m_size;
+  ret.used            = m_used;
+  ret.peak            = m_peak;
+  ret.num_allocs      = m_num_allocs;
+  ret.num_live        = m_num_live;
+  ret.free            = m_size - m_offset;
+  ret.largest_free    = m_size - m_offset;
+  ret.num_free_ranges = (uint32_t) m_free_by_addr.size();
+  ret.histogram       = m_histogram;
 
-    assert(m_free_ranges.size() < INITIAL_FREE_RANGE_SIZE);  // Warn me when this ever happens
-                                                             // (possible, currently not likely)
+  for (auto const &it : m_free_by_addr) {
+    ret.free += it.second;
   }
 
-  // When fully deallocated, there should be one single range of the entire used space
-  bool is_empty = false;
-  if (m_free_ranges.size() == 1) {
-    auto &tmp = m_free_ranges.front();
-    is_empty = (tmp.left == 0) && (tmp.right == m_offset - 1);
+  if (!m_free_by_size.empty()) {
+    ret.largest_free = std::max(ret.largest_free, m_free_by_size.rbegin()->first);
   }
 
-  if (is_empty) {
-    // We're done, reset the buffer
-    assert(m_offset > 0);  // paranoia
-    m_offset = 0;          // yes, it's that simple
-    m_free_ranges.clear();
-    //debug("BufferObject empty again!");
-  }
+  return ret;
 }
 
 }  // namespace V3DLib
@@ -1,26 +1,67 @@
 #ifndef _V3DLIB_SUPPORT_HEAPMANAGER_H_
 #define _V3DLIB_SUPPORT_HEAPMANAGER_H_
 #include <stdint.h>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <utility>  // std::pair
 #include <vector>
 
 namespace V3DLib {
 
+/**
+ * Usage statistics of a heap.
+ */
+struct HeapStats {
+  static int const NUM_BUCKETS = 32;
+
+  uint32_t size            = 0;  // Total size in bytes
+  uint32_t used            = 0;  // Bytes currently allocated
+  uint32_t peak            = 0;  // Maximum value of `used`
+  uint32_t num_allocs      = 0;  // Total number of allocations
+  uint32_t num_live        = 0;  // Number of allocations which are not deallocated yet
+  uint32_t free            = 0;  // Bytes available for allocation
+  uint32_t largest_free    = 0;  // Size of the largest free block
+  uint32_t num_free_ranges = 0;  // Number of free ranges left by deallocations
+
+  // Number of allocations per size, entry i counts the sizes in [2^i, 2^(i+1))
+  std::vector<uint32_t> histogram;
+
+  HeapStats() : histogram(NUM_BUCKETS, 0) {}
+
+  static int bucket(uint32_t size_in_bytes);
+  float fragmentation() const;
+  std::string dump() const;
+};
+
+
 /**
  * Memory manager for controlled heap objects.
  *
  * Keeps track of allocated and freed memory, handles space allocation.
+ *
+ * Memory is allocated from the top of the used space, or from the free ranges
+ * left by deallocations. The free ranges are indexed by size and by address,
+ * so that allocation (best fit) and deallocation (merging with adjacent free ranges)
+ * both take O(log n) for n free ranges.
+ *
+ * Allocation and deallocation are thread-safe.
+ *
+ * Usage statistics are kept for sizing the heap, see `stats()`.
  */
 class HeapManager {
 public:
-  HeapManager();
+  HeapManager() {}
   HeapManager(HeapManager *object) = delete;
 
   uint32_t size() const { return m_size; }
   bool empty() const { return m_offset == 0; }
 
   // Intended for unit tests
-  uint32_t num_free_ranges() const { return (uint32_t) m_free_ranges.size(); }
+  uint32_t num_free_ranges() const { return (uint32_t) m_free_by_addr.size(); }
+
+  HeapStats stats() const;
 
 protected:
   int alloc_array(uint32_t size_in_bytes);
@@ -35,27 +76,26 @@ private:
   void operator=(HeapManager& a);
 
   uint32_t m_size   = 0;  // Total allocated size of derived heap/buffer object
-  uint32_t m_offset = 0;
-
-  struct FreeRange {
-    uint32_t left  = 0;
-    uint32_t right = 0;
-
-    FreeRange(uint32_t l, uint32_t r) : left(l), right(r) {}  // required by std::vector
-    unsigned size() const;
-    bool empty() const { return size() == 0; }
+  uint32_t m_offset = 0;  // Start of the unused space at the top of the heap
+  mutable std::mutex m_mutex;  // Guards the allocation administration
 
-    bool overlaps(FreeRange const &rhs) const {
-      return !(rhs.left > right || rhs.right < left);
-    }
+  // Statistics
+  uint32_t m_used       = 0;
+  uint32_t m_peak       = 0;
+  uint32_t m_num_allocs = 0;
+  uint32_t m_num_live   = 0;
+  std::vector<uint32_t> m_histogram = std::vector<uint32_t>(HeapStats::NUM_BUCKETS, 0);
 
-    std::string dump() const;
-  };
+  using SizeIndex = std::set<std::pair<uint32_t, uint32_t>>;
 
-  std::vector<FreeRange> m_free_ranges;
+  std::map<uint32_t, uint32_t> m_free_by_addr;  // Free ranges, start offset -> size
+  SizeIndex                    m_free_by_size;  // Free ranges, (size, start offset)
 
-  bool check_available(uint32_t n);
-  void dealloc_array(FreeRange const in_range);
+  bool check_available(uint32_t n) const;
+  void count_alloc(uint32_t size_in_bytes);
+  void add_free_range(uint32_t left, uint32_t size);
+  void remove_free_range(uint32_t left, uint32_t size);
+  std::string dump_range(uint32_t left, uint32_t size) const;
 };
 
 }  // namespace V3DLib
@@ -1,7 +1,162 @@
 #include "InstructionComment.h"
+#include <deque>
+#include <mutex>
+#include <vector>
 #include "Support/basics.h"
 
 namespace V3DLib {
+namespace {
+
+bool comments_enabled = false;
+std::string const no_comment;
+
+struct Entry {
+  int refs = 0;  // Number of instances using this entry, 0 if free
+  std::string header;
+  std::string comment;
+};
+
+//
+// Side table with the comments.
+//
+// Entry 0 is never used, id 0 means 'no comments'. A deque, so that references
+// to the strings stay valid when entries are added.
+//
+std::mutex            table_mutex;
+std::deque<Entry>     table(1);
+std::vector<uint16_t> free_ids;
+
+
+/**
+ * Get an unused entry. Call with the table locked.
+ *
+ * @return id of the entry, 0 if the table is full
+ */
+uint16_t new_entry() {
+  uint16_t id = 0;
+
+  if (!free_ids.empty()) {
+    id = free_ids.back();
+    free_ids.pop_back();
+  } else if (table.size() <= UINT16_MAX) {
+    id = (uint16_t) table.size();
+    table.emplace_back();
+  } else {
+    static bool warned = false;
+    if (!warned) {
+      warning("InstructionComment: comment table full, further comments are dropped");
+      warned = true;
+    }
+    return 0;
+  }
+
+  table[id].refs = 1;
+  return id;
+}
+
+}  // anon namespace
+
+
+/**
+ * Enable or disable the collection of comments.
+ *
+ * Collected comments are kept for the lifetime of the instructions,
+ * so only enable this if the comments are actually going to be displayed.
+ */
+void InstructionComment::enable(bool val) {
+  comments_enabled = val;
+}
+
+
+bool InstructionComment::enabled() {
+  return comments_enabled;
+}
+
+
+InstructionComment::InstructionComment(InstructionComment const &rhs) {
+  if (rhs.m_id == 0) return;
+
+  std::lock_guard<std::mutex> lock(table_mutex);
+  table[rhs.m_id].refs++;
+  m_id = rhs.m_id;
+}
+
+
+InstructionComment &InstructionComment::operator=(InstructionComment const &rhs) {
+  if (m_id == rhs.m_id) return *this;
+
+  if (m_id != 0) release();
+
+  if (rhs.m_id != 0) {
+    std::lock_guard<std::mutex> lock(table_mutex);
+    table[rhs.m_id].refs++;
+    m_id = rhs.m_id;
+  }
+
+  return *this;
+}
+
+
+/**
+ * Stop using the current entry, and free it if no other instance uses it
+ */
+void InstructionComment::release() {
+  std::lock_guard<std::mutex> lock(table_mutex);
+  assert(m_id != 0);
+
+  auto &entry = table[m_id];
+  assert(entry.refs > 0);
+
+  if (--entry.refs == 0) {
+    entry.header.clear();
+    entry.comment.clear();
+    free_ids.push_back(m_id);
+  }
+
+  m_id = 0;
+}
+
+
+/**
+ * Make sure this instance has an entry of its own, which it can change.
+ *
+ * @return true if successful, false if the table is full
+ */
+bool InstructionComment::own_entry() {
+  std::lock_guard<std::mutex> lock(table_mutex);
+
+  if (m_id != 0 && table[m_id].refs == 1) return true;
+
+  uint16_t id = new_entry();
+  if (id == 0) return false;
+
+  if (m_id != 0) {
+    // Copy on write
+    table[id].header  = table[m_id].header;
+    table[id].comment = table[m_id].comment;
+    table[m_id].refs--;
+  }
+
+  m_id = id;
+  return true;
+}
+
+
+std::string const &InstructionComment::header() const {
+  if (m_id == 0) return no_comment;
+
+  std::lock_guard<std::mutex> lock(table_mutex);
+  return table[m_id].header;
+}
+
+
+std::string const &InstructionComment::comment() const {
+  if (m_id == 0) return no_comment;
+
+  std::lock_guard<std::mutex> lock(table_mutex);
+  return table[m_id].comment;
+}
+
 
 void InstructionComment::transfer_comments(InstructionComment const &rhs) {
   if (!rhs.header().empty()) {
@@ -14,21 +169,21 @@ void InstructionComment::transfer_comments(InstructionComment const &rhs) {
 }
 
 
-void InstructionComment::clear_comments() {
-  m_header.clear();
-  m_comment.clear();
-}
-
-
 /**
  * Assign header comment to current instance
  *
  * For display purposes only, when generating a dump of the opcodes.
  */
 void InstructionComment::header(std::string const &msg) {
-  assertq(m_header.empty(), "Header comment already has a value when setting it", true);
-  m_header = msg;
-  findAndReplaceAll(m_header, "\n", "\n# ");
+  if (!enabled()) return;
+  assertq(header().empty(), "Header comment already has a value when setting it", true);
+
+  std::string str = msg;
+  findAndReplaceAll(str, "\n", "\n# ");
+
+  if (!own_entry()) return;
+  std::lock_guard<std::mutex> lock(table_mutex);
+  table[m_id].header = str;
 }
 
 
@@ -40,20 +195,24 @@ void InstructionComment::header(std::string const &msg) {
  * For display purposes only, when generating a dump of the opcodes.
  */
 void InstructionComment::comment(std::string msg) {
-  if (msg.empty()) return;
+  if (!enabled() || msg.empty()) return;
 
   findAndReplaceAll(msg, "\n", "\n# ");
 
-  if (!m_comment.empty()) {
-    m_comment += "; ";
+  if (!own_entry()) return;
+  std::lock_guard<std::mutex> lock(table_mutex);
+  auto &entry = table[m_id];
+
+  if (!entry.comment.empty()) {
+    entry.comment += "; ";
   }
 
-  m_comment += msg;
+  entry.comment += msg;
 }
 
 
 std::string InstructionComment::emit_header() const {
-  if (m_header.empty()) return "";
+  if (header().empty()) return "";
 
   std::string ret;
   ret << "\n# " << header() << "\n";
@@ -67,7 +226,7 @@ std::string InstructionComment::emit_header() const {
  * @param instr_size  size of the associated instruction in bytes
  */
 std::string InstructionComment::emit_comment(int instr_size) const {
-  if (m_comment.empty()) return "";
+  if (comment().empty()) return "";
 
   const int COMMENT_INDENT = 57;
   int spaces = COMMENT_INDENT - instr_size;
@@ -87,7 +246,7 @@ std::string InstructionComment::emit_comment(int instr_size) const {
   };
 
   std::string ret;
-  ret << emit_spaces(spaces) << "# " << m_comment;
+  ret << emit_spaces(spaces) << "# " << comment();
   return ret;
 }
 
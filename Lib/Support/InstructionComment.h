@@ -1,27 +1,49 @@
 #ifndef _LIB_COMMON_INSTRUCTIONCOMMENT_H
 #define _LIB_COMMON_INSTRUCTIONCOMMENT_H
+#include <stdint.h>
 #include <string>
 
 namespace V3DLib {
 
 /**
  * Mixin for instruction comments
+ *
+ * The comments are stored out of line, in a side table. An instance only holds
+ * the index of its entry in the table, 0 if it has no comments, so that
+ * instructions stay small and cheap to copy.
+ *
+ * Copies of an instance share the entry; it is copied when one of them changes
+ * its comments. An entry is released when the last instance using it is destroyed.
+ *
+ * Comments are for display only. They are only collected when enabled, which should
+ * be done when pretty output is requested. Otherwise, setting comments is a no-op.
  */
 class InstructionComment {
 public:
+  InstructionComment() = default;
+  InstructionComment(InstructionComment const &rhs);
+  ~InstructionComment() { if (m_id != 0) release(); }
+
+  InstructionComment &operator=(InstructionComment const &rhs);
+
+  static void enable(bool val = true);
+  static bool enabled();
+
   void transfer_comments(InstructionComment const &rhs);
-  void clear_comments();
+  void clear_comments() { if (m_id != 0) release(); }
   void header(std::string const &msg);
   void comment(std::string msg);
-  std::string const &header() const { return m_header; }
-  std::string const &comment() const { return m_comment; }
+  std::string const &header() const;
+  std::string const &comment() const;
 
   std::string emit_header() const;
   std::string emit_comment(int instr_size) const;
 
 private:
-  std::string m_header;
-  std::string m_comment;
+  uint16_t m_id = 0;  // Index of the comments in the side table, 0 if none
+
+  void release();
+  bool own_entry();
 };
 
 }  // namespace V3DLib
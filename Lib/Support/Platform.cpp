@@ -1,6 +1,7 @@
 #include "Platform.h"
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <string.h>  // strstr()
 #include "basics.h"
 
@@ -111,6 +112,7 @@ bool get_chip_version(std::string &output) {
 // Defined like this to delay the creation of the instance after program init,
 // So that other globals get the chance to use it on program init.
 std::unique_ptr<PlatformInfo> local_instance;
+std::once_flag local_instance_init;
 
 }  // anon namespace
 
@@ -157,9 +159,9 @@ void PlatformInfo::output() {
 
 
 PlatformInfo &Platform::instance_local() {
-  if (!local_instance) {
+  std::call_once(local_instance_init, [] () {
     local_instance.reset(new PlatformInfo);
-  }
+  });
 
   return *local_instance;
 }
@@ -194,6 +196,48 @@ void Platform::compiling_for_vc4(bool val) {
 }
 
 
+/**
+ * Sets the number of threads per QPU to compile v3d kernels for.
+ *
+ * Allowed values:
+ *
+ * - 1 - default, one kernel instance per QPU. Thread switches are only done in
+ *       the init and end sequences.
+ * - 2, 4 - multiple kernel instances per QPU. A thread switch is done after
+ *       TMU requests, so that another instance can run while the load is outstanding.
+ *
+ * The register file is shared by the threads on a QPU, see `size_regfile()`.
+ */
+void Platform::v3d_threads(int val) {
+  assertq(val == 1 || val == 2 || val == 4, "v3d_threads(): number of threads must be 1, 2 or 4", true);
+  instance_local().m_v3d_threads = val;
+}
+
+
+/**
+ * Sets the memory access path to compile `vc4` kernels for.
+ *
+ * With the TMU path, a store does not wait for the DMA to complete; the wait
+ * happens on the next store to the same VPM buffer, or at the end of the kernel.
+ * This means that a value written by a kernel can not reliably be read back
+ * by the same kernel.
+ */
+void Platform::vc4_memory_path(Vc4MemoryPath val) {
+  instance_local().m_vc4_memory_path = val;
+}
+
+
+/**
+ * Enables or disables the automatic pipelining of loads in `For`-loops.
+ *
+ * Enabled by default. This takes effect for kernels compiled afterwards.
+ * On `vc4`, loads are only pipelined with memory path `VC4_MEM_TMU`.
+ */
+void Platform::pipeline_loads(bool val) {
+  instance_local().m_pipeline_loads = val;
+}
+
+
 /**
  * Returns the number of available registers in a register file for the current
  * target platform
@@ -202,23 +246,17 @@ void Platform::compiling_for_vc4(bool val) {
  * of each register file.
  * `v3d` has one single dual-port register file 'A' per QPU.
  *
- * Current implementation assumes no multi-threading has been enabled on the
- * QPU's. If that ever happens (not likely in this project), the size becomes
- * `size/num_threads`.
- *
- * However, according to internet hearsay, the default and minimum number of
- * threads for `v3d` is actually 2 per QPU. Still, 64 for `v3d` appears to be the
- * correct return value in this case.
- *
- * This all goes to show that something that appears to be exceedingly simple in
- * concept can actually be convoluted as f*** underwater.
+ * The physical register file of `v3d` (64 registers) is split evenly over the threads
+ * running on a QPU, so the size is 64, 32 or 16 for 1, 2 or 4 threads.
+ * This is the same split as mesa uses.
  */
 int PlatformInfo::size_regfile() const {
   if (m_compiling_for_vc4) {
     return 32;
-  } else {
-    return 64;
   }
+
+  int const PHYS_COUNT = 64;
+  return PHYS_COUNT/m_v3d_threads;
 }
 
 }  // namespace V3DLib
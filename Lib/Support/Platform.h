@@ -4,6 +4,16 @@
 
 namespace V3DLib {
 
+/**
+ * Selection of the memory access path for `vc4` kernels
+ */
+enum Vc4MemoryPath {
+	VC4_MEM_DMA,   // Loads and stores via DMA, waiting for completion of each (default)
+	VC4_MEM_TMU,   // Loads via TMU, stores via VPM and DMA without waiting for completion
+	VC4_MEM_AUTO   // TMU if the kernel does not use VPM or DMA directly, DMA otherwise
+};
+
+
 struct PlatformInfo {
 	friend class Platform;
 
@@ -15,12 +25,18 @@ struct PlatformInfo {
 	PlatformInfo();
 	bool use_main_memory() const { return m_use_main_memory; }
 	bool compiling_for_vc4() const { return m_compiling_for_vc4; }
+	int v3d_threads() const { return m_v3d_threads; }
+	Vc4MemoryPath vc4_memory_path() const { return m_vc4_memory_path; }
+	bool pipeline_loads() const { return m_pipeline_loads; }
 	void output();
 	int size_regfile() const;
 
 private:
 	bool m_use_main_memory   = false;
 	bool m_compiling_for_vc4 = true;
+	int  m_v3d_threads       = 1;
+	Vc4MemoryPath m_vc4_memory_path = VC4_MEM_DMA;
+	bool m_pipeline_loads    = true;
 };
 
 
@@ -29,6 +45,9 @@ public:
 	static PlatformInfo const &instance();
 	static void use_main_memory(bool val);
 	static void compiling_for_vc4(bool val);
+	static void v3d_threads(int val);
+	static void vc4_memory_path(Vc4MemoryPath val);
+	static void pipeline_loads(bool val);
 
 private:
 	static PlatformInfo &instance_local();
@@ -0,0 +1,57 @@
+#include "parallel.h"
+#include <algorithm>  // std::min()
+#include <cstring>    // memcpy()
+#include <thread>
+#include <vector>
+
+namespace V3DLib {
+
+/**
+ * Call a function for the range [0, n), split into chunks over multiple threads.
+ *
+ * The calling thread handles the first chunk. If the range is too small to split,
+ * the function is called once for the entire range.
+ *
+ * @param n          size of the range
+ * @param min_chunk  minimum size of a chunk handled by a thread
+ * @param f          function to call with the bounds [first, last) of a chunk
+ */
+void parallel_for(size_t n, size_t min_chunk, RangeFunc const &f) {
+  if (n == 0) return;
+
+  size_t num_threads = std::max((size_t) std::thread::hardware_concurrency(), (size_t) 1);
+  num_threads = std::min(num_threads, n/std::max(min_chunk, (size_t) 1));
+
+  if (num_threads <= 1) {
+    f(0, n);
+    return;
+  }
+
+  size_t chunk = (n + num_threads - 1)/num_threads;
+  std::vector<std::thread> threads;
+
+  for (size_t first = chunk; first < n; first += chunk) {
+    threads.emplace_back(f, first, std::min(first + chunk, n));
+  }
+
+  f(0, chunk);
+
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+
+/**
+ * Copy a memory block, over multiple threads if it is large.
+ */
+void bulk_copy(void *dst, void const *src, size_t size_in_bytes) {
+  auto *d = (uint8_t *) dst;
+  auto *s = (uint8_t const *) src;
+
+  parallel_for(size_in_bytes, PARALLEL_MIN_BYTES, [d, s] (size_t first, size_t last) {
+    memcpy(d + first, s + first, last - first);
+  });
+}
+
+}  // namespace V3DLib
@@ -0,0 +1,23 @@
+#ifndef _V3DLIB_SUPPORT_PARALLEL_H_
+#define _V3DLIB_SUPPORT_PARALLEL_H_
+#include <stdint.h>
+#include <cstddef>  // size_t
+#include <functional>
+
+namespace V3DLib {
+
+/**
+ * Minimum number of bytes per thread for splitting bulk operations over threads.
+ *
+ * Below this, starting the threads costs more than it gains.
+ */
+size_t const PARALLEL_MIN_BYTES = 1024*1024;
+
+using RangeFunc = std::function<void (size_t first, size_t last)>;
+
+void parallel_for(size_t n, size_t min_chunk, RangeFunc const &f);
+void bulk_copy(void *dst, void const *src, size_t size_in_bytes);
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_SUPPORT_PARALLEL_H_
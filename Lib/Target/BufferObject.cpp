@@ -1,6 +1,7 @@
 #include "BufferObject.h"
 #include <cassert>
 #include <memory>
+#include <mutex>
 #include <cstdio>
 #include "../Support/basics.h"
 #include "../Support/debug.h"
@@ -12,10 +13,32 @@ namespace {
 
 // Defined as a smart ptr to avoid issues on program init
 std::unique_ptr<BufferObject> emuHeap;
+std::once_flag emuHeapInit;
 
 }
 
 
+/**
+ * @param phyaddr  physical address to use for the heap. This is only relevant if more
+ *                 than one heap is used, the ranges of physical addresses should not overlap.
+ * @param mem      if not null, use this memory for the heap instead of allocating it.
+ *                 The caller remains the owner of the memory.
+ */
+BufferObject::BufferObject(uint32_t size, uint32_t phyaddr, uint8_t *mem) {
+	if (mem != nullptr) {
+		arm_base = mem;
+		m_owns_memory = false;
+		set_size(size);
+	} else {
+		alloc_heap(size);
+	}
+
+	if (phyaddr != 0) {
+		set_phy_address(phyaddr);
+	}
+}
+
+
 /**
  * Allocate heap if not already done so
  */
@@ -34,10 +57,10 @@ uint32_t BufferObject::alloc_array(uint32_t size_in_bytes, uint8_t *&array_start
 
 
 BufferObject &getHeap() {
-	if (!emuHeap) {
+	std::call_once(emuHeapInit, [] () {
 		//debug("Allocating emu heap v3d\n");
 		emuHeap.reset(new BufferObject(BufferObject::DEFAULT_HEAP_SIZE));
-	}
+	});
 
 	return *emuHeap;
 }
@@ -9,7 +9,7 @@ class BufferObject : public V3DLib::BufferObject {
 	using Parent = V3DLib::BufferObject;
 
 public:
-	BufferObject(uint32_t size) { alloc_heap(size); }
+	BufferObject(uint32_t size, uint32_t phyaddr = 0, uint8_t *mem = nullptr);
 	~BufferObject() { dealloc(); }
 
 	uint32_t alloc_array(uint32_t size_in_bytes, uint8_t *&array_start_address);
@@ -17,8 +17,10 @@ public:
 	const BufferType buftype = HeapBuffer;
 
 private:
+	bool m_owns_memory = true;
+
 	void alloc_heap(uint32_t size);
-	void dealloc() { delete [] arm_base; arm_base = nullptr; }
+	void dealloc() { if (m_owns_memory) delete [] arm_base; arm_base = nullptr; }
 };
 
 BufferObject &getHeap();
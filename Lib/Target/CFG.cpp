@@ -39,7 +39,7 @@ void buildCFG(Seq<Instr> &instrs, CFG &cfg) {
 
   for (int i = 0; i < instrs.size(); i++) {
     // Get instruction
-    Instr instr = instrs[i];
+    Instr const &instr = instrs[i];
 
     // Is it an unconditional jump?
     bool uncond = instr.tag == BRL && instr.BRL.cond.tag == COND_ALWAYS;
@@ -65,7 +65,7 @@ void buildCFG(Seq<Instr> &instrs, CFG &cfg) {
   // Add a successor for each conditional jump.
 
   for (int i = 0; i < instrs.size(); i++) {
-    Instr instr = instrs[i];
+    Instr const &instr = instrs[i];
     if (instr.tag == BRL) {
       assert(labelMap[instr.BRL.label] >= 0);
       cfg[i].insert(labelMap[instr.BRL.label]);
@@ -100,6 +100,8 @@ struct QPUState {
   DMAAddr dmaStore;                    // DMA store address
   DMALoadReq dmaLoadSetup;             // DMA load setup register
   DMAStoreReq dmaStoreSetup;           // DMA store setup register
+  DMAStoreReq dmaStoreReq;             // Setup of the DMA store in progress
+  int dmaStoreStride = 0;              // Write stride of the DMA store in progress
   Queue<2, VPMLoadReq> vpmLoadQueue;   // VPM load queue
   VPMStoreReq vpmStoreSetup;           // VPM store setup
   int readPitch = 0;                   // Read pitch
@@ -144,7 +146,7 @@ struct State {
   Word vpm[VPM_SIZE];      // Shared VPM memory
   Seq<char>* output;       // Output for print statements
   int sema[16];            // Semaphores
-	SharedArray<uint32_t> emuHeap;
+	HeapView emuHeap;
 
 	State() {
   	// Initialise semaphores
@@ -155,6 +157,76 @@ struct State {
 }
 
 
+/**
+ * Perform the DMA store in progress to completion.
+ *
+ * The DMA store is done lazily, on the wait or on the start of the next DMA store.
+ * This models the QPU stalling on starting a DMA store while the previous one
+ * is still in progress.
+ */
+void dmaStoreComplete(QPUState* s, State* g) {
+  if (s->dmaStore.active == false) return;
+  DMAStoreReq* req = &s->dmaStoreReq;
+  uint32_t memAddr = s->dmaStore.addr.intVal;
+
+  if (req->hor) {
+    // Horizontal access
+    uint32_t y = (req->vpmAddr >> 4) & 0x3f;
+    for (int r = 0; r < req->numRows; r++) {
+      uint32_t x = req->vpmAddr & 0xf;
+      for (int i = 0; i < req->rowLen; i++) {
+        g->emuHeap.phy(memAddr >> 2) = g->vpm[y*16 + x].intVal;
+        x = (x+1) % 16;
+        memAddr = memAddr + 4;
+      }
+      y = (y+1) % 64;
+      memAddr += s->dmaStoreStride;
+    }
+  }
+  else {
+    // Vertical access
+    uint32_t x = req->vpmAddr & 0xf;
+    for (int r = 0; r < req->numRows; r++) {
+      uint32_t y = (req->vpmAddr >> 4) & 0x3f;
+      for (int i = 0; i < req->rowLen; i++) {
+        g->emuHeap.phy(memAddr >> 2) = g->vpm[y*16 + x].intVal;
+        y = (y+1) % 64;
+        memAddr = memAddr + 4;
+      }
+      x = (x+1) % 16;
+      memAddr += s->dmaStoreStride;
+    }
+  }
+  s->dmaStore.active = false;
+}
+
+
+/**
+ * Check that a VPM write does not touch the data of a DMA store in progress.
+ *
+ * On the hardware, this would change the data written to memory.
+ *
+ * @param index  index of the word written in the VPM
+ */
+void checkVPMWrite(QPUState* s, int index) {
+  if (!s->dmaStore.active) return;
+
+  DMAStoreReq const &req = s->dmaStoreReq;
+  int row = index / 16;
+  int col = index % 16;
+
+  int first_row = (req.vpmAddr >> 4) & 0x3f;
+  int first_col = req.vpmAddr & 0xf;
+  int num_rows  = req.hor? req.numRows : req.rowLen;
+  int num_cols  = req.hor? req.rowLen  : req.numRows;
+
+  bool in_rows = ((row - first_row + 64) % 64) < num_rows;
+  bool in_cols = ((col - first_col + 16) % 16) < num_cols;
+
+  assertq(!(in_rows && in_cols), "VPM write to data of the DMA store in progress", true);
+}
+
+
 /**
  * Read a vector register
  */
@@ -261,40 +333,7 @@ Vec readReg(QPUState* s, State* g, Reg reg) {
         return v; // Return value unspecified
       }
       else if (reg.regId == SPECIAL_DMA_ST_WAIT) {
-        // Perform DMA store to completion
-        if (s->dmaStore.active == false) return v;
-        DMAStoreReq* req = &s->dmaStoreSetup;
-        uint32_t memAddr = s->dmaStore.addr.intVal;
-
-        if (req->hor) {
-          // Horizontal access
-          uint32_t y = (req->vpmAddr >> 4) & 0x3f;
-          for (int r = 0; r < req->numRows; r++) {
-            uint32_t x = req->vpmAddr & 0xf;
-            for (int i = 0; i < req->rowLen; i++) {
-              g->emuHeap.phy(memAddr >> 2) = g->vpm[y*16 + x].intVal;
-              x = (x+1) % 16;
-              memAddr = memAddr + 4;
-            }
-            y = (y+1) % 64;
-            memAddr += s->writeStride;
-          }
-        }
-        else {
-          // Vertical access
-          uint32_t x = req->vpmAddr & 0xf;
-          for (int r = 0; r < req->numRows; r++) {
-            uint32_t y = (req->vpmAddr >> 4) & 0x3f;
-            for (int i = 0; i < req->rowLen; i++) {
-              g->emuHeap.phy(memAddr >> 2) = g->vpm[y*16 + x].intVal;
-              y = (y+1) % 64;
-              memAddr = memAddr + 4;
-            }
-            x = (x+1) % 16;
-            memAddr += s->writeStride;
-          }
-        }
-        s->dmaStore.active = false;
+        dmaStoreComplete(s, g);
         return v; // Return value unspecified
       }
       fatal("V3DLib: can't read special register");
@@ -487,6 +526,7 @@ void writeReg(QPUState* s, State* g, bool setFlags, AssignCond cond, Reg dest, V
             for (int i = 0; i < NUM_LANES; i++) {
               int index = (16*req->addr+i);
               assert(index < VPM_SIZE);
+              checkVPMWrite(s, index);
               g->vpm[index] = v[i];
             }
           }
@@ -497,6 +537,7 @@ void writeReg(QPUState* s, State* g, bool setFlags, AssignCond cond, Reg dest, V
             for (int i = 0; i < NUM_LANES; i++) {
               int index = (y*16*16 + x + i*16);
               assert(index < VPM_SIZE);
+              checkVPMWrite(s, index);
               g->vpm[index] = v[i];
             }
           }
@@ -511,10 +552,18 @@ void writeReg(QPUState* s, State* g, bool setFlags, AssignCond cond, Reg dest, V
           return;
         }
         case SPECIAL_DMA_ST_ADDR: {
-          // Initiate DMA store
-          assert(!s->dmaStore.active);
+          // Initiate DMA store.
+          //
+          // This used to assert that no DMA store is in progress. A store may however
+          // be started before the previous one has completed, the QPU then stalls until
+          // it has. The TMU memory path relies on this. Instead, VPM writes to the data
+          // of a store in progress are caught by `checkVPMWrite()`, and a missing
+          // wait for the last store is caught on ending the QPU.
+          dmaStoreComplete(s, g);
           s->dmaStore.active = true;
           s->dmaStore.addr   = v[0];
+          s->dmaStoreReq     = s->dmaStoreSetup;
+          s->dmaStoreStride  = s->writeStride;
           return;
         }
         case SPECIAL_HOST_INT: {
@@ -814,7 +863,7 @@ void emulate(
 
   state.uniforms = uniforms;
 	// Add final dummy uniform
-	// See Note 1, function `invoke()` in `vc4/Invoke.cpp`.
+	// See Note 1, `Launch::invoke()` in `vc4/Invoke.cpp`.
 	state.uniforms << 0;
 
 	state.emuHeap.heap_view(heap);
@@ -852,7 +901,7 @@ void emulate(
 				//
 				// Run next instruction
 				//
-        Instr const instr = instrs->get(s->pc++);
+        Instr const &instr = instrs->get(s->pc++);
         switch (instr.tag) {
           // Load immediate
           case LI: {
@@ -869,6 +918,8 @@ void emulate(
           }
           // End program (halt)
           case END: {
+            // Otherwise, the data of the last store might not have reached memory
+            assertq(!s->dmaStore.active, "QPU ended with a DMA store in progress", true);
             s->running = false;
             break;
           }
@@ -895,7 +946,7 @@ void emulate(
             break;
           // PRS: print string
           case PRS: {
-            emitStr(state.output, instr.PRS);
+            emitStr(state.output, instr.PRS());
             break;
           }
           // PRI: print integer
@@ -1,9 +1,30 @@
 #include "Syntax.h"         // Location of definition struct Instr
+#include <deque>
+#include <map>
+#include <mutex>
 #include "Target/Pretty.h"  // pretty_instr_tag()
 #include "Support/basics.h" // fatal()
 
 namespace V3DLib {
 
+static_assert(sizeof(Instr) <= 24, "Target instructions should be kept small, they are copied a lot");
+
+namespace {
+
+//
+// Strings of print instructions.
+//
+// These are stored out of line, so that instructions do not need to hold a pointer.
+// Identical strings share an entry. The strings are not released; there is one
+// entry per distinct string printed by kernels.
+//
+std::mutex               print_strings_mutex;
+std::deque<std::string>  print_strings;
+std::map<std::string, uint32_t> print_string_index;
+
+}  // anon namespace
+
+
 /**
  * Initialize the fields per selected instruction tag.
  *
@@ -118,6 +139,32 @@ SetCond &Instr::setCond() {
 }
 
 
+/**
+ * Set the string of a print string instruction
+ */
+void Instr::PRS(char const *str) {
+  assert(tag == InstrTag::PRS);
+  std::lock_guard<std::mutex> lock(print_strings_mutex);
+
+  auto it = print_string_index.find(str);
+  if (it != print_string_index.end()) {
+    m_prs = it->second;
+    return;
+  }
+
+  m_prs = (uint32_t) print_strings.size();
+  print_strings.emplace_back(str);
+  print_string_index[str] = m_prs;
+}
+
+
+char const *Instr::PRS() const {
+  assert(tag == InstrTag::PRS);
+  std::lock_guard<std::mutex> lock(print_strings_mutex);
+  return print_strings[m_prs].c_str();
+}
+
+
 Instr &Instr::pushz() {
   setCond().tag(SetCond::Z);
   return *this;
@@ -37,8 +37,8 @@ void introduceAccum(Liveness &live, Seq<Instr> &instrs) {
   LiveSet liveOut;
 
   for (int i = 1; i < instrs.size(); i++) {
-    Instr prev  = instrs[i-1];
-    Instr instr = instrs[i];
+    Instr &prev  = instrs[i-1];
+    Instr &instr = instrs[i];
 
     // Compute vars defined by prev
     useDef(prev, &useDefPrev);
@@ -77,8 +77,6 @@ void introduceAccum(Liveness &live, Seq<Instr> &instrs) {
 
     renameDest( &prev, REG_A, def, ACC, acc_id);
     renameUses(&instr, REG_A, def, ACC, acc_id);
-    instrs[i-1] = prev;
-    instrs[i]   = instr;
         
 /*
     // WRI DEBUG
@@ -103,7 +101,7 @@ void introduceAccum(Liveness &live, Seq<Instr> &instrs) {
 /**
  * Compute 'use' and 'def' sets for a given instruction
  */
-void useDefReg(Instr instr, UseDefReg* useDef) {
+void useDefReg(Instr const &instr, UseDefReg* useDef) {
   auto ALWAYS = AssignCond::Tag::ALWAYS;
 
   // Make the 'use' and 'def' sets empty
@@ -199,7 +197,7 @@ void useSetOfSuccs(Seq<Instr>* instrs, CFG* cfg, InstrId i, SmallSeq<RegId>* use
 
 // Return true if given instruction has two register operands.
 
-bool getTwoUses(Instr instr, Reg* r1, Reg* r2)
+bool getTwoUses(Instr const &instr, Reg* r1, Reg* r2)
 {
   if (instr.tag == ALU && instr.ALU.srcA.tag == REG
                        && instr.ALU.srcB.tag == REG) {
@@ -237,8 +235,7 @@ void liveness(Seq<Instr> &instrs, Liveness &live) {
     // Propagate live variables backwards
     for (int i = instrs.size()-1; i >= 0; i--) {
       // Compute 'use' and 'def' sets
-      Instr instr = instrs[i];
-      useDef(instr, &useDefSets);
+      useDef(instrs[i], &useDefSets);
 
       // Compute live-out variables
       live.computeLiveOut(i, liveOut);
@@ -28,9 +28,9 @@ struct UseDef {
 
 // Compute 'use' and 'def' sets for a given instruction
 
-void useDefReg(Instr instr, UseDefReg* out);
+void useDefReg(Instr const &instr, UseDefReg* out);
 void useDef(Instr const &instr, UseDef* out);
-bool getTwoUses(Instr instr, Reg* r1, Reg* r2);
+bool getTwoUses(Instr const &instr, Reg* r1, Reg* r2);
 
 // A live set containts the variables
 // that are live-in to an instruction.
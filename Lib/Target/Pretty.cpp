@@ -99,7 +99,7 @@ std::string pretty_instr(Instr const &instr) {
       buf << "L" << instr.label();
       break;
     case PRS:
-			buf << "PRS(\"" << instr.PRS << "\")";
+			buf << "PRS(\"" << instr.PRS() << "\")";
       break;
     case PRI:
       buf << "PRI(" << instr.PRI.pretty() << ")";
@@ -31,6 +31,16 @@ const char* specialStr(RegId rid) {
   assert(false);
 	return "";
 }
+
+
+/**
+ * Register id for a standard variable
+ */
+uint16_t var_reg_id(Var v) {
+	assertq(v.id() <= MAX_REG_ID, "Too many variables in kernel, register ids are limited to 16 bits", true);
+	return (uint16_t) v.id();
+}
+
 }  //  anon namespace
 
 
@@ -42,7 +52,7 @@ Reg freshReg() {
 	Reg r;
 
 	r.tag = REG_A;
-	r.regId = v.id();
+	r.regId = var_reg_id(v);
 	return r;
 }
 
@@ -74,7 +84,7 @@ Reg srcReg(Var v) {
 			break;
     case STANDARD:
       r.tag   = REG_A;
-      r.regId = v.id();
+      r.regId = var_reg_id(v);
 			break;
     case VPM_WRITE:
     case TMU0_ADDR:
@@ -83,7 +93,7 @@ Reg srcReg(Var v) {
 			break;
     case DUMMY:
       r.tag   = NONE;
-      r.regId = v.id();
+      r.regId = (uint16_t) v.id();
 			break;
 		default:
 			assert(false);
@@ -109,7 +119,7 @@ Reg dstReg(Var v) {
 			return Reg();  // Return anything
 
     case STANDARD:
-			return Reg(REG_A, v.id());
+			return Reg(REG_A, var_reg_id(v));
     case VarTag::VPM_WRITE:
 			return Target::instr::VPM_WRITE;
     case TMU0_ADDR:
@@ -1,5 +1,6 @@
 #ifndef _V3DLIB_TARGET_REG_H_
 #define _V3DLIB_TARGET_REG_H_
+#include <stdint.h>
 #include "Source/Var.h"
 
 namespace V3DLib {
@@ -10,8 +11,16 @@ namespace V3DLib {
 
 typedef int RegId;
 
+/**
+ * Largest register id that can be stored in a `Reg`.
+ *
+ * Register ids are stored in 16 bits to keep instructions small. Variables map
+ * to register ids, so this also limits the number of variables in a kernel.
+ */
+RegId const MAX_REG_ID = UINT16_MAX;
+
 // Different kinds of registers
-enum RegTag {
+enum RegTag : uint8_t {
     REG_A           // In register file A (0..31)
   , REG_B           // In register file B (0..31)
   , ACC             // Accumulator register
@@ -50,13 +59,12 @@ enum Special {
 
 
 struct Reg {
-  RegTag tag;   // What kind of register is it?
-  RegId regId;  // Register identifier
-
+  RegTag tag;         // What kind of register is it?
 	bool isUniformPtr;
+  uint16_t regId;     // Register identifier, at most MAX_REG_ID
 
 	Reg() = default;
-	Reg(RegTag in_tag, RegId in_regId) : tag(in_tag), regId(in_regId) {}
+	Reg(RegTag in_tag, RegId in_regId) : tag(in_tag), regId((uint16_t) in_regId) {}
 
   bool operator==(Reg const &rhs) const {
     return tag == rhs.tag && regId == rhs.regId;
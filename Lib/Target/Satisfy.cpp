@@ -18,7 +18,7 @@ Instr remapAToAccum(Instr* instr, RegId acc) {
 
   Reg src = instr->ALU.srcA.reg;
   instr->ALU.srcA.reg.tag    = ACC;
-  instr->ALU.srcA.reg.regId  = acc;
+  instr->ALU.srcA.reg.regId  = (uint16_t) acc;
 
   return Target::instr::mov(Reg(ACC, acc), src);
 }
@@ -32,7 +32,7 @@ Instr remapBToAccum(Instr* instr, RegId acc) {
 
   Reg src = instr->ALU.srcB.reg;
   instr->ALU.srcB.reg.tag   = ACC;
-  instr->ALU.srcB.reg.regId = acc;
+  instr->ALU.srcB.reg.regId = (uint16_t) acc;
 
   return Target::instr::mov(Reg(ACC, acc), src);
 }
@@ -111,7 +111,7 @@ void insertNops(Seq<Instr> &instrs, Seq<Instr> &newInstrs) {
   Instr prev = Instr::nop();
 
   for (int i = 0; i < instrs.size(); i++) {
-    Instr instr = instrs[i];
+    Instr const &instr = instrs[i];
 
     // Insert NOPs to avoid data hazards
     useDefReg(prev, &prevSet);
@@ -146,7 +146,7 @@ void insertNops(Seq<Instr> &instrs, Seq<Instr> &newInstrs) {
 /**
  * Return true for any instruction that doesn't read from the VPM
  */
-bool notVPMGet(Instr instr) {
+bool notVPMGet(Instr const &instr) {
   // Use/def sets
   UseDefReg useDef;
 
@@ -168,14 +168,14 @@ void removeVPMStall(Seq<Instr> &instrs, Seq<Instr> &newInstrs) {
   UseDefReg useDef;
 
   for (int i = 0; i < instrs.size(); i++) {
-    Instr instr = instrs[i];
+    Instr const &instr = instrs[i];
     if (instr.tag != VPM_STALL)
       newInstrs << instr;
     else {
       int numNops = 3;  // Number of nops to insert
       for (int j = 1; j <= 3; j++) {
         if ((i+j) >= instrs.size()) break;
-        Instr next = instrs[i+j];
+        Instr const &next = instrs[i+j];
         if (next.tag == LAB) break;
         if (notVPMGet(next)) numNops--; else break;
       }
@@ -11,7 +11,7 @@ void renameDest(Instr* instr, RegTag vt, RegId v, RegTag wt, RegId w) {
     case LI:
       if (instr->LI.dest.tag == vt && instr->LI.dest.regId == v) {
         instr->LI.dest.tag = wt;
-        instr->LI.dest.regId = w;
+        instr->LI.dest.regId = (uint16_t) w;
       }
       return;
 
@@ -19,7 +19,7 @@ void renameDest(Instr* instr, RegTag vt, RegId v, RegTag wt, RegId w) {
     case ALU:
       if (instr->ALU.dest.tag == vt && instr->ALU.dest.regId == v) {
         instr->ALU.dest.tag = wt;
-        instr->ALU.dest.regId = w;
+        instr->ALU.dest.regId = (uint16_t) w;
       }
       return;
 
@@ -27,7 +27,7 @@ void renameDest(Instr* instr, RegTag vt, RegId v, RegTag wt, RegId w) {
     case RECV:
       if (instr->RECV.dest.tag == vt && instr->RECV.dest.regId == v) {
         instr->RECV.dest.tag = wt;
-        instr->RECV.dest.regId = w;
+        instr->RECV.dest.regId = (uint16_t) w;
       }
       return;
 		default:
@@ -46,13 +46,13 @@ void renameUses(Instr* instr, RegTag vt, RegId v, RegTag wt, RegId w) {
       if (instr->ALU.srcA.tag == REG && instr->ALU.srcA.reg.tag == vt &&
           instr->ALU.srcA.reg.regId == v) {
         instr->ALU.srcA.reg.tag = wt;
-        instr->ALU.srcA.reg.regId = w;
+        instr->ALU.srcA.reg.regId = (uint16_t) w;
       }
 
       if (instr->ALU.srcB.tag == REG && instr->ALU.srcB.reg.tag == vt &&
           instr->ALU.srcB.reg.regId == v) {
         instr->ALU.srcB.reg.tag = wt;
-        instr->ALU.srcB.reg.regId = w;
+        instr->ALU.srcB.reg.regId = (uint16_t) w;
       }
       return;
 
@@ -60,7 +60,7 @@ void renameUses(Instr* instr, RegTag vt, RegId v, RegTag wt, RegId w) {
     case PRI:
       if (instr->PRI.tag == vt && instr->PRI.regId == v) {
         instr->PRI.tag = wt;
-        instr->PRI.regId = w;
+        instr->PRI.regId = (uint16_t) w;
       }
       return;
 
@@ -68,7 +68,7 @@ void renameUses(Instr* instr, RegTag vt, RegId v, RegTag wt, RegId w) {
     case PRF:
       if (instr->PRF.tag == vt && instr->PRF.regId == v) {
         instr->PRF.tag = wt;
-        instr->PRF.regId = w;
+        instr->PRF.regId = (uint16_t) w;
       }
       return;
 		default:
@@ -33,7 +33,7 @@ Instr genInstr(ALUOp::Enum op, Reg dst, Reg srcA, int n) {
   instr.ALU.op                = ALUOp(op);
   instr.ALU.srcB.tag          = IMM;
   instr.ALU.srcB.smallImm.tag = SMALL_IMM;
-  instr.ALU.srcB.smallImm.val = n;
+  instr.ALU.srcB.smallImm.val = (int16_t) n;
 
   return instr;
 }
@@ -44,11 +44,11 @@ Instr genInstr(ALUOp::Enum op, Reg dst, int n, int m) {
   instr.ALU.dest              = dst;
   instr.ALU.srcA.tag          = IMM;
   instr.ALU.srcA.smallImm.tag = SMALL_IMM;
-  instr.ALU.srcA.smallImm.val = n;
+  instr.ALU.srcA.smallImm.val = (int16_t) n;
   instr.ALU.op                = ALUOp(op);
   instr.ALU.srcB.tag          = IMM;
   instr.ALU.srcB.smallImm.tag = SMALL_IMM;
-  instr.ALU.srcB.smallImm.val = m;
+  instr.ALU.srcB.smallImm.val = (int16_t) m;
 
   return instr;
 }
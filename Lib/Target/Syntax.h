@@ -38,7 +38,7 @@ namespace V3DLib {
 // ============================================================================
 
 // Different kinds of immediate
-enum ImmTag {
+enum ImmTag : uint8_t {
     IMM_INT32    // 32-bit word
   , IMM_FLOAT32  // 32-bit float
   , IMM_MASK     // 1 bit per vector element (0 to 0xffff)
@@ -54,7 +54,7 @@ struct Imm {
 };
 
 // Different kinds of small immediates
-enum SmallImmTag {
+enum SmallImmTag : uint8_t {
     SMALL_IMM  // Small immediate
   , ROT_ACC    // Rotation amount taken from accumulator 5
   , ROT_IMM    // Rotation amount 1..15
@@ -64,8 +64,8 @@ struct SmallImm {
   // What kind of small immediate is it?
   SmallImmTag tag;
   
-  // Immediate value
-  int val;
+  // Immediate value, an encoded small literal or a rotation amount
+  int16_t val;
 
   bool operator==(SmallImm const &rhs) const {
     return tag == rhs.tag && val == rhs.val;
@@ -77,7 +77,7 @@ struct SmallImm {
 };
 
 // A register or a small immediate operand?
-enum RegOrImmTag { REG, IMM };
+enum RegOrImmTag : uint8_t { REG, IMM };
 
 struct RegOrImm {
   // Register id or small immediate?
@@ -113,7 +113,6 @@ struct RegOrImm {
 
 struct BranchTarget {
   bool relative;      // Branch is absolute or relative to PC+4
-
   bool useRegOffset;  // Plus value from register file A (optional)
   RegId regOffset;
 
@@ -149,7 +148,7 @@ void resetFreshLabelGen(int val);
 // ============================================================================
 
 // QPU instruction tags
-enum InstrTag {
+enum InstrTag : uint8_t {
   LI,             // Load immediate
   ALU,            // ALU operation
   BR,             // Conditional branch to target
@@ -219,9 +218,9 @@ struct Instr : public InstructionComment {
     struct {
       SetCond    m_setCond;
       AssignCond cond;
+      ALUOp      op;
       Reg        dest;
       RegOrImm   srcA;
-      ALUOp      op;
       RegOrImm   srcB;
     } ALU;
 
@@ -252,7 +251,7 @@ struct Instr : public InstructionComment {
     struct { Reg dest; } RECV;  // Destination register for load receive
 
     // Print instructions
-    const char* PRS;            // Print string
+    uint32_t m_prs;             // Print string, index of the string, see `PRS()`
     Reg PRI;                    // Print integer
     Reg PRF;                    // Print float
   };
@@ -276,6 +275,9 @@ struct Instr : public InstructionComment {
   bool isLast() const;
 
   SetCond const &setCond() const;
+
+  void PRS(char const *str);
+  char const *PRS() const;
   std::string mnemonic(bool with_comments = false, std::string const &pref = "") const;
 
   bool operator==(Instr const &rhs) const {
@@ -323,6 +325,13 @@ struct Instr : public InstructionComment {
     return *this;
   }
 
+  Instr &allzs() {
+    assert(tag == InstrTag::BRL);
+    BRL.cond.tag  = COND_ALL;
+    BRL.cond.flag = Flag::ZS;
+    return *this;
+  }
+
 private:
   SetCond &setCond();
 };
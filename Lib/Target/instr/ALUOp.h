@@ -1,5 +1,6 @@
 #ifndef _V3DLIB_TARGET_SYNTAX_INSTR_ALUOP_H_
 #define _V3DLIB_TARGET_SYNTAX_INSTR_ALUOP_H_
+#include <stdint.h>
 #include <string>
 
 namespace V3DLib {
@@ -8,7 +9,7 @@ struct Op;  // Forward declaration
 
 class ALUOp {
 public:
-  enum Enum {
+  enum Enum : uint8_t {
     NOP,            // No op
 
     // Opcodes for the 'add' ALU
@@ -1,5 +1,6 @@
 #ifndef _V3DLIB_TARGET_SYNTAX_INSTR_CONDITIONS_H_
 #define _V3DLIB_TARGET_SYNTAX_INSTR_CONDITIONS_H_
+#include <stdint.h>
 #include <string>
 
 namespace V3DLib {
@@ -10,7 +11,7 @@ class CmpOp;  // Forward declaration
 // Conditions
 // ============================================================================
 
-enum Flag {
+enum Flag : uint8_t {
     ZS              // Zero set
   , ZC              // Zero clear
   , NS              // Negative set
@@ -19,7 +20,7 @@ enum Flag {
 
 // Branch conditions
 
-enum BranchCondTag {
+enum BranchCondTag : uint8_t {
     COND_ALL         // Reduce vector of bits to a single
   , COND_ANY         // bit using AND/OR reduction
   , COND_ALWAYS
@@ -38,7 +39,7 @@ struct BranchCond {
 
 // v3d only
 struct SetCond {
-	enum Tag {
+	enum Tag : uint8_t {
 		NO_COND,
 		Z,
 		N,
@@ -65,7 +66,7 @@ private:
  * Assignment conditions
  */
 struct AssignCond {
-	enum Tag {
+	enum Tag : uint8_t {
 		NEVER,
 		ALWAYS,
 		FLAG
@@ -0,0 +1,162 @@
+#include "TaskGraph.h"
+#include <future>
+#include "Support/basics.h"
+
+namespace V3DLib {
+
+// ============================================================================
+// Class TaskGraph::Task
+// ============================================================================
+
+/**
+ * Check for a read-after-write, write-after-write or write-after-read dependency
+ * on a previously added task.
+ */
+bool TaskGraph::Task::depends_on(Task const &prev) const {
+  for (auto const &w : prev.m_writes) {
+    for (auto const &r : m_reads) {
+      if (w.overlaps(r)) return true;
+    }
+
+    for (auto const &w2 : m_writes) {
+      if (w.overlaps(w2)) return true;
+    }
+  }
+
+  for (auto const &r : prev.m_reads) {
+    for (auto const &w : m_writes) {
+      if (r.overlaps(w)) return true;
+    }
+  }
+
+  return false;
+}
+
+
+// ============================================================================
+// Class TaskGraph
+// ============================================================================
+
+/**
+ * Add an invocation of the kernel with its currently loaded parameters.
+ *
+ * The parameters are copied, as with `CommandQueue::record()`.
+ *
+ * @return the new task, for declaring the arrays it reads and writes
+ */
+TaskGraph::Task &TaskGraph::add(KernelBase &k) {
+  std::unique_ptr<Task> task(new Task);
+  task->m_kernel.record(k);
+
+  m_tasks.push_back(std::move(task));
+  return *m_tasks.back();
+}
+
+
+/**
+ * Add a function to run on the host.
+ *
+ * @return the new task, for declaring the arrays it reads and writes
+ */
+TaskGraph::Task &TaskGraph::add_host(std::function<void()> f) {
+  assert(f);
+  std::unique_ptr<Task> task(new Task);
+  task->m_host = f;
+
+  m_tasks.push_back(std::move(task));
+  return *m_tasks.back();
+}
+
+
+void TaskGraph::set_dependencies() {
+  for (int i = 0; i < size(); ++i) {
+    auto &task = *m_tasks[i];
+    task.m_deps.clear();
+
+    for (int j = 0; j < i; ++j) {
+      if (task.depends_on(*m_tasks[j])) {
+        task.m_deps.push_back(j);
+      }
+    }
+  }
+}
+
+
+/**
+ * Run all tasks, and wait until they are done.
+ *
+ * Since a task can only depend on tasks added before it, there is always at
+ * least one task which can run in a stage.
+ */
+void TaskGraph::run() {
+  set_dependencies();
+  m_num_stages = 0;
+
+  // 0: not run yet, 1: in current stage, 2: done
+  std::vector<int> state(m_tasks.size(), 0);
+  int num_done = 0;
+
+  while (num_done < size()) {
+    CommandQueue     kernels;
+    std::vector<int> hosts;
+    std::vector<int> stage;
+
+    for (int i = 0; i < size(); ++i) {
+      if (state[i] != 0) continue;
+      auto &task = *m_tasks[i];
+
+      // Dependencies within the stage are only allowed on tasks of the same kind
+      bool ready = true;
+      for (int dep : task.m_deps) {
+        if (state[dep] == 2) continue;
+        if (state[dep] == 1 && m_tasks[dep]->is_kernel() == task.is_kernel()) continue;
+
+        ready = false;
+        break;
+      }
+
+      if (!ready) continue;
+
+      state[i] = 1;
+      stage.push_back(i);
+
+      if (task.is_kernel()) {
+        kernels.append(task.m_kernel);
+      } else {
+        hosts.push_back(i);
+      }
+    }
+
+    assert(!stage.empty());
+
+    // Run the kernels in the background while the host functions run
+    std::future<void> kernels_done;
+    if (!kernels.empty()) {
+      kernels_done = std::async(std::launch::async, [&kernels] () {
+        kernels.submit();
+      });
+    }
+
+    try {
+      for (int i : hosts) {
+        m_tasks[i]->m_host();
+      }
+    } catch (...) {
+      if (kernels_done.valid()) kernels_done.wait();
+      throw;
+    }
+
+    if (kernels_done.valid()) {
+      kernels_done.get();  // Rethrows if the kernels failed
+    }
+
+    for (int i : stage) {
+      state[i] = 2;
+    }
+
+    num_done += (int) stage.size();
+    m_num_stages++;
+  }
+}
+
+}  // namespace V3DLib
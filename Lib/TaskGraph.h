@@ -0,0 +1,106 @@
+#ifndef _V3DLIB_TASKGRAPH_H_
+#define _V3DLIB_TASKGRAPH_H_
+#include <functional>
+#include <memory>
+#include <vector>
+#include "CommandQueue.h"
+
+namespace V3DLib {
+
+/**
+ * Runs kernel invocations and host functions in order of their data dependencies.
+ *
+ * Usage:
+ *
+ *     TaskGraph graph;
+ *
+ *     preprocess.load(&in, &tmp);
+ *     graph.add(preprocess).reads(in).writes(tmp);
+ *
+ *     graph.add_host([&] () { prepare(other); }).writes(other);
+ *
+ *     transform.load(&tmp, &other, &out);
+ *     graph.add(transform).reads(tmp).reads(other).writes(out);
+ *
+ *     graph.run();
+ *
+ * A task depends on all previously added tasks which write the arrays it reads
+ * or writes, and on all previously added tasks which read the arrays it writes.
+ * Arrays are compared by memory range, so overlapping arrays are handled.
+ *
+ * The tasks are run in stages. Each stage consists of:
+ *
+ *  - the kernel invocations whose dependencies are met before the stage, or by
+ *    previous kernel invocations in the same stage. These are submitted together
+ *    via a `CommandQueue`, so there is only one wait for all of them.
+ *  - the host functions whose dependencies are met before the stage, or by previous
+ *    host functions in the same stage. These run on the calling thread while the
+ *    kernels run.
+ *
+ * The graph is kept after running, so that it can be run again.
+ */
+class TaskGraph {
+public:
+  class Task {
+    friend class TaskGraph;
+
+  public:
+    template <typename T>
+    Task &reads(SharedArray<T> &arr) {
+      m_reads.push_back(range(arr));
+      return *this;
+    }
+
+    template <typename T>
+    Task &writes(SharedArray<T> &arr) {
+      m_writes.push_back(range(arr));
+      return *this;
+    }
+
+    bool is_kernel() const { return !m_host; }
+    std::vector<int> const &dependencies() const { return m_deps; }
+
+  private:
+    struct Range {
+      uint32_t addr;
+      uint32_t size;
+
+      bool overlaps(Range const &rhs) const {
+        return addr < rhs.addr + rhs.size && rhs.addr < addr + size;
+      }
+    };
+
+    CommandQueue          m_kernel;  // Holds the kernel invocation, for kernel tasks
+    std::function<void()> m_host;    // Set for host tasks
+    std::vector<Range>    m_reads;
+    std::vector<Range>    m_writes;
+    std::vector<int>      m_deps;    // Indexes of the tasks this task depends on
+
+    template <typename T>
+    static Range range(SharedArray<T> &arr) {
+      assertq(arr.allocated(), "TaskGraph: array for task not allocated", true);
+      return { arr.getAddress(), (uint32_t) (arr.size()*sizeof(T)) };
+    }
+
+    bool depends_on(Task const &prev) const;
+  };
+
+  Task &add(KernelBase &k);
+  Task &add_host(std::function<void()> f);
+  void run();
+  void clear() { m_tasks.clear(); }
+
+  int size() const { return (int) m_tasks.size(); }
+  Task const &task(int index) const { return *m_tasks[index]; }
+  int num_stages() const { return m_num_stages; }
+
+private:
+  std::vector<std::unique_ptr<Task>> m_tasks;
+  int m_num_stages = 0;  // Number of stages of the last run
+
+  void set_dependencies();
+};
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_TASKGRAPH_H_
@@ -5,6 +5,10 @@
 #include "Source/Cond.h"
 #include "Source/Lang.h"
 #include "Source/gather.h"
+#include "Source/Functions.h"
 #include "Kernel.h"
+#include "CommandQueue.h"
+#include "TaskGraph.h"
+#include "WorkSplit.h"
 
 #endif
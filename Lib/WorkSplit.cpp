@@ -0,0 +1,131 @@
+#include "WorkSplit.h"
+#include <chrono>
+#include <cmath>   // std::lround()
+#include <future>
+#include "Support/basics.h"
+
+namespace V3DLib {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Weight of the newest measurement in the throughput estimates.
+ *
+ * Averaging smooths out timing noise, while the split still adapts within a few runs.
+ */
+double const RATE_WEIGHT = 0.5;
+
+
+double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+void smooth(double &rate, size_t n, double secs) {
+  if (n == 0 || secs <= 0.0) return;  // Nothing measured
+
+  double measured = ((double) n)/secs;
+
+  if (rate == 0.0) {
+    rate = measured;
+  } else {
+    rate = (1.0 - RATE_WEIGHT)*rate + RATE_WEIGHT*measured;
+  }
+}
+
+}  // anon namespace
+
+
+/**
+ * @param granularity  size of the QPU part is a multiple of this. Typically,
+ *                     this is 16 times the number of QPUs used.
+ * @param qpu_share    fraction of the range for the QPUs in the first run,
+ *                     in range [0, 1]
+ */
+WorkSplit::WorkSplit(size_t granularity, float qpu_share) :
+  m_granularity(granularity),
+  m_qpu_share(qpu_share) {
+  assertq(granularity > 0, "WorkSplit: granularity must be positive", true);
+  assertq(0.0f <= qpu_share && qpu_share <= 1.0f, "WorkSplit: share of QPUs must be in range [0, 1]", true);
+}
+
+
+/**
+ * Run the range [0, n), with the QPU part on a background thread and the host
+ * part on the calling thread and `parallel_for()` threads.
+ *
+ * Either function is skipped if its part is empty.
+ *
+ * @param qpu_func  function running the kernel for the bounds [first, last)
+ * @param cpu_func  function handling the bounds [first, last) on the host.
+ *                  This is called for consecutive chunks from multiple threads.
+ */
+void WorkSplit::run(size_t n, RangeFunc const &qpu_func, RangeFunc const &cpu_func) {
+  size_t qpu_n = qpu_count(n);
+  size_t cpu_n = n - qpu_n;
+  m_last_qpu_count = qpu_n;
+
+  double qpu_secs = 0.0;
+  std::future<void> qpu_done;
+
+  if (qpu_n > 0) {
+    qpu_done = std::async(std::launch::async, [&qpu_func, qpu_n, &qpu_secs] () {
+      auto start = Clock::now();
+      qpu_func(0, qpu_n);
+      qpu_secs = seconds_since(start);
+    });
+  }
+
+  double cpu_secs = 0.0;
+
+  try {
+    auto start = Clock::now();
+
+    parallel_for(cpu_n, m_granularity, [&cpu_func, qpu_n] (size_t first, size_t last) {
+      cpu_func(qpu_n + first, qpu_n + last);
+    });
+
+    cpu_secs = seconds_since(start);
+  } catch (...) {
+    if (qpu_done.valid()) qpu_done.wait();
+    throw;
+  }
+
+  if (qpu_done.valid()) {
+    qpu_done.get();  // Rethrows if the kernel failed
+  }
+
+  update(qpu_n, qpu_secs, cpu_n, cpu_secs);
+}
+
+
+/**
+ * @return size of the QPU part of a range of size n, for the current share
+ */
+size_t WorkSplit::qpu_count(size_t n) const {
+  size_t units = (size_t) std::lround(m_qpu_share*((double) n)/((double) m_granularity));
+  size_t max_units = n/m_granularity;
+
+  if (units > max_units) units = max_units;
+  return units*m_granularity;
+}
+
+
+/**
+ * Adjust the QPU share to the measured throughput.
+ *
+ * With rates r_q and r_c, both parts take the same time if the QPU share is r_q/(r_q + r_c).
+ * A side which got no work keeps its previous estimate.
+ */
+void WorkSplit::update(size_t qpu_n, double qpu_secs, size_t cpu_n, double cpu_secs) {
+  smooth(m_qpu_rate, qpu_n, qpu_secs);
+  smooth(m_cpu_rate, cpu_n, cpu_secs);
+
+  if (m_qpu_rate == 0.0 || m_cpu_rate == 0.0) return;  // Need both to compare
+
+  m_qpu_share = (float) (m_qpu_rate/(m_qpu_rate + m_cpu_rate));
+}
+
+}  // namespace V3DLib
@@ -0,0 +1,56 @@
+#ifndef _V3DLIB_WORKSPLIT_H_
+#define _V3DLIB_WORKSPLIT_H_
+#include <cstddef>  // size_t
+#include "Support/parallel.h"
+
+namespace V3DLib {
+
+/**
+ * Splits a data-parallel range between the QPUs and the host threads.
+ *
+ * Usage:
+ *
+ *     WorkSplit split(16*k.numQPUs);
+ *
+ *     split.run(SIZE,
+ *       [&] (size_t first, size_t last) {         // On the QPUs
+ *         k.load((int) first, (int) (last - first), &x);
+ *         k.call();
+ *       },
+ *       [&] (size_t first, size_t last) {         // On the host
+ *         scalar_version(x.view().data() + first, last - first);
+ *       });
+ *
+ * The QPUs get the start of the range, the host threads the rest. Both parts
+ * run at the same time; the host part is split over threads with `parallel_for()`.
+ *
+ * The throughput of both parts is measured on each run. The share of the QPUs
+ * is adjusted to this for the next run, so that both parts take about the same time.
+ * The same instance should therefore be used for all invocations of the same
+ * computation.
+ */
+class WorkSplit {
+public:
+  WorkSplit(size_t granularity = 16, float qpu_share = 0.5f);
+
+  void run(size_t n, RangeFunc const &qpu_func, RangeFunc const &cpu_func);
+
+  float qpu_share() const { return m_qpu_share; }
+  size_t last_qpu_count() const { return m_last_qpu_count; }
+  double qpu_rate() const { return m_qpu_rate; }
+  double cpu_rate() const { return m_cpu_rate; }
+
+private:
+  size_t m_granularity;            // The QPU part is a multiple of this
+  float  m_qpu_share;              // Fraction of the range for the QPUs in the next run
+  size_t m_last_qpu_count = 0;     // Size of the QPU part in the last run
+  double m_qpu_rate = 0.0;         // Measured items per second, 0 if not measured yet
+  double m_cpu_rate = 0.0;
+
+  size_t qpu_count(size_t n) const;
+  void update(size_t qpu_n, double qpu_secs, size_t cpu_n, double cpu_secs);
+};
+
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_WORKSPLIT_H_
@@ -1,5 +1,6 @@
 #include "BufferObject.h"
 #include <memory>
+#include <mutex>
 #include "Support/basics.h"
 #include "Support/Platform.h"  // has_vc4() 
 #include "v3d.h"
@@ -119,16 +120,17 @@ namespace {
 
 // Defined as a smart ptr to avoid issues on program init
 std::unique_ptr<BufferObject> mainHeap;
+std::once_flag mainHeapInit;
 
 }
 
 
 BufferObject &getMainHeap() {
 	if (!Platform::instance().has_vc4) {
-		if (!mainHeap) {
+		std::call_once(mainHeapInit, [] () {
 			//debug("Allocating main heap v3d\n");
 			mainHeap.reset(new BufferObject(BufferObject::DEFAULT_HEAP_SIZE));
-		}
+		});
 	}
 
 	return *mainHeap;
@@ -0,0 +1,124 @@
+#include "CycleModel.h"
+#include <algorithm>  // std::max()
+#include <deque>
+#include "Support/debug.h"
+
+namespace V3DLib {
+namespace v3d {
+namespace {
+
+struct Thread {
+  size_t          pc          = 0;
+  bool            done        = false;
+  bool            store       = false;  // Data has been written for the next TMU request
+  int             stores_done = 0;      // Cycle at which the outstanding TMU stores are done
+  std::deque<int> loads;                // Cycles at which the outstanding TMU loads are available
+};
+
+
+bool writes_to(instr::Instr const &instr, v3d_qpu_waddr waddr) {
+  if (instr.type != V3D_QPU_INSTR_TYPE_ALU) return false;
+
+  return (instr.alu.add.magic_write && instr.alu.add.waddr == waddr)
+      || (instr.alu.mul.magic_write && instr.alu.mul.waddr == waddr);
+}
+
+}  // anon namespace
+
+
+/**
+ * Simulate `num_threads` instances of the given code on a single QPU.
+ *
+ * The model:
+ *
+ * - Every instruction takes one cycle.
+ * - A TMU request (a write to `tmua`) completes `tmu_latency` cycles later. There is no
+ *   limit on the number of outstanding requests, and no contention between threads.
+ * - A TMU request after a write to `tmud` is a store. `tmuwt` waits until all stores
+ *   of the thread are done.
+ * - `ldtmu` waits until the oldest outstanding load of the thread is done.
+ * - The QPU switches to the next thread after the two delay slots of a `thrsw`.
+ *   A thread which waits on the TMU stalls the QPU; there is no switch otherwise.
+ * - Branches are not taken, the code is run once from start to end.
+ *   For a loop, this amounts to a single iteration.
+ *
+ * @param code         v3d instructions of the kernel
+ * @param num_threads  number of threads per QPU the code was compiled for
+ * @param tmu_latency  cycles needed for a TMU request, the default is a rough
+ *                     figure for a load which misses the caches
+ */
+CycleEstimate estimate_cycles(std::vector<instr::Instr> const &code, int num_threads, int tmu_latency) {
+  assert(num_threads >= 1);
+
+  CycleEstimate ret;
+  ret.num_threads = num_threads;
+
+  std::vector<Thread> threads(num_threads);
+  int num_done = 0;
+  int cur      = 0;
+  int cycle    = 0;
+
+  while (num_done < num_threads) {
+    Thread &t = threads[cur];
+    size_t switch_at = code.size();  // Index of last instruction to run before a thread switch
+
+    while (t.pc < code.size()) {
+      auto const &instr = code[t.pc];
+      int wait = 0;
+
+      if (instr.type == V3D_QPU_INSTR_TYPE_ALU) {
+        if (instr.sig.ldtmu && !t.loads.empty()) {
+          wait = std::max(0, t.loads.front() - cycle);
+          t.loads.pop_front();
+        }
+
+        if (instr.alu.add.op == V3D_QPU_A_TMUWT) {
+          wait = std::max(wait, t.stores_done - cycle);
+        }
+
+        if (instr.sig.thrsw && switch_at == code.size()) {
+          switch_at = t.pc + 2;
+        }
+      }
+
+      cycle += wait + 1;
+      ret.stall_cycles += wait;
+
+      if (writes_to(instr, V3D_QPU_WADDR_TMUD)) {
+        t.store = true;
+      }
+
+      if (writes_to(instr, V3D_QPU_WADDR_TMUA) || writes_to(instr, V3D_QPU_WADDR_TMUAU)) {
+        if (t.store) {
+          t.stores_done = cycle + tmu_latency;
+          t.store = false;
+        } else {
+          t.loads.push_back(cycle + tmu_latency);
+        }
+      }
+
+      if (t.pc++ == switch_at) break;
+    }
+
+    if (t.pc >= code.size()) {
+      t.done = true;
+      num_done++;
+    }
+
+    // Round-robin to the next thread which has not finished yet
+    for (int i = 1; i <= num_threads; ++i) {
+      int next = (cur + i) % num_threads;
+
+      if (!threads[next].done) {
+        cur = next;
+        break;
+      }
+    }
+  }
+
+  ret.cycles = cycle;
+  return ret;
+}
+
+}  // namespace v3d
+}  // namespace V3DLib
@@ -0,0 +1,29 @@
+#ifndef _LIB_V3D_CYCLEMODEL_H
+#define _LIB_V3D_CYCLEMODEL_H
+#include <vector>
+#include "instr/Instr.h"
+
+namespace V3DLib {
+namespace v3d {
+
+/**
+ * Rough estimate of the cycles a single QPU needs to run a kernel.
+ *
+ * This is meant for comparing the code generated for different thread modes,
+ * not for predicting actual run times. See `estimate_cycles()` for the model.
+ */
+struct CycleEstimate {
+  int num_threads  = 1;
+  int cycles       = 0;  // Total for all threads on the QPU
+  int stall_cycles = 0;  // Cycles the QPU waited on the TMU, included in `cycles`
+
+  int per_instance() const { return cycles/num_threads; }
+};
+
+
+CycleEstimate estimate_cycles(std::vector<instr::Instr> const &code, int num_threads, int tmu_latency = 100);
+
+}  // namespace v3d
+}  // namespace V3DLib
+
+#endif  // _LIB_V3D_CYCLEMODEL_H
@@ -44,6 +44,9 @@ namespace V3DLib {
 namespace v3d {
 
 /**
+ * @param thread       number of batches to run; this is the number of kernel instances
+ * @param num_threads  number of threads per QPU the kernel was compiled for
+ *
  * @return true if execution went well and no timeout,
  *         false otherwise
  *
@@ -55,7 +58,28 @@ namespace v3d {
  *
  * https://github.com/Idein/py-videocore6/blob/master/benchmarks/test_gpu_clock.py
  */
-bool Driver::execute(SharedArray<uint64_t> &code, SharedArray<uint32_t> *uniforms, uint32_t thread) {
+bool Driver::execute(
+  SharedArray<uint64_t> &code,
+  SharedArray<uint32_t> *uniforms,
+  uint32_t thread,
+  int num_threads) {
+  return submit(code, uniforms, thread, num_threads) && wait();
+}
+
+
+/**
+ * Submit a kernel for execution, without waiting for it to finish.
+ *
+ * Jobs submitted to the compute shader queue run in order of submission.
+ * The parameters are the same as for `execute()`.
+ *
+ * @return true if submitted, false otherwise
+ */
+bool Driver::submit(
+  SharedArray<uint64_t> &code,
+  SharedArray<uint32_t> *uniforms,
+  uint32_t thread,
+  int num_threads) {
   uint32_t code_phyaddr = code.getAddress();
   uint32_t unif_phyaddr = (uniforms == nullptr)?0u:uniforms->getAddress();
 
@@ -73,6 +97,16 @@ bool Driver::execute(SharedArray<uint64_t> &code, SharedArray<uint32_t> *uniform
 
   uint32_t wgs_per_sg = 16;         // Has no effect if previous (1, 1, 0)
 
+  // Lower bits of the shader address are flags.
+  // Bit 0 selects 4-thread mode; if not set, the QPU's run in 2-thread mode.
+  // For single-thread mode, there is one batch per QPU.
+  uint32_t const CFG5_THREADING = 1u;
+  uint32_t cfg5 = code_phyaddr;
+
+  if (num_threads == 4) {
+    cfg5 |= CFG5_THREADING;
+  }
+
   st_v3d_submit_csd st = {
     {
       workgroup.wg_x << 16,
@@ -84,7 +118,7 @@ bool Driver::execute(SharedArray<uint64_t> &code, SharedArray<uint32_t> *uniform
         (workgroup.wg_size() & 0xff)
       ),
       thread - 1,           // Number of batches minus 1
-      code_phyaddr,         // Shader address, pnan, singleseg, threading
+      cfg5,                 // Shader address, pnan, singleseg, threading
       unif_phyaddr
     },
     {0,0,0,0},
@@ -94,15 +128,21 @@ bool Driver::execute(SharedArray<uint64_t> &code, SharedArray<uint32_t> *uniform
     0    // out_sync
   };
 
-  uint64_t timeout_ns = 1000000000llu * m_timeout_sec;
-
   bool ret = (0 == v3d_submit_csd(st));
   assert(ret);
-  if (ret) {
-    ret = v3d_wait_bo(m_bo_handles, timeout_ns);
-  }
   return ret;
 }
 
+
+/**
+ * Wait until all submitted jobs using the buffer objects have finished
+ *
+ * @return true if done, false on timeout or error
+ */
+bool Driver::wait() {
+  uint64_t timeout_ns = 1000000000llu * m_timeout_sec;
+  return v3d_wait_bo(m_bo_handles, timeout_ns);
+}
+
 }  // v3d
 }  // V3DLib
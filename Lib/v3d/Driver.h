@@ -26,7 +26,13 @@ public:
 		m_bo_handles.push_back(bo_handle);
 	}
 
-	bool execute(SharedArray<uint64_t> &code, SharedArray<uint32_t> *uniforms = nullptr, uint32_t thread = 1);
+	void clear_bos() { m_bo_handles.clear(); }
+
+	bool execute(SharedArray<uint64_t> &code, SharedArray<uint32_t> *uniforms = nullptr, uint32_t thread = 1,
+	             int num_threads = 1);
+	bool submit(SharedArray<uint64_t> &code, SharedArray<uint32_t> *uniforms = nullptr, uint32_t thread = 1,
+	            int num_threads = 1);
+	bool wait();
 
 private:
 	BoHandles m_bo_handles;
@@ -1,42 +1,160 @@
 #include "Invoke.h"
 #include <stdio.h>
-#include "Driver.h"
 
 
 namespace V3DLib {
 namespace v3d {
 
-void invoke(
-  int numQPUs,
-  SharedArray<uint64_t> &codeMem,
-  int qpuCodeMemOffset,
-  Seq<int32_t> &params) {
+/**
+ * Set the uniforms for an invocation.
+ *
+ * The uniforms are only fully written if the number of QPUs or the number of
+ * parameters changed. Otherwise, only the changed parameters are written.
+ */
+void Launch::set(int numQPUs, Seq<int32_t> const &params) {
+	// The first two slots in uniforms for vc4 are used for qpu number and num qpu's respectively
+	// We do the same for v3d, so as not to screw up the logic too much.
+	int const PARAMS_OFFSET = 2;
 
-	assert(codeMem.size() != 0);
+	if (!m_done.allocated()) {
+		m_done.alloc(1);
+	}
+	m_done[0] = 0;
 
-	SharedArray<uint32_t> unif(params.size() + 3);
-	SharedArray<uint32_t> done(1);
-	done[0] = 0;
+	if (m_unif.allocated() && m_numQPUs == numQPUs && (int) m_params.size() == params.size()) {
+		for (int j = 0; j < params.size(); j++) {
+			if (m_params[j] != params[j]) {
+				m_params[j] = params[j];
+				m_unif[PARAMS_OFFSET + j] = params[j];
+			}
+		}
 
-	// The first two slots in uniforms for vc4 are used for qpu number and num qpu's respectively
-	// We do the same for v3d, so as not to screw up the logic too much.
-	int offset = 0;
+		return;
+	}
 
-	unif[offset++] = 0;        // qpu number (id for current qpu) - 0 is for 1 QPU
-	unif[offset++] = numQPUs;  // num qpu's running for this job
+	if (m_unif.allocated() && m_unif.size() != (uint32_t) (params.size() + 3)) {
+		m_unif.dealloc();
+	}
+
+	if (!m_unif.allocated()) {
+		m_unif.alloc(params.size() + 3);
+	}
+
+	m_numQPUs = numQPUs;
+	m_params.resize(params.size());
+
+	int offset = 0;
+	m_unif[offset++] = 0;        // qpu number (id for current qpu) - 0 is for 1 QPU
+	m_unif[offset++] = numQPUs;  // num qpu's running for this job
 
 	for (int j = 0; j < params.size(); j++) {
-		unif[offset++] = params[j];
+		m_params[j] = params[j];
+		m_unif[offset++] = params[j];
 	}
 
 	// The last item is for the 'done' location;
 	// Not sure if this is the correct slot to put it
 	// TODO: scrutinize the python project for this
-	unif[offset] = (uint32_t) done.getAddress();
+	m_unif[offset] = (uint32_t) m_done.getAddress();
+}
+
+
+/**
+ * Add a kernel invocation.
+ *
+ * The uniforms are set up here; the code memory must stay allocated
+ * until the batch is submitted.
+ */
+void Batch::add(
+  int numQPUs,
+  SharedArray<uint64_t> &codeMem,
+  Seq<int32_t> &params,
+  int num_threads) {
+
+	std::unique_ptr<Launch> launch(new Launch);
+	launch->set(numQPUs, params);
+
+	add(*launch, codeMem, num_threads);
+	m_jobs.back().owned = std::move(launch);
+}
+
+
+/**
+ * Add a kernel invocation with uniforms which have been set already.
+ *
+ * The launch and the code memory must stay allocated until the batch is submitted.
+ */
+void Batch::add(Launch &launch, SharedArray<uint64_t> &codeMem, int num_threads) {
+	assert(codeMem.size() != 0);
+	assert(launch.numQPUs() > 0);
+
+	Job job;
+	job.code        = &codeMem;
+	job.launch      = &launch;
+	job.num_threads = num_threads;
+
+	m_jobs.push_back(std::move(job));
+}
+
+
+/**
+ * Pass the buffer objects of the heap to the driver, if not done already or
+ * if the heap changed since.
+ */
+void Batch::add_bos() {
+	uint32_t generation = heap_generation();
+	if (m_have_bos && generation == m_generation) return;
+
+	m_drv.clear_bos();
+	for (auto *bo : heap_buffer_objects(getBufferObject())) {
+		m_drv.add_bo(*bo);
+	}
+
+	m_have_bos   = true;
+	m_generation = generation;
+}
+
+
+/**
+ * Submit all invocations as consecutive jobs, and wait until the last one is done.
+ *
+ * Afterwards, the batch is empty.
+ *
+ * @return true if all jobs ran, false otherwise
+ */
+bool Batch::submit() {
+	if (m_jobs.empty()) return true;
+
+	add_bos();
+
+	bool ret = true;
+	for (auto &job : m_jobs) {
+		auto &launch = *job.launch;
+
+		if (!m_drv.submit(*job.code, &launch.uniforms(), launch.numQPUs(), job.num_threads)) {
+			ret = false;
+			break;
+		}
+	}
+
+	// Also wait after a failed submit, for the jobs already submitted
+	ret = m_drv.wait() && ret;
+
+	m_jobs.clear();
+	return ret;
+}
+
+
+void invoke(
+  int numQPUs,
+  SharedArray<uint64_t> &codeMem,
+  int qpuCodeMemOffset,
+  Seq<int32_t> &params,
+  int num_threads) {
 
-  Driver drv;
-	drv.add_bo(getBufferObject());
-	drv.execute(codeMem, &unif, numQPUs);
+	Batch batch;
+	batch.add(numQPUs, codeMem, params, num_threads);
+	batch.submit();
 }
 
 }  // v3d
@@ -1,16 +1,78 @@
 #ifndef _V3DLIB_V3D_INVOKE_H
 #define _V3DLIB_V3D_INVOKE_H
+#include <memory>
+#include <vector>
 #include "Common/SharedArray.h"
 #include "Common/Seq.h"
+#include "Driver.h"
 
 namespace V3DLib {
 namespace v3d {
 
+/**
+ * Uniforms and 'done' location for invoking a kernel.
+ *
+ * Instances can be reused over invocations. Only the parameters which changed
+ * since the previous invocation are written to the uniforms.
+ */
+class Launch {
+public:
+  void set(int numQPUs, Seq<int32_t> const &params);
+
+  int numQPUs() const { return m_numQPUs; }
+  SharedArray<uint32_t> &uniforms() { return m_unif; }
+
+private:
+  SharedArray<uint32_t> m_unif;
+  SharedArray<uint32_t> m_done;
+  std::vector<int32_t>  m_params;    // Parameters currently in the uniforms
+  int                   m_numQPUs = 0;
+};
+
+
+/**
+ * Collects kernel invocations, for submitting them together.
+ *
+ * The invocations run in order of addition.
+ *
+ * A batch can be submitted multiple times. The list of buffer objects is only
+ * retrieved again if the heap changed.
+ */
+class Batch {
+public:
+  void add(
+    int numQPUs,
+    SharedArray<uint64_t> &codeMem,
+    Seq<int32_t> &params,
+    int num_threads = 1);
+  void add(Launch &launch, SharedArray<uint64_t> &codeMem, int num_threads = 1);
+
+  bool empty() const { return m_jobs.empty(); }
+  bool submit();
+
+private:
+  struct Job {
+    SharedArray<uint64_t>  *code   = nullptr;
+    Launch                 *launch = nullptr;
+    std::unique_ptr<Launch> owned;             // Set if the launch is not passed in
+    int                     num_threads = 1;
+  };
+
+  std::vector<Job> m_jobs;
+  Driver           m_drv;
+  bool             m_have_bos   = false;
+  uint32_t         m_generation = 0;       // Heap generation of the buffer objects in m_drv
+
+  void add_bos();
+};
+
+
 void invoke(
   int numQPUs,
   SharedArray<uint64_t> &codeMem,
   int qpuCodeMemOffset,
-  Seq<int32_t> &params);
+  Seq<int32_t> &params,
+  int num_threads = 1);
 
 }  // v3d
 }  // V3DLib
@@ -2,10 +2,14 @@
 
 #include "KernelDriver.h"
 #include <memory>
+#include <set>
+#include <tuple>              // std::tie()
 #include "Source/Translate.h"
 #include "Target/SmallLiteral.h"  // decodeSmallLit()
 #include "Target/RemoveLabels.h"
+#include "Target/Liveness.h"      // useDefReg()
 #include "Invoke.h"
+#include "CycleModel.h"
 #include "instr/Snippets.h"
 #include "Support/basics.h"
 #include "SourceTranslate.h"
@@ -549,7 +553,7 @@ bool translateRotate(V3DLib::Instr const &instr, Instructions &ret) {
 }
 
 
-Instructions encodeLoadImmediate(V3DLib::Instr const full_instr) {
+Instructions encodeLoadImmediate(V3DLib::Instr const &full_instr) {
   assert(full_instr.tag == LI);
   auto &instr = full_instr.LI;
   auto dst = encodeDestReg(full_instr);
@@ -650,7 +654,7 @@ Instructions encodeLoadImmediate(V3DLib::Instr const full_instr) {
 }
 
 
-Instructions encodeALUOp(V3DLib::Instr instr) {
+Instructions encodeALUOp(V3DLib::Instr const &instr) {
   Instructions ret;
 
   if (instr.isUniformLoad()) {
@@ -720,7 +724,7 @@ void encodeBranchCondition(v3d::instr::Instr &dst_instr, V3DLib::BranchCond src_
  * Create a branch instruction, including any branch conditions,
  * from Target source instruction.
  */
-v3d::instr::Instr encodeBranchLabel(V3DLib::Instr src_instr) {
+v3d::instr::Instr encodeBranchLabel(V3DLib::Instr const &src_instr) {
   assert(src_instr.tag == BRL);
   auto &instr = src_instr.BRL;
 
@@ -738,7 +742,7 @@ v3d::instr::Instr encodeBranchLabel(V3DLib::Instr src_instr) {
  *
  * **Pre:** All instructions not meant for v3d are detected beforehand and flagged as error.
  */
-Instructions encodeInstr(V3DLib::Instr instr) {
+Instructions encodeInstr(V3DLib::Instr const &instr) {
   Instructions ret;
   bool no_output = false;
 
@@ -863,7 +867,7 @@ bool checkUniformAtTop(Seq<V3DLib::Instr> &instrs) {
   bool doing_top = true;
 
   for (int i = 0; i < instrs.size(); i++) {
-    V3DLib::Instr instr = instrs[i];
+    V3DLib::Instr const &instr = instrs[i];
     if (doing_top) {
       if (instr.isUniformLoad()) {
         continue;  // as expected
@@ -883,17 +887,107 @@ bool checkUniformAtTop(Seq<V3DLib::Instr> &instrs) {
 }
 
 
+bool is_tmu_request(V3DLib::Instr const &instr) {
+  return instr.tag == ALU && instr.ALU.dest.tag == SPECIAL && instr.ALU.dest.regId == SPECIAL_TMU0_S;
+}
+
+
+/**
+ * Check if a thread switch can be done before the instruction with the given index.
+ *
+ * The accumulators and the condition flags are not preserved over a thread switch.
+ * The switch is therefore only safe if, on all code paths from the instruction,
+ * the flags and every accumulator are written before being read.
+ */
+bool can_switch_thread(Seq<V3DLib::Instr> const &instrs, int index) {
+  struct State {
+    int      index;
+    uint32_t accs_written;   // Bit per accumulator
+    bool     flags_written;
+
+    bool operator<(State const &rhs) const {
+      return std::tie(index, accs_written, flags_written)
+           < std::tie(rhs.index, rhs.accs_written, rhs.flags_written);
+    }
+  };
+
+  std::map<Label, int> labels;  // Index of instruction per label
+  for (int i = 0; i < instrs.size(); i++) {
+    if (instrs[i].tag == LAB) labels[instrs[i].label()] = i;
+  }
+
+  std::set<State> visited;
+  std::vector<State> todo = {{index, 0, false}};
+  UseDefReg useDef;
+
+  while (!todo.empty()) {
+    State state = todo.back();
+    todo.pop_back();
+
+    if (state.index >= instrs.size()) continue;  // End of program
+    if (!visited.insert(state).second) continue;
+
+    V3DLib::Instr const &instr = instrs[state.index];
+    if (instr.tag == END) continue;
+
+    bool reads_flags = instr.isCondAssign()
+                    || (instr.tag == BRL && (instr.BRL.cond.tag == COND_ALL || instr.BRL.cond.tag == COND_ANY));
+    if (reads_flags && !state.flags_written) return false;
+
+    useDefReg(instr, &useDef);
+
+    for (int i = 0; i < useDef.use.size(); i++) {
+      Reg r = useDef.use[i];
+      if (r.tag == ACC && !(state.accs_written & (1u << r.regId))) return false;
+    }
+
+    if (!instr.isCondAssign()) {
+      for (int i = 0; i < useDef.def.size(); i++) {
+        Reg r = useDef.def[i];
+        if (r.tag == ACC) state.accs_written |= (1u << r.regId);
+      }
+    }
+
+    if (instr.tag == TMU0_TO_ACC4) {
+      state.accs_written |= (1u << 4);
+    }
+
+    if ((instr.tag == LI || instr.tag == ALU) && instr.setCond().flags_set()) {
+      state.flags_written = true;
+    }
+
+    if (instr.tag == BRL) {
+      assert(labels.count(instr.BRL.label) == 1);
+      todo.push_back({labels[instr.BRL.label], state.accs_written, state.flags_written});
+      if (instr.BRL.cond.tag == COND_ALWAYS) continue;
+    }
+
+    todo.push_back({state.index + 1, state.accs_written, state.flags_written});
+  }
+
+  return true;
+}
+
+
 /**
  * Translate instructions from target to v3d
+ *
+ * For multiple threads per QPU, a thread switch is inserted before the first TMU
+ * load after a series of TMU requests. Another thread can then run while the load
+ * is outstanding.
+ *
+ * The switch is skipped if accumulators or condition flags are live at that point,
+ * e.g. for a load within a `Where`-block.
  */
-void _encode(uint8_t numQPUs, Seq<V3DLib::Instr> &instrs, Instructions &instructions) {
+void _encode(uint8_t numQPUs, int num_threads, Seq<V3DLib::Instr> &instrs, Instructions &instructions) {
   assert(checkUniformAtTop(instrs));
   bool prev_was_init_begin = false;
   bool prev_was_init_end    = false;
+  bool tmu_requested        = false;
 
   // Main loop
   for (int i = 0; i < instrs.size(); i++) {
-    V3DLib::Instr instr = instrs[i];
+    V3DLib::Instr const &instr = instrs[i];
     assertq(!instr.isZero(), "Zero instruction encountered", true);
     check_instruction_tag_for_platform(instr.tag, false);
 
@@ -905,6 +999,19 @@ void _encode(uint8_t numQPUs, Seq<V3DLib::Instr> &instrs, Instructions &instruct
     } else {
       auto ret = v3d::encodeInstr(instr);
 
+      if (num_threads > 1) {
+        if (is_tmu_request(instr)) {
+          tmu_requested = true;
+        } else if (instr.tag == TMU0_TO_ACC4 && tmu_requested) {
+          if (can_switch_thread(instrs, i)) {
+            auto sw = thread_switch();
+            ret.insert(ret.begin(), sw.begin(), sw.end());
+          }
+
+          tmu_requested = false;
+        }
+      }
+
       if (prev_was_init_begin) {
         ret.front().header("Init block");
         prev_was_init_begin = false;
@@ -936,21 +1043,31 @@ KernelDriver::KernelDriver() : V3DLib::KernelDriver(V3dBuffer) {}
 void KernelDriver::compile_init() {
   Parent::init_compile();
   Platform::compiling_for_vc4(false);
+  m_num_threads = Platform::instance().v3d_threads();
 }
 
 
 void KernelDriver::encode(int numQPUs) {
   if (instructions.size() > 0) return;  // Don't bother if already encoded
 
-  if (numQPUs != 1 && numQPUs != 8) {
-    errors << "Num QPU's must be 1 or 8";
+  int max_qpus = 8*m_num_threads;  // One kernel instance per thread
+
+  if (numQPUs != 1 && numQPUs != max_qpus) {
+    std::string buf;
+    buf << "Num QPU's must be 1 or " << max_qpus;
+    errors << buf;
     return;
   }
   local_numQPUs = (uint8_t) numQPUs;
 
   // Encode target instructions
-  _encode((uint8_t) numQPUs, m_targetCode, instructions);
-  removeLabels(instructions);
+  m_stats.start("encode", m_targetCode.size());
+  _encode((uint8_t) numQPUs, m_num_threads, m_targetCode, instructions);
+  m_stats.stop((int) instructions.size());
+
+  m_stats.measure("removeLabels", instructions, [this] {
+    removeLabels(instructions);
+  });
 
   if (!local_errors.empty()) {
     breakpoint
@@ -979,18 +1096,67 @@ std::vector<uint64_t> KernelDriver::to_opcodes() {
 
 void KernelDriver::compile_intern() {
   obtain_ast();
-  translate_stmt(m_targetCode, m_body);
-  insertInitBlock(m_targetCode);
-  add_init(m_targetCode);
-  compile_postprocess(m_targetCode);
+
+  // The original statements are retained for the interpreter
+  Stmt::Ptr body = convert_ifs(m_body);
+
+  m_stats.measure("translate_stmt", m_targetCode, [this, &body] {
+    translate_stmt(m_targetCode, body);
+  });
+
+  m_stats.measure("insertInitBlock", m_targetCode, [this] {
+    insertInitBlock(m_targetCode);
+    add_init(m_targetCode);
+  });
+
+  compile_postprocess(m_targetCode, m_stats);
 
   // The translation/removal op labels happens in `v3d::KernelDriver::to_opcodes()` 
 }
 
 
+/**
+ * Run the kernel and wait until it is done.
+ *
+ * The uniforms are kept per number of QPUs, so that consecutive invocations
+ * only need to write the changed parameters.
+ */
 void KernelDriver::invoke_intern(int numQPUs, Seq<int32_t> *params) {
   assert(params != nullptr);
 
+  load_code();
+
+  auto &launch = m_launches[std::make_pair(numQPUs, 0)];
+  launch.set(numQPUs, *params);
+
+  m_batch.add(launch, qpuCodeMem, m_num_threads);
+  m_batch.submit();
+}
+
+
+/**
+ * Add an invocation of the kernel to a batch, for submitting later on.
+ *
+ * As with `invoke_intern()`, the uniforms are reused over submits. A kernel can
+ * be in a batch multiple times, each invocation then needs its own uniforms.
+ *
+ * @param index  index of this invocation among the invocations of the kernel in the batch
+ */
+void KernelDriver::enqueue(int numQPUs, Seq<int32_t> &params, Batch &batch, int index) {
+  prepare(numQPUs);
+  load_code();
+
+  auto &launch = m_launches[std::make_pair(numQPUs, index)];
+  launch.set(numQPUs, params);
+
+  batch.add(launch, qpuCodeMem, m_num_threads);
+}
+
+
+/**
+ * Copy the opcodes to the code memory, if not done already
+ */
+void KernelDriver::load_code() {
   // Assumption: code in a kernel, once allocated, doesn't change
   if (qpuCodeMem.allocated()) {
     assert(instructions.size() > 0);
@@ -1014,8 +1180,6 @@ void KernelDriver::invoke_intern(int numQPUs, Seq<int32_t> *params) {
   } else {
     paramMem.alloc(numWords);
   }
-
-  v3d::invoke(numQPUs, qpuCodeMem, qpuCodeMemOffset, *params);
 }
 
 
@@ -1029,6 +1193,10 @@ void KernelDriver::emit_opcodes(FILE *f) {
     for (auto const &instr : instructions) {
       fprintf(f, "%s\n", instr.mnemonic(true).c_str());
     }
+
+    auto est = estimate_cycles(instructions, m_num_threads);
+    fprintf(f, "\nEstimated cycles per QPU with %d thread(s): %d, of which %d waiting on the TMU\n",
+      est.num_threads, est.cycles, est.stall_cycles);
   }
 
   fprintf(f, "\n");
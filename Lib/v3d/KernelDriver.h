@@ -1,8 +1,11 @@
 #ifndef _LIB_V3D_KERNELDRIVER_H
 #define _LIB_V3D_KERNELDRIVER_H
+#include <map>
+#include <utility>  // std::pair
 #include "../KernelDriver.h"
 #include "Common/SharedArray.h"
 #include "instr/Instr.h"
+#include "Invoke.h"
 
 #ifdef QPU_MODE
 
@@ -19,14 +22,21 @@ public:
 
   void compile_init();
   void encode(int numQPUs) override;
+  void enqueue(int numQPUs, Seq<int32_t> &params, Batch &batch, int index = 0);
 
 private:
   SharedArray<uint64_t> qpuCodeMem;
   SharedArray<uint32_t> paramMem;
   Instructions          instructions;
+  int                   m_num_threads = 1;  // Number of threads per QPU compiled for
+  Batch                 m_batch;            // Reused over invocations
+
+  // Uniforms per number of QPUs and index of the invocation in a batch, reused over invocations
+  std::map<std::pair<int, int>, Launch> m_launches;
 
   void compile_intern() override;
   void invoke_intern(int numQPUs, Seq<int32_t>* params) override;
+  void load_code();
 
   std::vector<uint64_t> to_opcodes();
   void emit_opcodes(FILE *f) override;
@@ -1,5 +1,6 @@
 #include "SourceTranslate.h"
 #include "Support/basics.h"
+#include "Support/Platform.h"
 #include "Source/Translate.h"  // srcReg()
 #include "Source/Stmt.h"  // srcReg()
 #include "Target/Liveness.h"
@@ -157,7 +158,7 @@ void SourceTranslate::regAlloc(CFG* cfg, Seq<Instr>* instrs) {
       buf << i << ": " << (*instrs)[i].mnemonic();
       error(buf, true);
     } else {
-      alloc[i].regId = regId;
+      alloc[i].regId = (uint16_t) regId;
     }
   }
 
@@ -205,7 +206,7 @@ void add_init(Seq<Instr> &code) {
   //
   // Broadly:
   //
-  // If (numQPUs() == 8)  // Alternative is 1, then qpu num initalized to 0 is ok
+  // If (numQPUs() != 1)  // Alternative is 1, then qpu num initalized to 0 is ok
   //   me() = (thread_index() >> 2) & 0b1111;
   // End
   //
@@ -213,14 +214,28 @@ void add_init(Seq<Instr> &code) {
   // threads. It's probably also the reason why you can select only 1 or 8 (max)
   // threads, otherwise there would be gaps in the qpu id.
   //
+  // With multiple threads per QPU, the thread index is taken to be `4*qpu + thread`.
+  // Each thread then runs a separate kernel instance:
+  //
+  //   me() = ((thread_index() >> 2) & 0b1111)*num_threads + (thread_index() & (num_threads - 1));
+  //
+  int num_threads = Platform::instance().v3d_threads();
+
   ret << mov(rf(RSV_QPU_ID), 0)           // not needed, already init'd to 0. Left here to counter future brainfarts
-      << sub(ACC0, rf(RSV_NUM_QPUS), 8).pushz()
-      << branch(endifLabel).allzc()       // nop()'s added downstream
+      << sub(ACC0, rf(RSV_NUM_QPUS), 1).pushz()
+      << branch(endifLabel).allzs()       // nop()'s added downstream
       << mov(ACC0, QPU_ID)
       << shr(ACC0, ACC0, 2)
-      << band(rf(RSV_QPU_ID), ACC0, 15)
-      << label(endifLabel)
-  ;
+      << band(rf(RSV_QPU_ID), ACC0, 15);
+
+  if (num_threads > 1) {
+    ret << shl(rf(RSV_QPU_ID), rf(RSV_QPU_ID), (num_threads == 4)? 2 : 1)
+        << mov(ACC0, QPU_ID)
+        << band(ACC0, ACC0, num_threads - 1)
+        << bor(rf(RSV_QPU_ID), rf(RSV_QPU_ID), ACC0);
+  }
+
+  ret << label(endifLabel);
 
   // offset = 4 * (thread_num + 16 * qpu_num);
   ret << shl(ACC1, rf(RSV_QPU_ID), 4) // Avoid ACC0 here, it's used for getting QPU_ID and ELEM_ID (next stmt)
@@ -242,6 +257,10 @@ bool SourceTranslate::stmt(Seq<Instr> &seq, Stmt::Ptr s) {
       storeRequest(seq, s->storeReq_data(), s->storeReq_addr());
       return true;
 
+    case TMU_WRITE_WAIT:
+      seq << Target::instr::tmuwt();
+      return true;
+
     case SET_READ_STRIDE:
     case SET_WRITE_STRIDE:
     case SEMA_INC:
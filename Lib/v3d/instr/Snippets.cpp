@@ -146,6 +146,25 @@ Instructions enable_tmu_read(Instr const *last_slot) {
 }
 
 
+/**
+ * Switch to another thread on the QPU while a TMU load is outstanding.
+ *
+ * The thread switch takes effect after the two delay slots.
+ * The accumulators are not preserved over a thread switch; the caller must
+ * ensure that none are live at this point.
+ */
+Instructions thread_switch() {
+	Instructions ret;
+
+	ret << nop().thrsw()
+	    << nop()
+	    << nop();
+
+	ret.front().comment("Thread switch while waiting for TMU");
+	return ret;
+}
+
+
 Instructions sync_tmu() {
 	Instructions ret;
 
@@ -16,6 +16,7 @@ Instructions get_num_qpus(Register const &reg, uint8_t num_qpus);
 Instructions calc_offset( uint8_t num_qpus, uint8_t reg_qpu_num);
 Instructions calc_stride( uint8_t num_qpus, uint8_t reg_stride);
 Instructions enable_tmu_read(Instr const *last_slot = nullptr);
+Instructions thread_switch();
 Instructions sync_tmu();
 Instructions end_program();
 
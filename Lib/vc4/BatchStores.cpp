@@ -0,0 +1,540 @@
+#include "BatchStores.h"
+#include <algorithm>  // std::find()
+#include <map>
+#include <vector>
+#include "Support/basics.h"
+
+namespace V3DLib {
+namespace vc4 {
+namespace {
+
+/**
+ * Number of VPM blocks of 16 rows which can be addressed with vertical writes.
+ *
+ * Within these blocks, each QPU uses its own column, as `StoreRequest()` does.
+ * Block 0 is used by the DMA loads of `SourceTranslate::varassign_deref_var()`.
+ */
+int const NUM_VPM_BLOCKS = 4;
+
+
+Expr::Ptr qpu_num() { return mkVar(Var(QPU_NUM)); }
+
+Expr::Ptr add(Expr::Ptr a, Expr::Ptr b) { return mkApply(a, Op(ADD, INT32), b); }
+Expr::Ptr sub(Expr::Ptr a, Expr::Ptr b) { return mkApply(a, Op(SUB, INT32), b); }
+Expr::Ptr shl(Expr::Ptr a, int n)       { return mkApply(a, Op(SHL, INT32), mkIntLit(n)); }
+
+
+bool is_int_apply(Expr::Ptr e, OpId op) {
+  return e->tag() == Expr::APPLY && e->apply_op.op == op && e->apply_op.type == INT32;
+}
+
+
+bool is_int_lit(Expr::Ptr e, int val) {
+  return e->tag() == Expr::INT_LIT && e->intLit == val;
+}
+
+
+Stmt::Ptr cond_stmt(Var v, int val, Stmt::Ptr then_stmt) {
+  auto cond = std::make_shared<BExpr>(mkVar(v), CmpOp(CmpOp::EQ, INT32), mkIntLit(val));
+  return Stmt::mkIf(mkAny(cond), then_stmt, nullptr);
+}
+
+
+/**
+ * Memory address of the form `base + (var << 2)` or `var`, with `var` increased
+ * by one vector in each loop iteration.
+ */
+struct Address {
+  Expr::Ptr addr;
+  Expr::Ptr base;  // `base` for the first form, `var` for the second
+  Var var = Var(DUMMY);
+  int step = 0;    // Increment of `var` per iteration
+
+  /**
+   * Get the address of the vector which was stored `n` iterations ago
+   */
+  Expr::Ptr previous(int n) const {
+    return subst(addr, var, sub(mkVar(var), mkIntLit(n*step)));
+  }
+};
+
+
+/**
+ * A store within the loop, with the VPM rows used to collect its vectors
+ */
+struct Batch {
+  Stmt::Ptr store;
+  Address   address;
+  int       first_block;
+};
+
+
+/**
+ * Determines if the stores in a loop can be batched.
+ *
+ * This is the case if all stores in the loop body are at the top level and write
+ * to consecutive vectors in each iteration. Loads in the body may not read memory
+ * written in previous iterations, because the data may not have been written yet.
+ *
+ * It is assumed, as for the pipelining of loads, that memory accessed via
+ * different base pointers does not overlap.
+ */
+class LoopAnalysis {
+public:
+  LoopAnalysis(Stmt const &loop);
+
+  bool ok() const { return m_ok; }
+  Stmt::Ptr rewrite(Stmt const &loop);
+
+private:
+  struct Inc {
+    int step;
+    int index;  // Position of the increment in the top-level statements
+  };
+
+  bool m_ok = false;
+  std::vector<Stmt::Ptr>  m_stmts;         // Top-level statements of the body
+  std::map<VarId, int>    m_assigned;      // Number of assignments per variable in the body
+  std::map<VarId, Inc>    m_incs;          // Variables increased by a constant in the body
+  std::vector<Address>    m_loads;
+  std::vector<Address>    m_stores;
+  std::vector<Stmt::Ptr>  m_store_stmts;
+  std::vector<Expr::Ptr>  m_gather_bases;  // Bases of TMU loads of the current vector
+  int m_batch_size = 0;                    // Number of vectors to collect before writing
+
+  void count_assigns(Stmt::Ptr s);
+  void find_incs();
+  bool hoistable(Expr::Ptr e) const;
+  bool match(Expr::Ptr addr, int index, Address &out) const;
+  bool scan(Stmt::Ptr s, bool nested);
+  bool scan_gather(Expr::Ptr addr);
+  bool check_overlap() const;
+  Stmt::Ptr flush(std::vector<Batch> const &batches, int n) const;
+};
+
+
+LoopAnalysis::LoopAnalysis(Stmt const &loop) {
+  assert(loop.tag == WHILE);
+  if (loop.body_is_null()) return;
+
+  flatten(loop.body(), m_stmts);
+  count_assigns(loop.body());
+  find_incs();
+
+  for (auto const &s : m_stmts) {
+    if (!scan(s, false)) return;
+  }
+
+  if (m_stores.empty() || !check_overlap()) return;
+
+  // Block 0 is only available if there are no DMA loads in the loop
+  int num_blocks = NUM_VPM_BLOCKS - (m_loads.empty()? 0 : 1);
+  m_batch_size = num_blocks/((int) m_stores.size());
+
+  m_ok = (m_batch_size >= 2);
+}
+
+
+void LoopAnalysis::count_assigns(Stmt::Ptr s) {
+  if (s.get() == nullptr) return;
+
+  switch (s->tag) {
+    case SEQ:
+      count_assigns(s->seq_s0());
+      count_assigns(s->seq_s1());
+      break;
+    case ASSIGN: {
+      Expr::Ptr lhs = s->assign_lhs();
+      if (lhs->tag() == Expr::VAR && lhs->var().tag() == STANDARD) {
+        m_assigned[lhs->var().id()]++;
+      }
+      break;
+    }
+    case IF:
+    case WHERE:
+      count_assigns(s->thenStmt());
+      count_assigns(s->elseStmt());
+      break;
+    case WHILE:
+      count_assigns(s->body());
+      break;
+    default:
+      break;
+  }
+}
+
+
+/**
+ * Find the top-level statements of the form `v = v + c`, with `v` not assigned elsewhere
+ */
+void LoopAnalysis::find_incs() {
+  for (int i = 0; i < (int) m_stmts.size(); i++) {
+    auto const &s = m_stmts[i];
+    if (s->tag != ASSIGN) continue;
+
+    Expr::Ptr lhs = s->assign_lhs();
+    Expr::Ptr rhs = s->assign_rhs();
+    if (lhs->tag() != Expr::VAR || lhs->var().tag() != STANDARD) continue;
+    if (!is_int_apply(rhs, ADD) || rhs->rhs()->tag() != Expr::INT_LIT) continue;
+    if (rhs->lhs()->tag() != Expr::VAR || !same_var(rhs->lhs()->var(), lhs->var())) continue;
+
+    VarId id = lhs->var().id();
+    if (m_assigned[id] != 1) continue;
+
+    m_incs[id] = { rhs->rhs()->intLit, i };
+  }
+}
+
+
+/**
+ * Check if given expression has the same value in all iterations
+ */
+bool LoopAnalysis::hoistable(Expr::Ptr e) const {
+  switch (e->tag()) {
+    case Expr::INT_LIT:
+    case Expr::FLOAT_LIT:
+      return true;
+    case Expr::VAR:
+      switch (e->var().tag()) {
+        case STANDARD: return m_assigned.count(e->var().id()) == 0;
+        case QPU_NUM:
+        case ELEM_NUM: return true;
+        default:       return false;  // Reading has side effects
+      }
+    case Expr::APPLY:
+      return hoistable(e->lhs()) && hoistable(e->rhs());
+    case Expr::DEREF:
+      return false;
+  }
+
+  return false;
+}
+
+
+/**
+ * Check if the address refers to the next vector in each iteration.
+ *
+ * @param index position of the memory access in the top-level statements.
+ *              The variable must be increased after this position.
+ */
+bool LoopAnalysis::match(Expr::Ptr addr, int index, Address &out) const {
+  out.addr = addr;
+
+  if (addr->tag() == Expr::VAR && addr->var().tag() == STANDARD) {
+    // Form `p`, with `p = p + 16` for Ptr p
+    out.base = addr;
+    out.var  = addr->var();
+    out.step = 16*4;
+  } else if (is_int_apply(addr, ADD) && is_int_apply(addr->rhs(), SHL)) {
+    // Form `base + (i << 2)`, i.e. `base[i]`, with `i = i + 16`
+    Expr::Ptr offset = addr->rhs();
+    if (offset->lhs()->tag() != Expr::VAR || !is_int_lit(offset->rhs(), 2)) return false;
+    if (!hoistable(addr->lhs())) return false;
+
+    out.base = addr->lhs();
+    out.var  = offset->lhs()->var();
+    out.step = 16;
+  } else {
+    return false;
+  }
+
+  auto it = m_incs.find(out.var.id());
+  if (out.var.tag() != STANDARD || it == m_incs.end()) return false;
+
+  return it->second.step == out.step && it->second.index > index;
+}
+
+
+/**
+ * Check a TMU load, as issued by the pipelining of loads.
+ *
+ * Only loads of the current or a later vector are accepted.
+ */
+bool LoopAnalysis::scan_gather(Expr::Ptr addr) {
+  // Strip the lane offset
+  if (is_int_apply(addr, ADD) && is_int_apply(addr->rhs(), SHL)) {
+    Expr::Ptr offset = addr->rhs();
+    if (offset->lhs()->tag() == Expr::VAR && offset->lhs()->var().tag() == ELEM_NUM) {
+      addr = addr->lhs();
+    }
+  }
+
+  if (!is_int_apply(addr, ADD) || !is_int_apply(addr->rhs(), SHL)) return false;
+  if (!is_int_lit(addr->rhs()->rhs(), 2) || !hoistable(addr->lhs())) return false;
+
+  Expr::Ptr ind = addr->rhs()->lhs();
+  int c = 0;
+
+  if (is_int_apply(ind, ADD) && ind->rhs()->tag() == Expr::INT_LIT) {
+    c   = ind->rhs()->intLit;
+    ind = ind->lhs();
+  }
+
+  if (ind->tag() != Expr::VAR || ind->var().tag() != STANDARD || c < 0) return false;
+
+  auto it = m_incs.find(ind->var().id());
+  if (it == m_incs.end() || it->second.step != 16) return false;
+
+  if (c < 16) {
+    m_gather_bases.push_back(addr->lhs());
+  }
+
+  return true;
+}
+
+
+bool LoopAnalysis::scan(Stmt::Ptr s, bool nested) {
+  if (s.get() == nullptr) return true;
+
+  switch (s->tag) {
+    case SKIP:
+    case LOAD_RECEIVE:
+      return true;
+    case SEQ:
+      return scan(s->seq_s0(), nested) && scan(s->seq_s1(), nested);
+    case IF:
+      return !has_deref(s->if_cond()->bexpr()) && scan(s->thenStmt(), true) && scan(s->elseStmt(), true);
+    case WHERE:
+      return !has_deref(s->where_cond()) && scan(s->thenStmt(), true) && scan(s->elseStmt(), true);
+    case PRINT:
+      return s->print.tag() == PRINT_STR || !has_deref(s->print_expr());
+    case ASSIGN:
+      break;
+    default:
+      // Nested loops, and explicit DMA, VPM and semaphore operations
+      return false;
+  }
+
+  Expr::Ptr lhs = s->assign_lhs();
+  Expr::Ptr rhs = s->assign_rhs();
+  int index = (int) (std::find(m_stmts.begin(), m_stmts.end(), s) - m_stmts.begin());
+
+  if (lhs->tag() == Expr::DEREF) {  // Store
+    Address address;
+    if (nested || has_deref(rhs) || !match(lhs->deref_ptr(), index, address)) return false;
+
+    m_stores.push_back(address);
+    m_store_stmts.push_back(s);
+    return true;
+  }
+
+  assert(lhs->tag() == Expr::VAR);
+
+  switch (lhs->var().tag()) {
+    case STANDARD:
+      break;
+    case TMU0_ADDR:
+      return !has_deref(rhs) && scan_gather(rhs);
+    default:
+      return false;  // Notably, a VPM write
+  }
+
+  if (rhs->tag() == Expr::DEREF) {  // Load
+    Address address;
+
+    // A load after a store could read a value which is not written yet
+    if (nested || !m_stores.empty() || !match(rhs->deref_ptr(), index, address)) return false;
+
+    m_loads.push_back(address);
+    return true;
+  }
+
+  return !has_deref(rhs);
+}
+
+
+/**
+ * Check that loads do not read the memory written by the stores.
+ *
+ * Loads and stores via the same base pointer must be to the same address.
+ * The loads come before the stores in the body, so this reads the original values.
+ */
+bool LoopAnalysis::check_overlap() const {
+  for (auto const &store : m_stores) {
+    for (auto const &load : m_loads) {
+      if (equal(load.base, store.base) && !equal(load.addr, store.addr)) return false;
+    }
+
+    for (auto const &base : m_gather_bases) {
+      if (equal(base, store.base)) return false;
+    }
+  }
+
+  return true;
+}
+
+
+/**
+ * Write the first `n` vectors of the VPM rows of each batch to main memory
+ */
+Stmt::Ptr LoopAnalysis::flush(std::vector<Batch> const &batches, int n) const {
+  std::vector<Stmt::Ptr> ret;
+
+  ret.push_back(Stmt::create(SET_WRITE_STRIDE, mkIntLit(0), nullptr));
+
+  for (auto const &batch : batches) {
+    Var addr = freshVar();
+    ret.push_back(Stmt::create_assign(mkVar(addr), batch.address.previous(n)));
+
+    // Horizontal DMA of 16*n rows of 1 word, i.e. the column of the current QPU
+    Expr::Ptr vpm_addr = add(mkIntLit(16*16*batch.first_block), qpu_num());
+    Stmt::Ptr setup = Stmt::create(SETUP_DMA_WRITE, vpm_addr, nullptr);
+    setup->setupDMAWrite.hor     = 1;
+    setup->setupDMAWrite.numRows = 16*n;
+    setup->setupDMAWrite.rowLen  = 1;
+
+    ret.push_back(setup);
+    ret.push_back(Stmt::create(DMA_START_WRITE, mkVar(addr), nullptr));
+    ret.push_back(Stmt::create(DMA_WRITE_WAIT));
+  }
+
+  ret.front()->comment("Write batch of stores");
+  return sequence(ret);
+}
+
+
+/**
+ * Replace the stores in the loop with writes to VPM.
+ *
+ * The vectors are collected per store in the VPM, and written to main memory
+ * with a single DMA when the batch is full, and after the loop for the remainder:
+ *
+ *     dmaWaitWrite()             // Outstanding stores may use the same VPM rows
+ *     count = 0
+ *     While (cond)
+ *       ...
+ *       vpmSetupWrite(VERT, ((first_block + count) << 4) + qpu_num)
+ *       vpmPut(v)                // Replaces `*addr = v`
+ *       ...
+ *       count = count + 1
+ *       If (count == batch_size)
+ *         (DMA write of batch_size vectors)
+ *         count = 0
+ *       End
+ *     End
+ *     If (count == 1)
+ *       (DMA write of 1 vector)
+ *     End
+ *     ...                        // Up to `batch_size - 1`
+ *
+ * Note that the variable of each address has been increased `count` times since
+ * the start of the batch, which determines the address for the DMA.
+ */
+Stmt::Ptr LoopAnalysis::rewrite(Stmt const &loop) {
+  assert(m_ok);
+
+  Var count = freshVar();
+  std::vector<Batch> batches;
+  int first_block = NUM_VPM_BLOCKS - m_batch_size*((int) m_stores.size());
+
+  for (int i = 0; i < (int) m_stores.size(); i++) {
+    batches.push_back({m_store_stmts[i], m_stores[i], first_block + i*m_batch_size});
+  }
+
+  // New loop body
+  std::vector<Stmt::Ptr> body;
+
+  for (auto const &s : m_stmts) {
+    auto it = std::find(m_store_stmts.begin(), m_store_stmts.end(), s);
+
+    if (it == m_store_stmts.end()) {
+      body.push_back(s);
+      continue;
+    }
+
+    Batch const &batch = batches[it - m_store_stmts.begin()];
+    Expr::Ptr vpm_addr = add(shl(add(mkIntLit(batch.first_block), mkVar(count)), 4), qpu_num());
+    Stmt::Ptr setup = Stmt::create(SETUP_VPM_WRITE, vpm_addr, nullptr);
+    setup->setupVPMWrite.hor    = 0;
+    setup->setupVPMWrite.stride = 1;
+    setup->transfer_comments(*s);
+
+    body.push_back(setup);
+    body.push_back(Stmt::create_assign(mkVar(Var(VPM_WRITE)), s->assign_rhs()));
+  }
+
+  body.push_back(Stmt::create_assign(mkVar(count), add(mkVar(count), mkIntLit(1))));
+  body.push_back(cond_stmt(count, m_batch_size, Stmt::create_sequence(
+    flush(batches, m_batch_size),
+    Stmt::create_assign(mkVar(count), mkIntLit(0))
+  )));
+
+  Stmt::Ptr new_loop = Stmt::mkWhile(loop.loop_cond(), sequence(body));
+  new_loop->transfer_comments(loop);
+
+  // Complete loop
+  std::vector<Stmt::Ptr> ret;
+  ret.push_back(Stmt::create(DMA_WRITE_WAIT));
+  ret.back()->comment("Batched stores in loop");
+  ret.push_back(Stmt::create_assign(mkVar(count), mkIntLit(0)));
+  ret.push_back(new_loop);
+
+  for (int n = 1; n < m_batch_size; n++) {
+    ret.push_back(cond_stmt(count, n, flush(batches, n)));
+  }
+
+  return sequence(ret);
+}
+
+}  // anon namespace
+
+
+/**
+ * Batch stores to consecutive addresses in loops.
+ *
+ * Every store with DMA has a fixed overhead for the setup and the wait for completion.
+ * In loops which store to consecutive vectors, multiple vectors are therefore
+ * collected in VPM and written to main memory with a single DMA.
+ *
+ * The passed statement is not changed; the changed parts are copied. This allows
+ * the interpreter to use the original statements.
+ *
+ * @return statement with batched stores
+ */
+Stmt::Ptr batch_stores(Stmt::Ptr s) {
+  if (s.get() == nullptr) return s;
+
+  Stmt::Ptr ret;
+
+  switch (s->tag) {
+    case SEQ: {
+      auto s0 = batch_stores(s->seq_s0());
+      auto s1 = batch_stores(s->seq_s1());
+      if (s0 == s->seq_s0() && s1 == s->seq_s1()) return s;
+
+      ret = Stmt::create_sequence(s0, s1);
+      break;
+    }
+    case IF:
+    case WHERE: {
+      auto then_stmt = batch_stores(s->thenStmt());
+      auto else_stmt = batch_stores(s->elseStmt());
+      if (then_stmt == s->thenStmt() && else_stmt == s->elseStmt()) return s;
+
+      if (s->tag == IF) {
+        ret = Stmt::mkIf(s->if_cond(), then_stmt, else_stmt);
+      } else {
+        ret = mkWhere(s->where_cond(), then_stmt, else_stmt);
+      }
+      break;
+    }
+    case WHILE: {
+      LoopAnalysis info(*s);
+      if (info.ok()) return info.rewrite(*s);
+
+      auto body = batch_stores(s->body());
+      if (body == s->body()) return s;
+
+      ret = Stmt::mkWhile(s->loop_cond(), body);
+      break;
+    }
+    default:
+      return s;
+  }
+
+  ret->transfer_comments(*s);
+  return ret;
+}
+
+}  // namespace vc4
+}  // namespace V3DLib
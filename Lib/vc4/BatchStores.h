@@ -0,0 +1,13 @@
+#ifndef _V3DLIB_VC4_BATCHSTORES_H_
+#define _V3DLIB_VC4_BATCHSTORES_H_
+#include "Source/Stmt.h"
+
+namespace V3DLib {
+namespace vc4 {
+
+Stmt::Ptr batch_stores(Stmt::Ptr s);
+
+}  // namespace vc4
+}  // namespace V3DLib
+
+#endif  // _V3DLIB_VC4_BATCHSTORES_H_
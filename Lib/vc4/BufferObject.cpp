@@ -1,6 +1,7 @@
 #include "BufferObject.h"
 #include <cassert>
 #include <stdio.h>
+#include <mutex>
 #include "Mailbox.h"
 #include "vc4.h"
 #include "../Support/Platform.h"  // has_vc4() 
@@ -16,6 +17,7 @@ namespace vc4 {
 namespace {
 
 BufferObject heap;
+std::once_flag heapInit;
 
 }
 
@@ -66,10 +68,10 @@ void BufferObject::dealloc() {
 
 BufferObject &getHeap() {
 	if (Platform::instance().has_vc4) {
-		if (heap.size() == 0) {
+		std::call_once(heapInit, [] () {
 			//debug("Allocating main heap vc4\n");
 			heap.alloc_mem(BufferObject::DEFAULT_HEAP_SIZE);
-		}
+		});
 	}
 
 	return heap;
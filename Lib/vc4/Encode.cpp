@@ -249,7 +249,7 @@ void encodeInstr(Instr instr, uint32_t* high, uint32_t* low) {
       instr.ALU.dest.tag          = NONE;
       instr.ALU.srcA.tag          = REG;
       instr.ALU.srcA.reg.tag      = SPECIAL;
-      instr.ALU.srcA.reg.regId    = src;
+      instr.ALU.srcA.reg.regId    = (uint16_t) src;
       instr.ALU.srcB.tag          = REG;
       instr.ALU.srcB.reg          = instr.ALU.srcA.reg;
       break;
@@ -444,7 +444,7 @@ void encodeInstr(Instr instr, uint32_t* high, uint32_t* low) {
 // Top-level encoder
 // =================
 
-uint64_t encode(Instr instr) {
+uint64_t encode(Instr const &instr) {
 	uint64_t ret;
 	uint32_t low;
 	uint32_t high;
@@ -459,7 +459,7 @@ uint64_t encode(Instr instr) {
 void encode(Seq<Instr>* instrs, Seq<uint32_t>* code) {
   uint32_t high, low;
   for (int i = 0; i < instrs->size(); i++) {
-    Instr instr = instrs->get(i);
+    Instr const &instr = instrs->get(i);
 		check_instruction_tag_for_platform(instr.tag, true);
 
 		if (instr.tag == INIT_BEGIN || instr.tag == INIT_END) {
@@ -7,7 +7,7 @@
 namespace V3DLib {
 namespace vc4 {
 
-uint64_t encode(Instr instr);
+uint64_t encode(Instr const &instr);
 void encode(Seq<Instr>* instrs, Seq<uint32_t>* code);
 
 }  // namespace vc4
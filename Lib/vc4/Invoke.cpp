@@ -6,9 +6,10 @@
 #define QPU_TIMEOUT 10000
 
 namespace V3DLib {
+namespace vc4 {
 
 /**
- * TODO rewrite to shared array holding the parameters
+ * Run the kernel on the given number of QPUs.
  *
  * ----------------------------------------------------------------------------
  * Notes
@@ -21,7 +22,39 @@ namespace V3DLib {
  *    cause and gave up. Instead, I'll just pass a final dummy uniform value,
  *    which can be mangled to the heart's content of the hardware.
  */
-void invoke(int numQPUs, SharedArray<uint32_t> &codeMem, int qpuCodeMemOffset, Seq<int32_t>* params) {
+void Launch::invoke(int numQPUs, SharedArray<uint32_t> &codeMem, int qpuCodeMemOffset, Seq<int32_t> const &params) {
+  if (numQPUs == m_numQPUs && params.size() == (int) m_params.size()) {
+    write_params(codeMem, qpuCodeMemOffset, params);
+  } else {
+    write_layout(numQPUs, codeMem, qpuCodeMemOffset, params);
+  }
+
+#ifdef ARM32
+  int mb = getMailbox();  // Open mailbox for talking to vc4
+
+  // Launch messages come after the parameters
+  unsigned launchOffset = qpuCodeMemOffset + (2 + params.size() + 1)*numQPUs;
+  uint32_t* launchMsgsPtr = codeMem.getPointer() + launchOffset;
+
+  // Launch QPUs
+  unsigned result = execute_qpu(mb, numQPUs, (uint32_t) (uintptr_t) launchMsgsPtr, 1, QPU_TIMEOUT);
+#else
+  #pragma message("WARNING: invoke() will not run on this platform, only on ARM 32-bits")
+  assertq(false, "invoke() will not run on this platform, only on ARM 32-bits");
+
+  unsigned result = 1;  // Force error message
+#endif
+
+  if (result != 0) {
+    printf("Failed to invoke kernel on QPUs\n");
+  }
+}
+
+
+/**
+ * Write the parameters per QPU and the launch messages to the code memory
+ */
+void Launch::write_layout(int numQPUs, SharedArray<uint32_t> &codeMem, int qpuCodeMemOffset, Seq<int32_t> const &params) {
   //
   // Number of 32-bit words needed for kernel code & parameters
   // - First two values are always the QPU ID and num QPU's
@@ -30,7 +63,7 @@ void invoke(int numQPUs, SharedArray<uint32_t> &codeMem, int qpuCodeMemOffset, S
   // - The final two words are the pointer to the parameters per QPU, and
   //   the pointer to the kernel program to execute.
   //
-  unsigned numWords = qpuCodeMemOffset + (2 + params->size() + 1)*numQPUs + 2*numQPUs;
+  unsigned numWords = qpuCodeMemOffset + (2 + params.size() + 1)*numQPUs + 2*numQPUs;
 
   assert(numWords < codeMem.size());
 
@@ -39,40 +72,50 @@ void invoke(int numQPUs, SharedArray<uint32_t> &codeMem, int qpuCodeMemOffset, S
 
   // Copy parameters to instruction memory
   int offset = qpuCodeMemOffset;
-  uint32_t** paramsPtr = new uint32_t* [numQPUs];  // TODO check shouldn't this be deleted?
   for (int i = 0; i < numQPUs; i++) {
-    paramsPtr[i] = qpuCodePtr + offset;
     codeMem[offset++] = (uint32_t) i;              // Unique QPU ID
     codeMem[offset++] = (uint32_t) numQPUs;        // QPU count
-    for (int j = 0; j < params->size(); j++)
-      codeMem[offset++] = params->get(j);
+    for (int j = 0; j < params.size(); j++)
+      codeMem[offset++] = params[j];
     codeMem[offset++] = 0;                         // Dummy final parameter, see Note 1.
   }
 
-#ifdef ARM32
-  int mb = getMailbox();  // Open mailbox for talking to vc4
-
   // Copy launch messages
-  uint32_t* launchMsgsPtr = qpuCodePtr + offset;
+  unsigned paramsSize = 2 + params.size() + 1;
   for (int i = 0; i < numQPUs; i++) {
-    codeMem[offset++] = (uint32_t) paramsPtr[i];
-    codeMem[offset++] = (uint32_t) qpuCodePtr;
+    uint32_t *paramsPtr = qpuCodePtr + qpuCodeMemOffset + i*paramsSize;
+    codeMem[offset++] = (uint32_t) (uintptr_t) paramsPtr;
+    codeMem[offset++] = (uint32_t) (uintptr_t) qpuCodePtr;
   }
 
   assertq(offset == (int) numWords, "Check final offset failed");
 
-  // Launch QPUs
-  unsigned result = execute_qpu(mb, numQPUs, (uint32_t) launchMsgsPtr, 1, QPU_TIMEOUT);
-#else
-  #pragma message("WARNING: invoke() will not run on this platform, only on ARM 32-bits")
-  assertq(false, "invoke() will not run on this platform, only on ARM 32-bits");
+  m_numQPUs = numQPUs;
+  m_params.resize(params.size());
+  for (int j = 0; j < params.size(); j++) {
+    m_params[j] = params[j];
+  }
+}
 
-  unsigned result = 1;  // Force error message
-#endif
 
-  if (result != 0) {
-    printf("Failed to invoke kernel on QPUs\n");
+/**
+ * Write the parameters which changed since the previous invocation to the code memory.
+ *
+ * The layout must have been written already for the current number of QPUs.
+ */
+void Launch::write_params(SharedArray<uint32_t> &codeMem, int qpuCodeMemOffset, Seq<int32_t> const &params) {
+  assert(m_numQPUs > 0);
+  unsigned paramsSize = 2 + params.size() + 1;
+
+  for (int j = 0; j < params.size(); j++) {
+    if (m_params[j] == params[j]) continue;
+    m_params[j] = params[j];
+
+    for (int i = 0; i < m_numQPUs; i++) {
+      codeMem[qpuCodeMemOffset + i*paramsSize + 2 + j] = params[j];
+    }
   }
 }
 
+}  // namespace vc4
 }  // namespace V3DLib
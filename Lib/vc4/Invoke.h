@@ -1,17 +1,38 @@
 #ifndef _V3DLIB_VC4_INVOKE_H_
 #define _V3DLIB_VC4_INVOKE_H_
 #include <stdint.h>
+#include <vector>
 #include "Common/Seq.h"
 #include "Common/SharedArray.h"
 
 namespace V3DLib {
+namespace vc4 {
 
-void invoke(
-  int numQPUs,
-  SharedArray<uint32_t> &codeMem,
-  int qpuCodeMemOffset,
-  Seq<int32_t>* params);
+/**
+ * Invokes a kernel, with the uniforms and launch messages stored in the code memory
+ * after the kernel code.
+ *
+ * The layout in the code memory is kept over invocations. Only if the number of QPUs
+ * or the number of parameters changes is it fully written again. Otherwise, only the
+ * changed parameters are written.
+ */
+class Launch {
+public:
+  void invoke(
+    int numQPUs,
+    SharedArray<uint32_t> &codeMem,
+    int qpuCodeMemOffset,
+    Seq<int32_t> const &params);
 
+private:
+  int                  m_numQPUs = 0;  // Number of QPUs of the current layout, 0 if none
+  std::vector<int32_t> m_params;       // Parameters currently in the code memory
+
+  void write_layout(int numQPUs, SharedArray<uint32_t> &codeMem, int qpuCodeMemOffset, Seq<int32_t> const &params);
+  void write_params(SharedArray<uint32_t> &codeMem, int qpuCodeMemOffset, Seq<int32_t> const &params);
+};
+
+}  // namespace vc4
 }  // namespace V3DLib
 
 #endif  // _V3DLIB_VC4_INVOKE_H_
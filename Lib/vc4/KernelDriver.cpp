@@ -1,8 +1,11 @@
 #include "KernelDriver.h"
+#include <mutex>
 #include "Source/Lang.h"
 #include "Source/Translate.h"
+#include "Support/Platform.h"
 #include "Target/RemoveLabels.h"
 #include "Translate.h"
+#include "BatchStores.h"
 #include "vc4.h"
 #include "Encode.h"
 #include "DMA.h"
@@ -10,6 +13,102 @@
 
 namespace V3DLib {
 namespace vc4 {
+namespace {
+
+/**
+ * Serializes kernel runs over the process.
+ *
+ * The QPU enable count and the mailbox are global, and running kernels share
+ * the VPM and the semaphores. Only one kernel can therefore run at a time.
+ */
+std::mutex invoke_mutex;
+
+/**
+ * Memory accesses in a kernel, as far as relevant for selecting the memory access path.
+ *
+ * The statements emitted by `kernelFinish()` are not considered.
+ */
+struct MemoryAccess {
+  bool direct  = false;  // VPM or DMA accessed directly
+  bool receive = false;  // Explicit TMU loads, either in the source or by pipelining
+  bool load    = false;  // Regular memory loads
+
+  void scan(Stmt::Ptr s);
+};
+
+
+void MemoryAccess::scan(Stmt::Ptr s) {
+  if (s.get() == nullptr) return;
+
+  switch (s->tag) {
+    case SEQ:
+      scan(s->seq_s0());
+      scan(s->seq_s1());
+      break;
+    case ASSIGN: {
+      Expr::Ptr lhs = s->assign_lhs();
+      load = load || has_deref(s->assign_rhs())
+                  || (lhs->tag() == Expr::DEREF && has_deref(lhs->deref_ptr()));
+      break;
+    }
+    case WHERE:
+      load = load || has_deref(s->where_cond());
+      scan(s->thenStmt());
+      scan(s->elseStmt());
+      break;
+    case IF:
+      load = load || has_deref(s->if_cond()->bexpr());
+      scan(s->thenStmt());
+      scan(s->elseStmt());
+      break;
+    case WHILE:
+      load = load || has_deref(s->loop_cond()->bexpr());
+      scan(s->body());
+      break;
+    case PRINT:
+      load = load || (s->print.tag() != PRINT_STR && has_deref(s->print_expr()));
+      break;
+    case LOAD_RECEIVE:
+      receive = true;
+      break;
+    case SET_READ_STRIDE:
+    case SET_WRITE_STRIDE:
+    case SETUP_VPM_READ:
+    case SETUP_VPM_WRITE:
+    case SETUP_DMA_READ:
+    case SETUP_DMA_WRITE:
+    case DMA_START_READ:
+    case DMA_START_WRITE:
+      direct = true;
+      break;
+    default:
+      break;
+  }
+}
+
+
+/**
+ * Determine if the TMU memory path should be used for given kernel.
+ *
+ * For `VC4_MEM_AUTO`, the TMU path is not used if the kernel accesses VPM or DMA
+ * directly, since the stores would interfere. Neither is it used if explicit TMU loads
+ * are combined with regular loads, since the TMU load of the latter could end up
+ * in between a `gather()` and its `receive()`.
+ */
+bool use_tmu(Stmt::Ptr body) {
+  switch (Platform::instance().vc4_memory_path()) {
+    case VC4_MEM_TMU:  return true;
+    case VC4_MEM_AUTO: {
+      MemoryAccess access;
+      access.scan(body);
+      return !access.direct && !(access.receive && access.load);
+    }
+    default:           return false;
+  }
+}
+
+}  // anon namespace
+
 
 KernelDriver::KernelDriver() : V3DLib::KernelDriver(Vc4Buffer) {}
 
@@ -47,7 +146,9 @@ void KernelDriver::kernelFinish() {
 void KernelDriver::encode(int numQPUs) {
   if (code.size() > 0) return;  // Don't bother if already encoded
 
+  m_stats.start("encode", m_targetCode.size());
   V3DLib::vc4::encode(&m_targetCode, &code);
+  m_stats.stop(code.size()/2);  // 2 words per opcode
 }
 
 
@@ -75,22 +176,48 @@ void KernelDriver::compile_intern() {
 
   obtain_ast();
 
-  V3DLib::translate_stmt(m_targetCode, m_body);
+  Seq<Instr> init_code = init_memory_path(use_tmu(m_body));
 
-  insertInitBlock(m_targetCode);  // TODO init block not used for vc4, remove
+  // The original statements are retained for the interpreter
+  Stmt::Ptr body = convert_ifs(m_body);
+  MemoryAccess access;
+  access.scan(m_body);
+
+  if (!access.direct) {
+    body = batch_stores(body);
+  }
+
+  m_stats.measure("translate_stmt", m_targetCode, [this, &body] {
+    V3DLib::translate_stmt(m_targetCode, body);
+  });
+
+  m_stats.measure("insertInitBlock", m_targetCode, [this, &init_code] {
+    insertInitBlock(m_targetCode);
+
+    // Place the init code for the memory path within the init block
+    for (int i = 0; i < m_targetCode.size() && !init_code.empty(); ++i) {
+      if (m_targetCode[i].tag == INIT_BEGIN) {
+        m_targetCode.insert(i + 1, init_code);
+        break;
+      }
+    }
+  });
 
   m_targetCode << Instr(END);
 
-  compile_postprocess(m_targetCode);
+  compile_postprocess(m_targetCode, m_stats);
 
   // Translate branch-to-labels to relative branches
-  removeLabels(m_targetCode);
+  m_stats.measure("removeLabels", m_targetCode, [this] {
+    removeLabels(m_targetCode);
+  });
 }
 
 
 void KernelDriver::invoke_intern(int numQPUs, Seq<int32_t>* params) {
   //debug("Called vc4 KernelDriver::invoke()");  
   assert(code.size() > 0);
+  std::lock_guard<std::mutex> lock(invoke_mutex);
 
   unsigned numWords = code.size() + 12*MAX_KERNEL_PARAMS + 12*2;
 
@@ -112,7 +239,7 @@ void KernelDriver::invoke_intern(int numQPUs, Seq<int32_t>* params) {
   }
 
   enableQPUs();
-  V3DLib::invoke(numQPUs, qpuCodeMem, qpuCodeMemOffset, params);
+  m_launch.invoke(numQPUs, qpuCodeMem, qpuCodeMemOffset, *params);
   disableQPUs();
 }
 
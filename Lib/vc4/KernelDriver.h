@@ -20,6 +20,7 @@ public:
 private:
   SharedArray<uint32_t> qpuCodeMem;   // Memory region for QPU code and parameters
   Seq<uint32_t> code;                 // opcodes for vc4
+  Launch        m_launch;             // Layout of the parameters in qpuCodeMem, reused over invocations
 
   void kernelFinish();
   void compile_intern() override;
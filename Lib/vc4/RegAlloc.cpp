@@ -16,7 +16,7 @@ void regalloc_determine_regfileAB(Seq<Instr> &instrs, int *prefA, int *prefB, in
   for (int i = 0; i < n; i++) prefA[i] = prefB[i] = 0;
 
   for (int i = 0; i < instrs.size(); i++) {
-    Instr instr = instrs[i];
+    Instr const &instr = instrs[i];
     Reg ra, rb;
     if (getTwoUses(instr, &ra, &rb) && ra.tag == REG_A && rb.tag == REG_A) {
       RegId x = ra.regId;
@@ -100,7 +100,7 @@ void regAlloc(CFG* cfg, Seq<Instr>* instrs) {
 
     // Finally, allocate a register to the variable
     alloc[i].tag = chosenRegFile;
-    alloc[i].regId = chosenRegFile == REG_A ? chosenA : chosenB;
+    alloc[i].regId = (uint16_t) (chosenRegFile == REG_A ? chosenA : chosenB);
   }
 
   // Step 4
@@ -11,6 +11,11 @@ namespace vc4 {
 
 Seq<Instr> SourceTranslate::deref_var_var(Var lhs, Var rhs) {
 	Seq<Instr> ret;
+
+	if (memory_path_is_tmu()) {
+		ret << StoreRequestNoWait(lhs, rhs);
+		return ret;
+	}
 	
 	ret << StoreRequest(lhs, rhs)
 	    << genWaitDMAStore();  // Wait for store to complete
@@ -22,6 +27,11 @@ Seq<Instr> SourceTranslate::deref_var_var(Var lhs, Var rhs) {
 void SourceTranslate::varassign_deref_var(Seq<Instr>* seq, Var &v, Expr &e) {
 	using namespace V3DLib::Target::instr;
 
+	if (memory_path_is_tmu()) {
+		*seq << load_tmu(v, e.deref_ptr()->var());
+		return;
+	}
+
 	Reg reg = srcReg(e.deref_ptr()->var());
 	Seq<Instr> ret;
 	
@@ -207,10 +207,24 @@ Seq<Instr> storeRequestOperation(Stmt::Ptr s) {
     addr = putInVar(&ret, addr);
   }
 
-  ret << vc4::StoreRequest(addr->var(), data->var(), true);
+  if (vc4::memory_path_is_tmu()) {
+    ret << vc4::StoreRequestNoWait(addr->var(), data->var());
+  } else {
+    ret << vc4::StoreRequest(addr->var(), data->var(), true);
+  }
+
   return ret;
 }
 
+
+/**
+ * State of the memory access path for the kernel being compiled.
+ */
+struct {
+  bool use_tmu = false;
+  Var  store_slot = Var(DUMMY);  // VPM buffer to use for the next store, alternates between 0 and 1
+} memory_path;
+
 }  // anon namespace
 
 
@@ -236,6 +250,7 @@ bool translate_stmt(Seq<Instr> &seq, Stmt::Ptr s) {
     case DMA_WRITE_WAIT:   seq << genWaitDMAStore();                     return true;
     case DMA_START_READ:   seq<< startDMAReadStmt(s->address());         return true;
     case DMA_START_WRITE:  seq << startDMAWriteStmt(s->address());       return true;
+    case TMU_WRITE_WAIT:                                                 return true;  // vc4 stores don't use the TMU
 
     default:
       assertq(false, "translate_stmt(): unexpected stmt tag");
@@ -276,5 +291,108 @@ Seq<Instr> StoreRequest(Var addr_var, Var data_var,  bool wait) {
   return ret;
 }
 
+
+/**
+ * Select the memory access path for the kernel to be compiled.
+ *
+ * @return init code for the selected path, to be placed at the start of the kernel
+ */
+Seq<Instr> init_memory_path(bool use_tmu) {
+  using namespace V3DLib::Target::instr;
+  Seq<Instr> ret;
+
+  memory_path.use_tmu = use_tmu;
+  memory_path.store_slot = Var(DUMMY);
+
+  if (use_tmu) {
+    memory_path.store_slot = freshVar();
+    ret << li(memory_path.store_slot, 0);
+    ret.back().comment("Init VPM buffer slot for stores");
+  }
+
+  return ret;
+}
+
+
+bool memory_path_is_tmu() {
+  return memory_path.use_tmu;
+}
+
+
+/**
+ * Load a vector via the TMU.
+ *
+ * This replaces DMA to VPM and a read from VPM, and does not require the
+ * wait for the DMA to complete.
+ */
+Seq<Instr> load_tmu(Var dst_var, Var addr_var) {
+  using namespace V3DLib::Target::instr;
+
+  Reg addr = freshReg();
+  Seq<Instr> ret;
+
+  ret << shl(addr, ELEM_ID, 2)
+      << add(addr, srcReg(addr_var), addr)
+      << mov(TMU0_S, addr);
+
+  Instr recv(RECV);
+  recv.RECV.dest = dstReg(dst_var);
+  ret << recv;
+
+  ret.front().comment("Start TMU load var");
+  ret.back().comment("End TMU load var");
+
+  return ret;
+}
+
+
+/**
+ * Store a vector via VPM and DMA, without waiting for the DMA to complete.
+ *
+ * Two VPM buffers are used alternately for each QPU:
+ *
+ *  - slot 0: rows 16..31, the buffer used by `StoreRequest()`
+ *  - slot 1: rows 32..47
+ *
+ * The vector is written to the VPM buffer which is not used by the previous DMA store.
+ * Starting the DMA stalls until the previous DMA store has completed,
+ * so the buffer is always free on the next store.
+ *
+ * The DMA of the last store is waited for at the end of the kernel.
+ */
+Seq<Instr> StoreRequestNoWait(Var addr_var, Var data_var) {
+  using namespace V3DLib::Target::instr;
+  assert(memory_path.use_tmu);
+
+  Reg slot      = srcReg(memory_path.store_slot);
+  Reg offset    = freshReg();
+  Reg addr      = freshReg();
+  Reg storeAddr = freshReg();
+
+  Seq<Instr> ret;
+
+  ret << shl(offset, slot, 4)               // Setup VPM
+      << li(addr, 16)
+      << add(addr, addr, QPU_ID)
+      << add(addr, addr, offset)
+      << genSetupVPMStore(addr, 0, 1)
+      << shl(offset, slot, 8)               // Store address
+      << li(storeAddr, 256)
+      << add(storeAddr, storeAddr, QPU_ID)
+      << add(storeAddr, storeAddr, offset);
+
+  // Setup DMA
+  ret << genSetWriteStride(0)
+      << genSetupDMAStore(16, 1, 1, storeAddr)
+      << shl(Target::instr::VPM_WRITE, srcReg(data_var), 0)  // Put to VPM
+      << genStartDMAStore(srcReg(addr_var))                  // Start DMA
+      << bxor(memory_path.store_slot, memory_path.store_slot, 1);
+
+  ret.front().comment("Start DMA store request, no wait");
+  ret.back().comment("End DMA store request, no wait");
+
+  return ret;
+}
+
 }  // namespace vc4
 }  // namespace V3DLib
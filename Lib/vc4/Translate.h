@@ -11,6 +11,11 @@ namespace vc4 {
 bool translate_stmt(Seq<Instr> &seq, Stmt::Ptr s);
 Seq<Instr> StoreRequest(Var addr_var, Var data_var, bool wait = false);
 
+Seq<Instr> init_memory_path(bool use_tmu);
+bool memory_path_is_tmu();
+Seq<Instr> load_tmu(Var dst_var, Var addr_var);
+Seq<Instr> StoreRequestNoWait(Var addr_var, Var data_var);
+
 }  // namespace vc4
 }  // namespace V3DLib
 
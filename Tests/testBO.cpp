@@ -1,6 +1,29 @@
 #include "catch.hpp"
+#include <algorithm>  // std::sort(), std::count(), std::equal()
+#include <atomic>
+#include <chrono>
+#include <cstdio>     // fopen(), std::remove()
+#include <iostream>
+#include <mutex>
+#include <numeric>    // std::accumulate()
+#include <thread>
+#include <unistd.h>   // ftruncate()
+#include "Common/FileMapping.h"
 #include "Common/SharedArray.h"
+#include "Common/SlabAllocator.h"
 #include "Target/BufferObject.h"
+#include "V3DLib.h"
+
+namespace {
+
+void inc_kernel(V3DLib::Ptr<V3DLib::Int> p) {
+  using namespace V3DLib;
+
+  Int a = *p;
+  *p = a + 1;
+}
+
+}  // anon namespace
 
 
 TEST_CASE("Test Buffer Objects", "[bo]") {
@@ -133,4 +156,597 @@ TEST_CASE("Test Buffer Objects", "[bo]") {
       REQUIRE(heap.num_free_ranges() == 0);
     }
   }
+
+
+  SECTION("BO should handle many free ranges") {
+    const int NUM_ARRAYS = 1000;
+
+    {
+      SharedArrays arrays(NUM_ARRAYS);
+
+      for (int i = 0; i < NUM_ARRAYS; ++i) {
+        arrays[i].reset(new SharedArray(1 + i % 64, heap));
+      }
+
+      // Free every other array, leaves many separate free ranges
+      for (int i = 0; i < NUM_ARRAYS; i += 2) {
+        arrays[i]->dealloc();
+      }
+      REQUIRE(heap.num_free_ranges() == NUM_ARRAYS/2);
+
+      // Reallocating smaller arrays should reuse the free ranges
+      for (int i = 0; i < NUM_ARRAYS; i += 2) {
+        arrays[i]->alloc(1);
+      }
+      REQUIRE(heap.num_free_ranges() <= NUM_ARRAYS/2);
+
+      // Freeing the rest should merge everything again
+      for (int i = 1; i < NUM_ARRAYS; i += 2) {
+        arrays[i]->dealloc();
+      }
+    }
+
+    REQUIRE(heap.empty());
+    REQUIRE(heap.num_free_ranges() == 0);
+  }
+}
+
+
+TEST_CASE("Global heap should grow when full", "[bo][grow]") {
+  using namespace V3DLib;
+  using Arrays = std::vector<std::unique_ptr<SharedArray<int>>>;
+
+  auto num_bos = [] () { return (int) heap_buffer_objects(getBufferObject()).size(); };
+  const int ARRAY_SIZE = 256*1024;  // 1 MiB
+
+  int initial_num_bos = num_bos();
+  uint32_t initial_generation = heap_generation();
+
+  {
+    Arrays arrays;
+    for (int i = 0; i < 12; ++i) {
+      arrays.emplace_back(new SharedArray<int>(ARRAY_SIZE));
+    }
+    REQUIRE(num_bos() > initial_num_bos);
+    REQUIRE(heap_generation() != initial_generation);
+
+    // Array larger than the default heap size
+    SharedArray<int> large(2*BufferObject::DEFAULT_HEAP_SIZE/4);
+    REQUIRE(num_bos() > initial_num_bos + 1);
+    large.dealloc();
+
+    // Kernels should be able to access arrays in all buffer objects
+    auto k = compile(inc_kernel);
+
+    for (auto &arr : arrays) {
+      arr->fill(1);
+      k.load(arr.get());
+      k.emu();
+      REQUIRE((*arr)[0] == 2);
+      k.interpret();
+      REQUIRE((*arr)[15] == 3);
+    }
+  }
+
+  // Extra buffer objects should be released
+  REQUIRE(num_bos() == initial_num_bos);
+
+  // Allocating within the existing buffer objects should not change the generation
+  uint32_t generation = heap_generation();
+  {
+    SharedArray<int> arr(1024);
+  }
+  REQUIRE(heap_generation() == generation);
+}
+
+
+TEST_CASE("Small arrays should be allocated from slabs", "[bo][slab]") {
+  using namespace V3DLib;
+  using Arrays = std::vector<std::unique_ptr<SharedArray<int>>>;
+
+  const int NUM_ARRAYS = 1000;
+
+  SECTION("Small arrays should not be interleaved with large arrays") {
+    Arrays small;
+    Arrays large;
+
+    for (int i = 0; i < 300; ++i) {
+      small.emplace_back(new SharedArray<int>(4));
+      large.emplace_back(new SharedArray<int>(1024));
+    }
+
+    std::vector<uint32_t> addresses;
+    for (auto &arr : small) {
+      addresses.push_back(arr->getAddress());
+    }
+    std::sort(addresses.begin(), addresses.end());
+
+    // There are only gaps between the slabs
+    int gaps = 0;
+    for (int i = 1; i < (int) addresses.size(); ++i) {
+      if (addresses[i] - addresses[i - 1] > SlabAllocator::SLAB_SIZE) gaps++;
+    }
+    REQUIRE(gaps <= 3);
+  }
+
+  Arrays arrays;
+  for (int i = 0; i < NUM_ARRAYS; ++i) {
+    int size = 1 + (i*7) % 64;
+    arrays.emplace_back(new SharedArray<int>(size));
+    arrays.back()->fill(i);
+  }
+
+  // Free in some arbitrary order
+  for (int i = 0; i < NUM_ARRAYS; i += 2) {
+    arrays[i]->dealloc();
+  }
+
+  for (int i = 0; i < NUM_ARRAYS; i += 2) {
+    arrays[i]->alloc(1 + i % 64);
+    arrays[i]->fill(i);
+  }
+
+  // No array should have overwritten another one
+  for (int i = 0; i < NUM_ARRAYS; ++i) {
+    auto &arr = *arrays[i];
+    INFO("i: " << i);
+    REQUIRE(arr[0] == i);
+    REQUIRE(arr[arr.size() - 1] == i);
+  }
+}
+
+
+TEST_CASE("Global heap should be usable from multiple threads", "[bo][threads]") {
+  using namespace V3DLib;
+  using Array  = SharedArray<int>;
+  using Arrays = std::vector<std::unique_ptr<Array>>;
+
+  const int NUM_THREADS    = 8;
+  const int NUM_ITERATIONS = 5000;
+
+  auto num_bos = [] () { return (int) heap_buffer_objects(getBufferObject()).size(); };
+  int initial_num_bos = num_bos();
+
+  std::atomic<int> errors(0);  // REQUIRE is not thread-safe
+  std::mutex handover_mutex;
+  Arrays handover;             // Arrays to deallocate by another thread
+
+  // All elements should have the value written by the owning thread
+  auto check = [&errors] (Array const &arr, int id) {
+    if (arr[0]/NUM_ITERATIONS != id) errors++;
+
+    for (int j = 1; j < (int) arr.size(); ++j) {
+      if (arr[j] != arr[0]) errors++;
+    }
+  };
+
+  auto worker = [&] (int id) {
+    Arrays arrays;
+    uint32_t seed = (uint32_t) id + 1;
+
+    for (int i = 0; i < NUM_ITERATIONS; ++i) {
+      seed = seed*1103515245 + 12345;
+      int r = (int) ((seed >> 16) & 0x7fff);
+
+      if (arrays.empty() || r % 3 != 0) {
+        int size = (r % 8 == 0)? 256 + r % 1024 : 1 + r % 64;  // Mostly small arrays
+        arrays.emplace_back(new Array(size));
+        arrays.back()->fill(id*NUM_ITERATIONS + i);
+      } else {
+        int index = r % (int) arrays.size();
+        std::unique_ptr<Array> arr(std::move(arrays[index]));
+        arrays.erase(arrays.begin() + index);
+        check(*arr, id);
+
+        if (r % 5 == 0) {
+          std::lock_guard<std::mutex> guard(handover_mutex);
+          handover.push_back(std::move(arr));
+        }
+      }
+
+      if (i % 16 == 0) {
+        std::lock_guard<std::mutex> guard(handover_mutex);
+        handover.clear();
+      }
+    }
+
+    for (auto &arr : arrays) {
+      check(*arr, id);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int id = 0; id < NUM_THREADS; ++id) {
+    threads.emplace_back(worker, id);
+  }
+
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  handover.clear();
+
+  REQUIRE(errors == 0);
+  REQUIRE(num_bos() == initial_num_bos);
+}
+
+
+TEST_CASE("Heap statistics should reflect the allocations", "[bo][stats]") {
+  using namespace V3DLib;
+  using Array = SharedArray<uint32_t>;
+
+  SECTION("Statistics of a buffer object") {
+    emu::BufferObject heap(64*1024);
+
+    std::vector<std::unique_ptr<Array>> arrays;
+    for (int i = 0; i < 8; ++i) {
+      arrays.emplace_back(new Array(256, heap));  // 1024 bytes each
+    }
+
+    HeapStats stats = heap.stats();
+    REQUIRE(stats.size == 64*1024);
+    REQUIRE(stats.used == 8*1024);
+    REQUIRE(stats.peak == 8*1024);
+    REQUIRE(stats.num_allocs == 8);
+    REQUIRE(stats.num_live == 8);
+    REQUIRE(stats.free == 56*1024);
+    REQUIRE(stats.largest_free == 56*1024);
+    REQUIRE(stats.num_free_ranges == 0);
+    REQUIRE(stats.fragmentation() == 0.0f);
+    REQUIRE(stats.histogram[HeapStats::bucket(1024)] == 8);
+
+    // Leave holes
+    arrays[1]->dealloc();
+    arrays[3]->dealloc();
+
+    stats = heap.stats();
+    REQUIRE(stats.used == 6*1024);
+    REQUIRE(stats.peak == 8*1024);
+    REQUIRE(stats.num_allocs == 8);
+    REQUIRE(stats.num_live == 6);
+    REQUIRE(stats.free == 58*1024);
+    REQUIRE(stats.largest_free == 56*1024);
+    REQUIRE(stats.num_free_ranges == 2);
+    REQUIRE(stats.fragmentation() > 0.0f);
+
+    arrays.clear();
+    stats = heap.stats();
+    REQUIRE(stats.used == 0);
+    REQUIRE(stats.num_live == 0);
+    REQUIRE(stats.num_free_ranges == 0);
+  }
+
+  SECTION("Statistics and trace of the global heap") {
+    HeapStats before = heap_stats();
+
+    heap_trace(true);
+    Array a(1000);
+    Array b(4);
+
+    HeapStats stats = heap_stats();
+    REQUIRE(stats.used == before.used + 4*1004);
+    REQUIRE(stats.num_allocs == before.num_allocs + 2);
+    REQUIRE(stats.num_live == before.num_live + 2);
+    REQUIRE(stats.peak >= stats.used);
+    REQUIRE(stats.histogram[HeapStats::bucket(4000)] == before.histogram[HeapStats::bucket(4000)] + 1);
+    REQUIRE(stats.histogram[HeapStats::bucket(16)] == before.histogram[HeapStats::bucket(16)] + 1);
+
+    std::string dump = heap_trace_dump();
+    INFO(dump);
+    REQUIRE(dump.find("Live arrays in the heap trace: 2") != dump.npos);
+    REQUIRE(dump.find("4000 bytes") != dump.npos);
+
+    a.dealloc();
+    b.dealloc();
+    REQUIRE(heap_trace_dump().find("No live arrays") != std::string::npos);
+    heap_trace(false);
+
+    stats = heap_stats();
+    REQUIRE(stats.used == before.used);
+    REQUIRE(stats.num_live == before.num_live);
+  }
+}
+
+
+TEST_CASE("SharedArray should support bulk data movement", "[bo][copy]") {
+  using namespace V3DLib;
+
+  std::vector<int> src(64);
+  for (int i = 0; i < (int) src.size(); ++i) {
+    src[i] = i;
+  }
+
+  SharedArray<int> arr(64);
+  arr.fill(-1);
+
+  SECTION("Contiguous copies") {
+    arr.copyFrom(src.data() + 8, 16, 4);
+    REQUIRE(arr[3] == -1);
+    REQUIRE(arr[4] == 8);
+    REQUIRE(arr[19] == 23);
+    REQUIRE(arr[20] == -1);
+
+    arr.copyFrom(src);
+    std::vector<int> dst;
+    arr.copyTo(dst);
+    REQUIRE(dst == src);
+
+    int part[4];
+    arr.copyTo(part, 4, 60);
+    REQUIRE(part[0] == 60);
+    REQUIRE(part[3] == 63);
+  }
+
+  SECTION("Strided copies") {
+    arr.copyFromStrided(src.data(), 16, 4);  // Every 4th element
+    REQUIRE(arr[0] == 0);
+    REQUIRE(arr[1] == 4);
+    REQUIRE(arr[15] == 60);
+    REQUIRE(arr[16] == -1);
+
+    std::vector<int> dst(32, -2);
+    arr.copyToStrided(dst.data(), 16, 2);
+    REQUIRE(dst[0] == 0);
+    REQUIRE(dst[1] == -2);
+    REQUIRE(dst[2] == 4);
+    REQUIRE(dst[30] == 60);
+  }
+
+  SECTION("2D copies") {
+    // 3x4 block of an 8x8 source matrix to position (1, 2) of an 8x8 array
+    arr.copyFrom2D(src.data(), 3, 4, 8, 8, 1*8 + 2);
+    REQUIRE(arr[1*8 + 1] == -1);
+    REQUIRE(arr[1*8 + 2] == 0);
+    REQUIRE(arr[1*8 + 4] == 2);
+    REQUIRE(arr[1*8 + 5] == -1);
+    REQUIRE(arr[4*8 + 2] == 3*8);
+    REQUIRE(arr[5*8 + 2] == -1);
+
+    std::vector<int> dst(3*4, -2);
+    arr.copyTo2D(dst.data(), 3, 4, 3, 8, 1*8 + 2);
+    for (int row = 0; row < 4; ++row) {
+      for (int col = 0; col < 3; ++col) {
+        REQUIRE(dst[row*3 + col] == row*8 + col);
+      }
+    }
+  }
+
+  SECTION("Raw views") {
+    arr.copyFrom(src);
+    auto view = arr.view();
+    REQUIRE(view.size() == 64);
+    REQUIRE(view[10] == 10);
+
+    view[10] = 100;
+    REQUIRE(arr[10] == 100);
+
+    SharedArray<int> const &c = arr;
+    REQUIRE(std::accumulate(c.view().begin(), c.view().end(), 0) == 63*64/2 + 90);
+  }
+
+  SECTION("Large arrays") {
+    const int SIZE = 1024*1024;  // Large enough to use multiple threads
+
+    SharedArray<int> large(SIZE);
+    large.fill(7);
+    REQUIRE(large[0] == 7);
+    REQUIRE(large[SIZE - 1] == 7);
+
+    std::vector<int> dst;
+    large.copyTo(dst);
+    REQUIRE(std::count(dst.begin(), dst.end(), 7) == SIZE);
+
+    for (int i = 0; i < SIZE; ++i) {
+      dst[i] = i;
+    }
+
+    large.copyFrom(dst);
+    REQUIRE(std::equal(dst.begin(), dst.end(), large.view().begin()));
+  }
+}
+
+
+TEST_CASE("Files should be usable as shared arrays", "[bo][file]") {
+  using namespace V3DLib;
+
+  char const *filename = "/tmp/v3dlib_testBO.bin";
+  std::string const header = "P5 header 1024\n\n";  // Not page-aligned, but aligned for int
+  const int SIZE = 1024;
+
+  // Create the input file
+  {
+    FILE *f = fopen(filename, "wb");
+    REQUIRE(f != nullptr);
+    fwrite(header.data(), 1, header.size(), f);
+
+    for (int i = 0; i < SIZE; ++i) {
+      fwrite(&i, sizeof(i), 1, f);
+    }
+
+    fclose(f);
+  }
+
+  auto read_file = [&] () {
+    std::vector<int> ret(SIZE);
+    FILE *f = fopen(filename, "rb");
+    fseek(f, (long) header.size(), SEEK_SET);
+    size_t count = fread(ret.data(), sizeof(int), SIZE, f);
+    fclose(f);
+    REQUIRE(count == SIZE);
+    return ret;
+  };
+
+  auto k = compile(inc_kernel);
+
+  SECTION("Changes to a read-only mapping should not be written to the file") {
+    FileMapping file(filename, FileMapping::READ_ONLY, (off_t) header.size());
+    REQUIRE(file.size() == SIZE*sizeof(int));
+
+    SharedArray<int> arr;
+    arr.heap_view(file.buffer_object());
+    REQUIRE(arr.size() == SIZE);
+    REQUIRE(arr[0] == 0);
+    REQUIRE(arr[SIZE - 1] == SIZE - 1);
+
+    k.load(&arr);
+    k.emu();
+    REQUIRE(arr[0] == 1);
+    REQUIRE(arr[15] == 16);   // The kernel handles one vector
+    REQUIRE(arr[16] == 16);
+
+    arr.dealloc();
+    REQUIRE(read_file()[0] == 0);
+  }
+
+  SECTION("Changes to a writable mapping should be written to the file") {
+    {
+      FileMapping file(filename, FileMapping::READ_WRITE, (off_t) header.size());
+
+      SharedArray<int> arr;
+      arr.heap_view(file.buffer_object());
+
+      k.load(&arr);
+      k.interpret();
+    }
+
+    auto data = read_file();
+    REQUIRE(data[0] == 1);
+    REQUIRE(data[15] == 16);
+    REQUIRE(data[SIZE - 1] == SIZE - 1);
+  }
+
+  SECTION("A new file should be created with the results") {
+    char const *out_filename = "/tmp/v3dlib_testBO_out.bin";
+
+    {
+      FileMapping file(out_filename, FileMapping::CREATE, 0, 16*sizeof(int));
+
+      SharedArray<int> arr;
+      arr.heap_view(file.buffer_object());
+      REQUIRE(arr.size() == 16);
+      arr.fill(41);
+
+      k.load(&arr);
+      k.emu();
+    }
+
+    int data[16];
+    FILE *f = fopen(out_filename, "rb");
+    REQUIRE(f != nullptr);
+    REQUIRE(fread(data, sizeof(int), 16, f) == 16);
+    fclose(f);
+    REQUIRE(data[0] == 42);
+    REQUIRE(data[15] == 42);
+
+    std::remove(out_filename);
+  }
+
+  SECTION("Ranges in files larger than 4 GiB should be mappable") {
+    char const *big_filename = "/tmp/v3dlib_testBO_big.bin";
+    off_t const big_offset = (off_t) (5ull << 30);
+    bool created = false;
+
+    if (sizeof(off_t) >= 8) {  // Otherwise, no large file support
+      FILE *f = fopen(big_filename, "wb");
+      REQUIRE(f != nullptr);
+      created = (ftruncate(fileno(f), big_offset + 64) == 0);  // Sparse file
+      fclose(f);
+    }
+
+    if (created) {
+      REQUIRE_THROWS(FileMapping(big_filename));  // Range too large for a buffer object
+
+      FileMapping file(big_filename, FileMapping::READ_ONLY, big_offset);
+      REQUIRE(file.size() == 64);
+
+      SharedArray<int> arr;
+      arr.heap_view(file.buffer_object());
+      REQUIRE(arr[15] == 0);
+    }
+
+    std::remove(big_filename);
+  }
+
+  REQUIRE_THROWS(FileMapping("/tmp/v3dlib_no_such_file.bin"));
+  std::remove(filename);
+}
+
+
+TEST_CASE("External memory should be adoptable by shared arrays", "[bo][adopt]") {
+  using namespace V3DLib;
+
+  auto num_bos = [] () { return (int) heap_buffer_objects(getBufferObject()).size(); };
+  int initial_num_bos = num_bos();
+
+  std::vector<int> data(64, 5);
+  auto k = compile(inc_kernel);
+
+  {
+    SharedArray<int> arr;
+    arr.adopt(data);
+    REQUIRE(arr.size() == 64);
+    REQUIRE(arr.view().data() == data.data());  // Not copied in emulation mode
+    REQUIRE(arr[63] == 5);
+
+    k.load(&arr);
+    k.emu();
+    REQUIRE(data[0] == 6);
+    k.interpret();
+    arr.sync_from_device();
+    REQUIRE(data[15] == 7);
+    REQUIRE(data[16] == 5);
+
+    // Changes to the adopted memory need an explicit sync to be seen by kernels on hardware
+    data[0] = 10;
+    arr.sync_to_device();
+    k.emu();
+    arr.sync_from_device();
+    REQUIRE(data[0] == 11);
+  }
+
+  REQUIRE(num_bos() == initial_num_bos);
+  REQUIRE(data[0] == 11);
+}
+
+
+/**
+ * Microbenchmark for allocation with many live arrays, intended to be run by hand:
+ *
+ *     runTests "[.heapbench]"
+ */
+TEST_CASE("Benchmark allocation of SharedArray instances", "[.heapbench]") {
+  using SharedArray = V3DLib::SharedArray<uint32_t>;
+  using Clock       = std::chrono::steady_clock;
+
+  const int NUM_ARRAYS = 10000;
+  const int NUM_OPS    = 1000000;
+
+  V3DLib::emu::BufferObject heap(64*1024*1024);
+  std::vector<std::unique_ptr<SharedArray>> arrays(NUM_ARRAYS);
+
+  for (auto &arr : arrays) {
+    arr.reset(new SharedArray(1, heap));  // Allocate to set the heap
+    arr->dealloc();
+  }
+
+  srand(42);
+  auto start = Clock::now();
+
+  for (int n = 0; n < NUM_OPS; ++n) {
+    auto &arr = *arrays[rand() % NUM_ARRAYS];
+
+    if (arr.size() == 0) {
+      arr.alloc(1 + rand() % 1024);
+    } else {
+      arr.dealloc();
+    }
+  }
+
+  double time_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  std::cout << "Heap benchmark: " << NUM_OPS << " alloc/dealloc operations, "
+            << (time_ns/NUM_OPS) << " ns per operation, "
+            << heap.num_free_ranges() << " free ranges at end" << std::endl;
+
+  arrays.clear();
+  REQUIRE(heap.empty());
 }
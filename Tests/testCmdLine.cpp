@@ -131,12 +131,15 @@ TEST_CASE("Check correct output example programs for all three run options", "[c
 	if (running_on_v3d()) {
 		SECTION("Check output Rot3D")   { check_output_example("Rot3D", "-d -k=2"); }
 		SECTION("Check output Rot3D")   { check_output_example("Rot3D", "-d -k=1"); }
+		SECTION("Check output Rot3D")   { check_output_example("Rot3D", "-d -k=3"); }
 	} else {
 		// These should be no problem
 		check_output_run("Rot3D", INTERPRETER, "-d -k=1");
 		check_output_run("Rot3D", EMULATOR,    "-d -k=1");
 		check_output_run("Rot3D", INTERPRETER, "-d -k=2");
 		check_output_run("Rot3D", EMULATOR,    "-d -k=2");
+		check_output_run("Rot3D", INTERPRETER, "-d -k=3");
+		check_output_run("Rot3D", EMULATOR,    "-d -k=3");
 
 		// Running on QPU will fail due to rounding errors
 		// This gets checked in `testRot3D`, where the kernels are run directly
@@ -1,8 +1,10 @@
 #include "catch.hpp"
+#include <algorithm>  // std::find_if()
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <V3DLib.h>
+#include "vc4/KernelDriver.h"
 #include "support/support.h"
 
 using namespace V3DLib;
@@ -457,6 +459,111 @@ void nested_for_kernel(Ptr<Int> result) {
 }
 
 
+/**
+ * Kernel with `If`-blocks, of which some can be converted to `Where`-blocks
+ */
+void if_conversion_kernel(Ptr<Int> result, Int n) {
+  Int x = 0;
+  Int y = 0;
+
+  For (Int m = 0, m < n, m++)
+    If ((m & 0x1) == 1)       // Converted
+      x += 1;
+    Else
+      y += 2;
+    End
+
+    If (any(index() == m))    // Not converted, condition differs per vector element
+      x += 10;
+    End
+
+    If (m == 3)               // Converted, as is the nested If
+      If (n > 5)
+        y += 100;
+      End
+    End
+
+    If (m == 2)               // Not converted, body too large
+      x += 1; y += 1;
+      x += 2; y += 2;
+      x += 3;
+    End
+  End
+
+  *result = x;
+  result += 16;
+  *result = y;
+}
+
+
+/**
+ * Kernel with a `Where`-body which is skipped when no vector element is selected
+ */
+void where_skip_kernel(Ptr<Int> result, Int limit) {
+  Int x   = index();
+  Int acc = 0;
+
+  For (Int i = 0, i < 8, i++)
+    Where (x < limit)
+      acc = acc + x;
+      acc = acc * 3;
+      acc = acc - i;
+      acc = acc + 1;
+      acc = acc ^ i;
+      acc = acc & 0xffff;
+      acc = acc + 7;
+      acc = acc - x;
+      x = x + 2;
+    Else
+      acc = acc + 1;
+    End
+  End
+
+  *result = acc;
+}
+
+
+/**
+ * Same as `where_skip_kernel()`, with a `Where`-body too short to be skipped
+ */
+void where_noskip_kernel(Ptr<Int> result, Int limit) {
+  Int x   = index();
+  Int acc = 0;
+
+  For (Int i = 0, i < 8, i++)
+    Where (x < limit)
+      acc = acc + x;
+    Else
+      acc = acc + 1;
+    End
+  End
+
+  *result = acc;
+}
+
+
+/**
+ * Compile the given kernel for vc4 and count the branches in the target code
+ */
+int num_branches(void (*f)(Ptr<Int> result, Int limit)) {
+  vc4::KernelDriver drv;
+  drv.compile_init();
+  Ptr<Int> result = mkArg< Ptr<Int> >();
+  Int limit       = mkArg<Int>();
+  f(result, limit);
+  drv.compile();
+
+  auto const &code = drv.targetCode();
+  int count = 0;
+
+  for (int i = 0; i < code.size(); i++) {
+    if (code[i].tag == BR || code[i].tag == BRL) count++;
+  }
+
+  return count;
+}
+
+
 TEST_CASE("Test For-loops", "[dsl][for]") {
   Platform::use_main_memory(true);
 
@@ -473,3 +580,87 @@ TEST_CASE("Test For-loops", "[dsl][for]") {
 
   Platform::use_main_memory(false);
 } 
+
+
+TEST_CASE("Small If-blocks should be converted to Where-blocks", "[dsl][ifconv]") {
+  auto k = compile(if_conversion_kernel);
+
+  // Converted: the first If, and the nested If's
+  auto const &passes = k.compile_stats(true).passes();
+  auto it = std::find_if(passes.begin(), passes.end(), [] (CompileStats::Pass const &pass) {
+    return pass.name == "if_conversion";
+  });
+  REQUIRE(it != passes.end());
+  REQUIRE(it->notes.size() == 3);
+
+  SharedArray<int> result(2*16);
+
+  for (int n : {0, 1, 3, 6, 20}) {
+    INFO("n: " << n);
+
+    int x = 0;
+    int y = 0;
+    for (int m = 0; m < n; m++) {
+      if (m % 2 == 1) x += 1; else y += 2;
+      if (m < 16) x += 10;
+      if (m == 3 && n > 5) y += 100;
+      if (m == 2) { x += 6; y += 3; }
+    }
+
+    vector<int> expected_x(16, x);
+    vector<int> expected_y(16, y);
+
+    k.load(&result, n);
+
+    result.fill(-1);
+    k.emu();
+    check_vector(result, 0, expected_x);
+    check_vector(result, 1, expected_y);
+
+    result.fill(-1);
+    k.interpret();
+    check_vector(result, 0, expected_x);
+    check_vector(result, 1, expected_y);
+  }
+}
+
+
+
+TEST_CASE("Where-bodies should be skipped if no element is selected", "[dsl][whereskip]") {
+  // Only the long body gets a branch over it
+  REQUIRE(num_branches(where_skip_kernel) == num_branches(where_noskip_kernel) + 1);
+
+  auto k = compile(where_skip_kernel);
+  SharedArray<int> result(16);
+
+  for (int limit : {0, 5, 12, 100}) {
+    INFO("limit: " << limit);
+
+    vector<int> expected;
+    for (int j = 0; j < 16; j++) {
+      int x   = j;
+      int acc = 0;
+
+      for (int i = 0; i < 8; i++) {
+        if (x < limit) {
+          acc = ((((acc + x)*3 - i + 1) ^ i) & 0xffff) + 7 - x;
+          x += 2;
+        } else {
+          acc += 1;
+        }
+      }
+
+      expected.push_back(acc);
+    }
+
+    k.load(&result, limit);
+
+    result.fill(-1);
+    k.emu();
+    check_vector(result, 0, expected);
+
+    result.fill(-1);
+    k.interpret();
+    check_vector(result, 0, expected);
+  }
+}
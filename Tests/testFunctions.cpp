@@ -0,0 +1,170 @@
+#include "catch.hpp"
+#include <algorithm>
+#include "V3DLib.h"
+
+using namespace V3DLib;
+
+namespace {
+
+int const VEC_SIZE = 16;
+
+/**
+ * Kernel for vector reductions and scans.
+ *
+ * Outputs one result vector per function.
+ */
+void vector_kernel(Ptr<Int> input, Ptr<Int> result) {
+  Int a = *input;
+
+  *result = reduce_add(a);          result += 16;
+  *result = reduce_min(a);          result += 16;
+  *result = reduce_max(a);          result += 16;
+  *result = scan_add(a);            result += 16;
+  *result = exclusive_scan_add(a);
+}
+
+
+void vector_float_kernel(Ptr<Float> input, Ptr<Float> result) {
+  Float a = *input;
+
+  *result = reduce_add(a);          result += 16;
+  *result = reduce_min(a);          result += 16;
+  *result = reduce_max(a);          result += 16;
+  *result = scan_add(a);            result += 16;
+  *result = exclusive_scan_add(a);
+}
+
+
+/**
+ * Kernel for cross-QPU reductions.
+ *
+ * Only QPU 0 outputs its result.
+ */
+void qpu_kernel(Ptr<Int> input, Ptr<Int> result, Ptr<Int> scratch1, Ptr<Int> scratch2) {
+  Int a = *input;
+
+  Int sum = reduce_add(a, scratch1);
+  Int mx  = reduce_max(a, scratch2);
+
+  If (me() == 0)
+    *result = sum;  result += 16;
+    *result = mx;
+  End
+}
+
+
+template<typename T>
+void check_vector(SharedArray<T> &input, SharedArray<T> &result) {
+  T sum = 0;
+  T mn  = input[0];
+  T mx  = input[0];
+
+  for (int i = 0; i < VEC_SIZE; i++) {
+    sum += input[i];
+    mn = std::min(mn, input[i]);
+    mx = std::max(mx, input[i]);
+  }
+
+  T prefix = 0;
+
+  for (int i = 0; i < VEC_SIZE; i++) {
+    INFO("i: " << i);
+    REQUIRE(result[i]              == sum);
+    REQUIRE(result[i + 1*VEC_SIZE] == mn);
+    REQUIRE(result[i + 2*VEC_SIZE] == mx);
+    REQUIRE(result[i + 4*VEC_SIZE] == prefix);
+    prefix += input[i];
+    REQUIRE(result[i + 3*VEC_SIZE] == prefix);
+  }
+}
+
+}  // anon namespace
+
+
+TEST_CASE("Reduction and scan functions should work", "[functions]") {
+  SECTION("Reductions and scans within a vector should work") {
+    SharedArray<int> input(VEC_SIZE);
+    SharedArray<int> result(5*VEC_SIZE);
+
+    for (int i = 0; i < VEC_SIZE; i++) {
+      input[i] = (i*7 + 3) % 11 - 5;  // Some negative values, not ordered
+    }
+
+    auto k = compile(vector_kernel);
+    k.load(&input, &result);
+
+    result.fill(-1);
+    k.emu();
+    check_vector(input, result);
+
+    result.fill(-1);
+    k.interpret();
+    check_vector(input, result);
+
+    // Power of two values, so that the float results are exact
+    SharedArray<float> input_f(VEC_SIZE);
+    SharedArray<float> result_f(5*VEC_SIZE);
+
+    for (int i = 0; i < VEC_SIZE; i++) {
+      input_f[i] = (float) ((i % 2 == 0)? (1 << i) : -(1 << (i/2)));
+    }
+
+    auto k2 = compile(vector_float_kernel);
+    k2.load(&input_f, &result_f);
+
+    result_f.fill(-1);
+    k2.emu();
+    check_vector(input_f, result_f);
+
+    result_f.fill(-1);
+    k2.interpret();
+    check_vector(input_f, result_f);
+  }
+
+
+  SECTION("Reductions over QPUs should work") {
+    int const MAX_QPUS = 8;
+
+    SharedArray<int> input(MAX_QPUS*VEC_SIZE);
+    SharedArray<int> result(2*VEC_SIZE);
+    SharedArray<int> scratch1(2*MAX_QPUS*VEC_SIZE);
+    SharedArray<int> scratch2(2*MAX_QPUS*VEC_SIZE);
+
+    for (int i = 0; i < (int) input.size(); i++) {
+      input[i] = (i*13) % 37;
+    }
+
+    auto k = compile(qpu_kernel);
+    k.load(&input, &result, &scratch1, &scratch2);
+
+    for (int num_qpus : {1, 2, 8}) {
+      INFO("Num QPUs: " << num_qpus);
+
+      int sum = 0;
+      int mx  = 0;
+      for (int i = 0; i < num_qpus*VEC_SIZE; i++) {
+        sum += input[i];
+        mx = std::max(mx, input[i]);
+      }
+
+      k.setNumQPUs(num_qpus);
+
+      for (int run = 0; run < 2; run++) {
+        scratch1.fill(0);
+        scratch2.fill(0);
+        result.fill(-1);
+
+        if (run == 0) {
+          k.emu();
+        } else {
+          k.interpret();
+        }
+
+        for (int i = 0; i < VEC_SIZE; i++) {
+          REQUIRE(result[i]            == sum);
+          REQUIRE(result[i + VEC_SIZE] == mx);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,465 @@
+#include "catch.hpp"
+#include <algorithm>  // std::count()
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include "V3DLib.h"
+
+using namespace V3DLib;
+
+namespace {
+
+void add_kernel(Ptr<Int> p, Int n) {
+  For (Int i = 0, i < 64, i = i + 16)
+    Int a = *p;
+    *p = a + n;
+    p = p + 16;
+  End
+}
+
+
+void mul_kernel(Ptr<Int> p, Int n) {
+  For (Int i = 0, i < 64, i = i + 16)
+    Int a = *p;
+    *p = a * n;
+    p = p + 16;
+  End
+}
+
+
+/**
+ * Multiplies the elements in range [offset, offset + n) by 3, distributed over the QPUs
+ */
+void mul_range_kernel(Int offset, Int n, Ptr<Int> p) {
+  Int inc = numQPUs() << 4;
+  p = p + offset;
+
+  For (Int i = 0, i < n, i = i + inc)
+    Int a = *p;
+    *p = a * 3;
+    p = p + inc;
+  End
+}
+
+}  // anon namespace
+
+
+TEST_CASE("Kernels should run asynchronously", "[kernel][launch]") {
+  const int SIZE = 64;
+
+  auto k = compile(add_kernel);
+
+  SharedArray<int> a(SIZE);
+  SharedArray<int> b(SIZE);
+  a.fill(0);
+  b.fill(0);
+
+  SECTION("Launch should run the kernel on a background thread") {
+    k.load(&a, 1);
+    KernelEvent ev = k.launch();
+    REQUIRE(ev.valid());
+
+    ev.wait();
+    REQUIRE(ev.ready());
+
+    for (int i = 0; i < SIZE; ++i) {
+      REQUIRE(a[i] == 1);
+    }
+  }
+
+  SECTION("Parameters can be loaded while the kernel runs") {
+    k.load(&a, 2);
+    KernelEvent ev1 = k.launch();
+    k.load(&b, 3);                   // Does not affect the running kernel
+    KernelEvent ev2 = k.launch();    // Waits for the first run
+
+    REQUIRE(ev1.ready());
+    ev2.wait();
+
+    REQUIRE(a[0] == 2);
+    REQUIRE(a[SIZE - 1] == 2);
+    REQUIRE(b[0] == 3);
+    REQUIRE(b[SIZE - 1] == 3);
+  }
+
+  SECTION("Host work should overlap with the kernel") {
+    auto k2 = compile(add_kernel);
+
+    k.load(&a, 1);
+    k2.load(&b, 1);
+
+    // Prepare the next batch while the kernels run
+    KernelEvent ev1 = k.launch();
+    KernelEvent ev2 = k2.launch();
+
+    std::vector<int> next(SIZE);
+    for (int i = 0; i < SIZE; ++i) {
+      next[i] = i;
+    }
+
+    ev1.wait();
+    ev2.wait();
+    REQUIRE(a[SIZE - 1] == 1);
+    REQUIRE(b[SIZE - 1] == 1);
+
+    a.copyFrom(next);
+    k.launch();
+    k.wait();
+    REQUIRE(a[10] == 11);
+  }
+
+  SECTION("Moving a kernel should wait for its run") {
+    k.load(&a, 1);
+    KernelEvent ev = k.launch();
+
+    auto k2 = std::move(k);
+    REQUIRE(ev.ready());
+    REQUIRE(a[SIZE - 1] == 1);
+
+    k2.load(&a, 2);
+    k2.call();
+    REQUIRE(a[0] == 3);
+    REQUIRE(a[SIZE - 1] == 3);
+  }
+
+  SECTION("A default event should be ready") {
+    KernelEvent ev;
+    REQUIRE(!ev.valid());
+    REQUIRE(ev.ready());
+    ev.wait();
+  }
+}
+
+
+TEST_CASE("Compile statistics should be collected per pass", "[kernel][stats]") {
+  SECTION("Passes should be recorded in order") {
+    CompileStats stats;
+    std::vector<int> code(10);
+
+    stats.start("ast");
+    stats.note("a \"quoted\" note");
+    stats.stop();
+
+    stats.measure("grow", code, [&code] { code.resize(15); });
+
+    auto const &passes = stats.passes();
+    REQUIRE(passes.size() == 2);
+    REQUIRE(!stats.running());
+
+    REQUIRE(passes[0].name == "ast");
+    REQUIRE(passes[0].instrs_before == -1);
+    REQUIRE(passes[0].instrs_after == -1);
+    REQUIRE(passes[0].notes.size() == 1);
+
+    REQUIRE(passes[1].name == "grow");
+    REQUIRE(passes[1].instrs_before == 10);
+    REQUIRE(passes[1].instrs_after == 15);
+    REQUIRE(passes[1].time_ms >= 0);
+    REQUIRE(stats.total_time_ms() >= passes[1].time_ms);
+
+    std::string json = stats.to_json("vc4");
+    REQUIRE(json.find("\"platform\": \"vc4\"") != std::string::npos);
+    REQUIRE(json.find("\"name\": \"ast\", ") != std::string::npos);
+    REQUIRE(json.find("\"instrs_before\": null") != std::string::npos);
+    REQUIRE(json.find("\"instrs_before\": 10, \"instrs_after\": 15") != std::string::npos);
+    REQUIRE(json.find("\"notes\": [\"a \\\"quoted\\\" note\"]") != std::string::npos);
+
+    stats.clear();
+    REQUIRE(stats.passes().empty());
+  }
+
+  SECTION("A kernel should have the stats of all compile passes") {
+    auto k = compile(add_kernel);
+    auto const &passes = k.compile_stats(true).passes();
+
+    std::vector<std::string> names;
+    for (auto const &pass : passes) names.push_back(pass.name);
+
+    for (auto name : {"AST build", "translate_stmt", "insertInitBlock", "loadStorePass",
+                      "buildCFG", "regAlloc", "satisfy", "removeLabels"}) {
+      INFO("pass: " << name);
+      REQUIRE(std::count(names.begin(), names.end(), name) == 1);
+    }
+  }
+
+  SECTION("Stats should be reset on recompile") {
+    vc4::KernelDriver drv;
+
+    auto build = [&drv] () {
+      drv.compile_init();
+      Ptr<Int> p = mkArg< Ptr<Int> >();
+      Int n      = mkArg<Int>();
+      add_kernel(p, n);
+      drv.compile();
+      return drv.stats().passes().size();
+    };
+
+    size_t first = build();
+    REQUIRE(first > 0);
+    REQUIRE(build() == first);
+  }
+}
+
+
+TEST_CASE("Command queues should run kernels in order", "[kernel][queue]") {
+  const int SIZE = 64;
+
+  auto add = compile(add_kernel);
+  auto mul = compile(mul_kernel);
+
+  SharedArray<int> a(SIZE);
+  SharedArray<int> b(SIZE);
+  a.fill(1);
+  b.fill(1);
+
+  CommandQueue queue;
+
+  add.load(&a, 2); queue.record(add);   // 3
+  mul.load(&a, 3); queue.record(mul);   // 9
+  add.load(&b, 5); queue.record(add);   // Same kernel, other parameters
+  add.load(&a, 1); queue.record(add);   // 10
+  REQUIRE(queue.size() == 4);
+
+  // Nothing should have run yet
+  REQUIRE(a[0] == 1);
+
+  queue.submit();
+  REQUIRE(queue.empty());
+
+  for (int i = 0; i < SIZE; ++i) {
+    INFO("i: " << i);
+    REQUIRE(a[i] == 10);
+    REQUIRE(b[i] == 6);
+  }
+
+  // The queue should be reusable
+  mul.load(&b, 2); queue.record(mul);
+  queue.submit();
+  REQUIRE(b[SIZE - 1] == 12);
+}
+
+
+TEST_CASE("Single parameters should be changeable after loading", "[kernel][set_arg]") {
+  const int SIZE = 64;
+
+  auto k = compile(add_kernel);
+
+  SharedArray<int> a(SIZE);
+  SharedArray<int> b(SIZE);
+  a.fill(0);
+  b.fill(0);
+
+  k.load(&a, 1);
+  k.call();
+
+  k.set_arg<1>(2);                  // Same array, other increment
+  k.call();
+  REQUIRE(a[0] == 3);
+
+  k.set_arg<0>(&b);                 // Other array, increment unchanged
+  k.call();
+  REQUIRE(a[SIZE - 1] == 3);
+  REQUIRE(b[0] == 2);
+  REQUIRE(b[SIZE - 1] == 2);
+
+  k.set_arg<0>(&a).set_arg<1>(10);
+  k.interpret();
+  REQUIRE(a[SIZE - 1] == 13);
+  REQUIRE(b[SIZE - 1] == 2);
+}
+
+
+/**
+ * Microbenchmark for the per-step overhead of changing parameters, intended to be run by hand:
+ *
+ *     runTests "[.kernelbench]"
+ *
+ * The parameter update is timed separately from the run, since in emulation mode
+ * the run time dominates.
+ */
+TEST_CASE("Benchmark parameter updates between kernel runs", "[.kernelbench]") {
+  using Clock = std::chrono::steady_clock;
+  using Ns    = std::chrono::duration<double, std::nano>;
+
+  const int SIZE      = 64;
+  const int NUM_STEPS = 1000;
+
+  auto k = compile(add_kernel);
+
+  SharedArray<int> a(SIZE);
+  SharedArray<int> b(SIZE);
+  a.fill(0);
+  b.fill(0);
+
+  auto run = [&] (bool use_set_arg) {
+    double update_ns = 0;
+    double total_ns  = 0;
+
+    k.load(&a, 1);
+
+    for (int i = 0; i < NUM_STEPS; ++i) {
+      auto start = Clock::now();
+
+      if (use_set_arg) {
+        k.set_arg<0>((i & 1)? &b : &a);
+      } else {
+        k.load((i & 1)? &b : &a, 1);
+      }
+
+      auto loaded = Clock::now();
+      k.call();
+
+      update_ns += Ns(loaded - start).count();
+      total_ns  += Ns(Clock::now() - start).count();
+    }
+
+    std::cout << (use_set_arg? "set_arg(): " : "load()   : ")
+              << (update_ns/NUM_STEPS) << " ns per update, "
+              << (total_ns/NUM_STEPS)  << " ns per step" << std::endl;
+  };
+
+  run(false);
+  run(true);
+
+  REQUIRE(a[0] == NUM_STEPS);
+  REQUIRE(b[0] == NUM_STEPS);
+}
+
+
+TEST_CASE("Task graphs should run tasks in order of dependencies", "[kernel][graph]") {
+  const int SIZE = 64;
+
+  auto add = compile(add_kernel);
+  auto mul = compile(mul_kernel);
+
+  SharedArray<int> a(SIZE);
+  SharedArray<int> b(SIZE);
+  SharedArray<int> c(SIZE);
+  SharedArray<int> d(SIZE);
+  a.fill(0);
+  b.fill(0);
+  c.fill(0);
+  d.fill(0);
+
+  TaskGraph graph;
+
+  add.load(&a, 1);
+  graph.add(add).reads(a).writes(a);                                // 0
+  mul.load(&a, 3);
+  graph.add(mul).reads(a).writes(a);                                // 1: after 0, same stage
+  graph.add_host([&] () { c.copyFrom(a.view().data(), SIZE); }).reads(a).writes(c);  // 2: after the kernels
+  add.load(&b, 2);
+  graph.add(add).reads(b).writes(b);                                // 3: independent
+  graph.add_host([&] () { d.fill(7); }).writes(d);                  // 4: independent, runs with the kernels
+  add.load(&c, 1);
+  graph.add(add).reads(c).writes(c);                                // 5: after host task 2
+
+  REQUIRE(graph.size() == 6);
+
+  graph.run();
+  REQUIRE(graph.num_stages() == 3);
+
+  REQUIRE(graph.task(1).dependencies() == std::vector<int>({0}));
+  REQUIRE(graph.task(2).dependencies() == std::vector<int>({0, 1}));
+  REQUIRE(graph.task(3).dependencies().empty());
+  REQUIRE(graph.task(5).dependencies() == std::vector<int>({2}));
+
+  for (int i = 0; i < SIZE; ++i) {
+    INFO("i: " << i);
+    REQUIRE(a[i] == 3);
+    REQUIRE(b[i] == 2);
+    REQUIRE(c[i] == 4);
+    REQUIRE(d[i] == 7);
+  }
+
+  // The graph should be rerunnable
+  graph.run();
+  REQUIRE(a[0] == 12);
+  REQUIRE(c[SIZE - 1] == 13);
+}
+
+
+TEST_CASE("Work should be split between QPUs and host", "[kernel][split]") {
+  using namespace std::chrono;
+
+  SECTION("Both parts should handle their range") {
+    const int SIZE = 16*64;
+    const int NUM_QPUS = 4;
+
+    auto k = compile(mul_range_kernel);
+    k.setNumQPUs(NUM_QPUS);
+
+    SharedArray<int> a(SIZE);
+    for (int i = 0; i < SIZE; ++i) {
+      a[i] = i;
+    }
+
+    WorkSplit split(16*NUM_QPUS);
+
+    for (int run = 0; run < 3; ++run) {
+      split.run(SIZE,
+        [&] (size_t first, size_t last) {
+          k.load((int) first, (int) (last - first), &a);
+          k.call();
+        },
+        [&] (size_t first, size_t last) {
+          for (size_t i = first; i < last; ++i) {
+            a[(int) i] *= 3;
+          }
+        });
+
+      REQUIRE(split.last_qpu_count() % (16*NUM_QPUS) == 0);
+    }
+
+    REQUIRE(split.qpu_rate() > 0.0);
+    REQUIRE(split.cpu_rate() > 0.0);
+
+    for (int i = 0; i < SIZE; ++i) {
+      INFO("i: " << i);
+      REQUIRE(a[i] == 27*i);
+    }
+  }
+
+  SECTION("The share of the QPUs should adapt to the throughput") {
+    const int SIZE = 16*100;
+
+    // The 'QPUs' are much faster than the 'host' here.
+    // The host work is serialized, so that its throughput doesn't depend on the number of cores.
+    auto qpu_func = [] (size_t first, size_t last) {
+      std::this_thread::sleep_for(microseconds(1*(last - first)));
+    };
+
+    std::mutex host_mutex;
+    auto cpu_func = [&host_mutex] (size_t first, size_t last) {
+      std::lock_guard<std::mutex> lock(host_mutex);
+      std::this_thread::sleep_for(microseconds(40*(last - first)));
+    };
+
+    WorkSplit split(16);
+    REQUIRE(split.qpu_share() == 0.5f);
+
+    for (int run = 0; run < 4; ++run) {
+      split.run(SIZE, qpu_func, cpu_func);
+    }
+
+    INFO("QPU share: " << split.qpu_share());
+    REQUIRE(split.qpu_share() > 0.7f);
+    REQUIRE(split.last_qpu_count() > SIZE/2);
+  }
+
+  SECTION("An empty part should not be run") {
+    std::atomic<int> qpu_calls(0);
+    std::atomic<int> cpu_items(0);
+
+    WorkSplit split(16, 0.0f);
+    split.run(100,
+      [&] (size_t, size_t) { qpu_calls++; },
+      [&] (size_t first, size_t last) { cpu_items += (int) (last - first); });
+
+    REQUIRE(qpu_calls == 0);
+    REQUIRE(cpu_items == 100);
+    REQUIRE(split.qpu_share() == 0.0f);  // Not adjusted without QPU measurement
+  }
+}
@@ -71,14 +71,8 @@ void matrix_copy_transposed(Arr &b, Arr &a, int dim) {
  * This is a kernel helper function.
  */
 void rotate_sum(Float &input, Float &result) {
-  result = input;
-
-  Float tmp = input;              comment("rotate_sum, loop unrolled");
-  for (int i = 0; i < 15; i++) {  // loop unroll
-    tmp = rotate(tmp, 1);
-    result += tmp;
-    //result = result + tmp;
-  }
+  comment("rotate_sum");
+  result = reduce_add(input);
 }
 
 
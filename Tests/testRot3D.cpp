@@ -2,6 +2,7 @@
 #include <math.h>
 #include <cmath>  // frexp()
 #include "../Examples/Rot3DLib/Rot3DKernels.h"
+#include "vc4/KernelDriver.h"
 
 using namespace Rot3DLib;
 
@@ -129,6 +130,32 @@ TEST_CASE("Test working of Rot3D example", "[rot3d]") {
       compareResults(x_1, y_1, x, y, N, "Rot3D_2 8 QPU's");
     }
 
+    auto k3 = compile(rot3D_3);
+
+    {
+      initArrays(x, y, N);
+      k3.load(N, cosf(THETA), sinf(THETA), &x, &y).call();
+      compareResults(x_1, y_1, x, y, N, "Rot3D_3");
+    }
+
+    if (!Platform::instance().has_vc4) {
+      INFO("Running with 8 kernels");
+      k3.setNumQPUs(8);
+      initArrays(x, y, N);
+      k3.load(N, cosf(THETA), sinf(THETA), &x, &y).call();
+      compareResults(x_1, y_1, x, y, N, "Rot3D_3 8 QPU's");
+
+      INFO("Running with 4 threads per QPU");
+      Platform::v3d_threads(4);
+      auto k4 = compile(rot3D_3);
+      Platform::v3d_threads(1);
+
+      k4.setNumQPUs(32);
+      initArrays(x, y, N);
+      k4.load(N, cosf(THETA), sinf(THETA), &x, &y).call();
+      compareResults(x_1, y_1, x, y, N, "Rot3D_3 4 threads");
+    }
+
     delete [] x_scalar;
     delete [] y_scalar;
   }
@@ -153,3 +180,386 @@ TEST_CASE("Test working of Rot3D example", "[rot3d]") {
     compareResults(x_1, y_1, x_2, y_2, N, "Rot3D_1 and Rot3D_2 1 QPU");
   }
 }
+
+
+// ============================================================================
+// Pipelining of loads in For-loops
+// ============================================================================
+
+namespace {
+
+// Two loads per iteration, pipelined
+void add_2(Int n, Ptr<Int> x, Ptr<Int> y) {
+  For (Int i = 0, i < n, i = i + 16)
+    Int a = x[i];
+    Int b = y[i];
+    x[i] = a + b;
+  End
+}
+
+
+// Three loads per iteration, does not fit in TMU FIFO; not pipelined
+void add_3(Int n, Ptr<Int> x, Ptr<Int> y, Ptr<Int> z) {
+  For (Int i = 0, i < n, i = i + 16)
+    Int a = x[i];
+    Int b = y[i];
+    Int c = z[i];
+    x[i] = a + b + c;
+  End
+}
+
+
+// Store overlaps with load of next iteration; not pipelined
+void running_sum(Int n, Ptr<Int> x) {
+  For (Int i = 1, i < n, i = i + 1)
+    Int a = x[i - 1];
+    Int b = x[i];
+    x[i] = a + b;
+  End
+}
+
+
+// Two stores via incremented pointers, batched on vc4
+void fill_2(Int n, Ptr<Int> x, Ptr<Int> y) {
+  For (Int i = 0, i < n, i = i + 1)
+    *x = i + index();
+    *y = 2*i;
+    x = x + 16;
+    y = y + 16;
+  End
+}
+
+
+// Loop variable differs per lane; not pipelined
+void add_lanes(Int n, Ptr<Int> x) {
+  For (Int i = index(), i < n, i = i + 16)
+    Int a = x[i];
+    x[i] = a + 1;
+  End
+}
+
+
+// Loop variable is assigned in a Where-block; not pipelined
+void add_where(Int n, Ptr<Int> x) {
+  Int start = 0;
+  Where (index() < 8)
+    start = 16;
+  End
+
+  For (Int i = start, i < n, i = i + 16)
+    Int a = x[i];
+    x[i] = a + 1;
+  End
+}
+
+
+// Loop variable derived from uniform values; pipelined
+void add_uniform(Int n, Ptr<Int> x) {
+  Int start = (me() << 4) + 16;
+
+  For (Int i = start, i < n, i = i + 16)
+    Int a = x[i];
+    x[i] = a + 1;
+  End
+}
+
+
+// Stores are masked for the tail, the load is still pipelined
+void add_par_for(Int n, Ptr<Int> x) {
+  ParFor (i, 0, n)
+    Int a = x[i];
+    x[i] = a + 1;
+  End
+}
+
+
+/**
+ * Compile the kernel for vc4 and count the pipelined loads in the source code
+ */
+int num_receives(void (*f)(Int n, Ptr<Int> x)) {
+  std::function<int(Stmt::Ptr)> count = [&count] (Stmt::Ptr s) -> int {
+    if (s.get() == nullptr) return 0;
+
+    switch (s->tag) {
+      case LOAD_RECEIVE: return 1;
+      case SEQ:          return count(s->seq_s0()) + count(s->seq_s1());
+      case WHILE:        return count(s->body());
+      case IF:
+      case WHERE:
+        return (s->then_is_null() ? 0 : count(s->thenStmt()))
+             + (s->else_is_null() ? 0 : count(s->elseStmt()));
+      default:           return 0;
+    }
+  };
+
+  vc4::KernelDriver drv;
+  drv.compile_init();
+  Int n      = mkArg<Int>();
+  Ptr<Int> x = mkArg< Ptr<Int> >();
+  f(n, x);
+  drv.compile();
+
+  return count(drv.sourceCode());
+}
+
+
+// Adds y to x in place, also tests masking of the tail
+template<ParForMode mode>
+void par_add(Int n, Ptr<Int> x, Ptr<Int> y) {
+  ParFor (i, 0, n, mode)
+    Int a = x[i];
+    Int b = y[i];
+    x[i] = a + b;
+  End
+}
+
+
+// Stores without a matching load, and within a control statement
+void par_fill(Int n, Ptr<Int> x) {
+  ParFor (i, 0, n)
+    If (n > 0)
+      x[i] = par_index(i);
+    End
+  End
+}
+
+}  // anon namespace
+
+
+TEST_CASE("Loads in For-loops should be pipelined correctly", "[rot3d][pipeline]") {
+  int const N = 64;
+
+  SharedArray<int> x(N + 16), y(N), z(N);
+
+  auto init = [&x, &y, &z] () {
+    for (int i = 0; i < (int) x.size(); i++) x[i] = i;
+    for (int i = 0; i < N; i++) {
+      y[i] = 2*i;
+      z[i] = 3*i;
+    }
+  };
+
+  auto run = [] (KernelBase &k, bool interpret) {
+    if (interpret) {
+      k.interpret();
+    } else {
+      k.emu();
+    }
+  };
+
+  for (int m = 0; m < 2; ++m) {
+    bool interpret = (m == 1);
+    INFO("Interpreter: " << interpret);
+
+    Platform::vc4_memory_path(VC4_MEM_TMU);  // Loads are only pipelined for vc4 on the TMU path
+
+    auto k2 = compile(add_2);
+    init();
+    k2.load(N, &x, &y);
+    run(k2, interpret);
+    for (int i = 0; i < N; i++) REQUIRE(x[i] == 3*i);
+    for (int i = N; i < N + 16; i++) REQUIRE(x[i] == i);  // Nothing written past end
+
+    init();
+    k2.load(0, &x, &y);  // Loop body not executed
+    run(k2, interpret);
+    for (int i = 0; i < N; i++) REQUIRE(x[i] == i);
+
+    auto k3 = compile(add_3);
+    init();
+    k3.load(N, &x, &y, &z);
+    run(k3, interpret);
+    for (int i = 0; i < N; i++) REQUIRE(x[i] == 6*i);
+
+    // Expected values, calculated with the vector semantics of the kernel
+    std::vector<int> expected(x.size());
+    for (int i = 0; i < (int) x.size(); i++) expected[i] = i;
+
+    int const n = 8;
+    for (int i = 1; i < n; i++) {
+      int tmp[16];
+      for (int l = 0; l < 16; l++) tmp[l] = expected[i - 1 + l] + expected[i + l];
+      for (int l = 0; l < 16; l++) expected[i + l] = tmp[l];
+    }
+
+    // Reads back its own stores, which is not reliable on the TMU path
+    Platform::vc4_memory_path(VC4_MEM_DMA);
+    auto k4 = compile(running_sum);
+    init();
+    k4.load(n, &x);
+    run(k4, interpret);
+    for (int i = 0; i < (int) x.size(); i++) REQUIRE(x[i] == expected[i]);
+  }
+}
+
+
+TEST_CASE("Only loops with a uniform loop variable should be pipelined", "[rot3d][pipeline]") {
+  Platform::vc4_memory_path(VC4_MEM_TMU);
+  int uniform = num_receives(add_uniform);
+  int lanes   = num_receives(add_lanes);
+  int where   = num_receives(add_where);
+  int par_for = num_receives(add_par_for);
+
+  Platform::pipeline_loads(false);
+  int disabled = num_receives(add_uniform);
+  Platform::pipeline_loads(true);
+
+  // TMU loads are not coherent with DMA stores
+  Platform::vc4_memory_path(VC4_MEM_DMA);
+  int dma = num_receives(add_uniform);
+
+  REQUIRE(uniform == 1);
+  REQUIRE(lanes == 0);
+  REQUIRE(where == 0);
+  REQUIRE(par_for == 1);
+  REQUIRE(disabled == 0);
+  REQUIRE(dma == 0);
+}
+
+
+TEST_CASE("Stores in loops should be batched correctly", "[rot3d][batch]") {
+  int const MAX_VECS = 10;  // Enough for all sizes of the last, partial batch
+  int const SIZE     = 16*(MAX_VECS + 1);
+
+  SharedArray<int> x(SIZE), y(SIZE);
+
+  auto k = compile(fill_2);
+  k.load(0, &x, &y);
+
+  for (int n = 0; n <= MAX_VECS; n++) {
+    for (int m = 0; m < 2; ++m) {
+      bool interpret = (m == 1);
+      INFO("n: " << n << ", interpreter: " << interpret);
+
+      x.fill(-1);
+      y.fill(-1);
+      k.load(n, &x, &y);
+
+      if (interpret) {
+        k.interpret();
+      } else {
+        k.emu();
+      }
+
+      for (int i = 0; i < SIZE; i++) {
+        int vec = i/16;
+        REQUIRE(x[i] == ((vec < n)? vec + i % 16 : -1));
+        REQUIRE(y[i] == ((vec < n)? 2*vec : -1));
+      }
+    }
+  }
+}
+
+
+TEST_CASE("ParFor should distribute the work over the QPUs", "[rot3d][parfor]") {
+  int const N    = 100;  // Deliberately not a multiple of 16
+  int const SIZE = 112;  // Padded to full vectors
+
+  SharedArray<int> x(SIZE), y(SIZE);
+
+  auto check = [&x, &y] (KernelBase &k, int num_qpus, bool interpret) {
+    INFO("Num QPUs: " << num_qpus << ", interpreter: " << interpret);
+
+    for (int i = 0; i < SIZE; i++) {
+      x[i] = i;
+      y[i] = 2*i;
+    }
+
+    k.setNumQPUs(num_qpus);
+
+    if (interpret) {
+      k.interpret();
+    } else {
+      k.emu();
+    }
+
+    for (int i = 0; i < N; i++)    REQUIRE(x[i] == 3*i);  // Every element handled exactly once
+    for (int i = N; i < SIZE; i++) REQUIRE(x[i] == i);    // Tail masked off
+  };
+
+  auto k1 = compile(par_add<BLOCK_CYCLIC>);
+  k1.load(N, &x, &y);
+
+  auto k2 = compile(par_add<CONTIGUOUS>);
+  k2.load(N, &x, &y);
+
+  for (int num_qpus : {1, 3, 8}) {
+    check(k1, num_qpus, false);
+    check(k1, num_qpus, true);
+    check(k2, num_qpus, false);
+    check(k2, num_qpus, true);
+  }
+
+  auto k3 = compile(par_fill);
+  k3.load(N, &x);
+
+  for (int num_qpus : {1, 8}) {
+    INFO("Num QPUs: " << num_qpus);
+    for (int i = 0; i < SIZE; i++) x[i] = -1;
+
+    k3.setNumQPUs(num_qpus);
+    k3.emu();
+
+    for (int i = 0; i < N; i++)    REQUIRE(x[i] == i);
+    for (int i = N; i < SIZE; i++) REQUIRE(x[i] == -1);
+  }
+}
+
+
+TEST_CASE("Kernels should work with the TMU memory path on vc4", "[rot3d][tmu]") {
+  int const N = 1920;
+  float const THETA = (float) 3.14159;
+
+  SharedArray<float> x_1(N), y_1(N);
+  SharedArray<float> x(N), y(N);
+
+  // Reference output, with the default DMA memory path
+  auto k = compile(rot3D_1);
+  initArrays(x_1, y_1, N);
+  k.load(N, cosf(THETA), sinf(THETA), &x_1, &y_1).emu();
+
+  auto check = [&] (KernelBase &k, int num_qpus, char const *label) {
+    INFO(label << ", num QPUs: " << num_qpus);
+    k.setNumQPUs(num_qpus);
+    initArrays(x, y, N);
+    k.emu();
+    compareResults(x_1, y_1, x, y, N, label);
+  };
+
+  for (auto path : {VC4_MEM_TMU, VC4_MEM_AUTO}) {
+    INFO("Memory path: " << path);
+    Platform::vc4_memory_path(path);
+    auto k1 = compile(rot3D_1);
+    auto k2 = compile(rot3D_2);
+    auto k3 = compile(rot3D_3);
+    Platform::vc4_memory_path(VC4_MEM_DMA);
+
+    k1.load(N, cosf(THETA), sinf(THETA), &x, &y);
+    k2.load(N, cosf(THETA), sinf(THETA), &x, &y);
+    k3.load(N, cosf(THETA), sinf(THETA), &x, &y);
+
+    check(k1, 1, "Rot3D_1");
+
+    for (int num_qpus : {1, 8}) {
+      check(k2, num_qpus, "Rot3D_2");
+      check(k3, num_qpus, "Rot3D_3");
+    }
+  }
+
+  // Kernel with regular loads, not pipelined
+  int const SIZE = 64;
+  SharedArray<int> a(SIZE), b(SIZE), c(SIZE);
+
+  for (int i = 0; i < SIZE; i++) {
+    a[i] = i;
+    b[i] = 2*i;
+    c[i] = 3*i;
+  }
+
+  Platform::vc4_memory_path(VC4_MEM_AUTO);
+  auto k4 = compile(add_3);
+  Platform::vc4_memory_path(VC4_MEM_DMA);
+
+  k4.load(SIZE, &a, &b, &c).emu();
+  for (int i = 0; i < SIZE; i++) REQUIRE(a[i] == 6*i);
+}
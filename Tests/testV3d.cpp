@@ -17,9 +17,13 @@
  ******************************************************************************/
 #ifdef QPU_MODE
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include "V3DLib.h"
 #include "Common/SharedArray.h"
 #include "v3d/v3d.h"
+#include "v3d/CycleModel.h"
 #include "v3d/instr/Instr.h"
 #include "v3d/instr/Snippets.h"
 #include "Support/Platform.h"
@@ -72,6 +76,56 @@ bool v3d_init() {
 
 }
 
+
+// Plain TMU load, a thread switch can be done while waiting for it
+void tmu_load(V3DLib::Int n, V3DLib::Ptr<V3DLib::Int> x) {
+	using namespace V3DLib;
+
+	Int a = *x;
+	*x = a + n;
+}
+
+
+// TMU load within a 'Where', the condition flags are live over the load
+void tmu_load_where(V3DLib::Int n, V3DLib::Ptr<V3DLib::Int> x) {
+	using namespace V3DLib;
+
+	Int a = 0;
+	Where (index() < n)
+		Int b = *x;
+		a = b + 1;
+	End
+	*x = a;
+}
+
+
+/**
+ * Count the thread switches in the v3d opcodes of the given kernel.
+ */
+int count_thrsw(void (*f)(V3DLib::Int, V3DLib::Ptr<V3DLib::Int>), int num_threads) {
+	using namespace V3DLib;
+
+	Platform::v3d_threads(num_threads);
+	auto k = compile(f);
+	Platform::v3d_threads(1);
+
+	k.setNumQPUs(8*num_threads);
+	k.pretty(false, "obj/test/thrsw_v3d.txt");
+
+	std::ifstream in("obj/test/thrsw_v3d.txt");
+	REQUIRE(in.is_open());
+	std::stringstream buf;
+	buf << in.rdbuf();
+	std::string code = buf.str();
+
+	int ret = 0;
+	for (size_t pos = code.find("thrsw"); pos != std::string::npos; pos = code.find("thrsw", pos + 1)) {
+		ret++;
+	}
+
+	return ret;
+}
+
 }  // anon namespace
 
 
@@ -80,6 +134,44 @@ bool v3d_init() {
 // The actual tests
 //////////////////////////////////
 
+TEST_CASE("Thread switches should only be inserted when safe", "[v3d][threads]") {
+	int base = count_thrsw(tmu_load, 1);  // Switches in init and end code
+
+	REQUIRE(count_thrsw(tmu_load, 4) == base + 1);
+	REQUIRE(count_thrsw(tmu_load_where, 1) == base);
+	REQUIRE(count_thrsw(tmu_load_where, 4) == base);  // Flags are not preserved over a switch
+}
+
+
+TEST_CASE("Thread switches should hide the TMU latency", "[v3d][threads]") {
+	using namespace V3DLib::v3d;
+	using namespace V3DLib::v3d::instr;
+
+	// One TMU load, optionally with a thread switch while it is outstanding
+	auto gather = [] (bool do_switch) {
+		std::vector<Instr> ret;
+
+		ret << mov(tmua, r0)
+		    << (do_switch? nop().thrsw() : nop())
+		    << nop()
+		    << nop()
+		    << nop().ldtmu(r4)
+		    << add(r0, r0, r4);
+
+		return ret;
+	};
+
+	auto one  = estimate_cycles(gather(false), 1);
+	auto same = estimate_cycles(gather(true), 1);  // Nothing to switch to
+	auto four = estimate_cycles(gather(true), 4);
+
+	REQUIRE(one.stall_cycles == 100 - 3);          // Latency minus the instructions in between
+	REQUIRE(same.cycles == one.cycles);
+	REQUIRE(four.per_instance() < one.per_instance()/2);
+	REQUIRE(four.stall_cycles < one.stall_cycles);
+}
+
+
 TEST_CASE("Test v3d opcodes", "[v3d][code][opcodes]") {
 	using namespace V3DLib::v3d::instr;
 	using Instructions =  V3DLib::v3d::Instructions;
@@ -17,6 +17,7 @@ OBJ := \
   vc4/DMA.o  \
   vc4/KernelDriver.o  \
   vc4/Translate.o  \
+  vc4/BatchStores.o  \
   vc4/Encode.o  \
   vc4/Mailbox.o  \
   vc4/PerformanceCounters.o  \
@@ -24,12 +25,21 @@ OBJ := \
   Support/debug.o  \
   Support/InstructionComment.o  \
   Support/basics.o  \
+  Support/CompileStats.o  \
   Support/HeapManager.o  \
+  Support/parallel.o  \
   SourceTranslate.o  \
   Kernel.o  \
+  CommandQueue.o  \
+  TaskGraph.o  \
+  WorkSplit.o  \
   KernelDriver.o  \
   Source/gather.o  \
   Source/StmtStack.o  \
+  Source/Pipeline.o  \
+  Source/IfConversion.o  \
+  Source/Uniformity.o  \
+  Source/Functions.o  \
   Source/Expr.o  \
   Source/Int.o  \
   Source/Interpreter.o  \
@@ -50,6 +60,7 @@ OBJ := \
   v3d/RegisterMapping.o  \
   v3d/Driver.o  \
   v3d/KernelDriver.o  \
+  v3d/CycleModel.o  \
   v3d/instr/Register.o  \
   v3d/instr/RFAddress.o  \
   v3d/instr/Snippets.o  \
@@ -57,6 +68,8 @@ OBJ := \
   v3d/instr/SmallImm.o  \
   v3d/PerformanceCounters.o  \
   Common/BufferObject.o  \
+  Common/SlabAllocator.o  \
+  Common/FileMapping.o  \
   Target/Syntax.o  \
   Target/Satisfy.o  \
   Target/Reg.o  \
@@ -98,6 +111,7 @@ EXAMPLES_EXTRA := \
 # support files for tests
 TESTS_FILES := \
   Tests/testBO.o  \
+  Tests/testKernel.o  \
   Tests/support/summation_kernel.o  \
   Tests/support/disasm_kernel.o  \
   Tests/support/support.o  \
@@ -105,6 +119,7 @@ TESTS_FILES := \
   Tests/support/rotate_kernel.o  \
   Tests/testAutoTest.o  \
   Tests/testRot3D.o  \
+  Tests/testFunctions.o  \
   Tests/testRegMap.o  \
   Tests/testSFU.o  \
   Tests/testConditionCodes.o  \